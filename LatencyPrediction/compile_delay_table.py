@@ -0,0 +1,109 @@
+import argparse
+import importlib.util
+import os
+import struct
+
+import numpy as np
+import pandas as pd
+from catboost import CatBoostRegressor
+
+# the table the C++ router loads for SAFEST_JOURNEY (PublicTransportNavigator/delayTable.h):
+# one byte per (gtfs route, hour of the week) so the router never runs the model
+TABLE_MAGIC = b"OTDT"
+TABLE_VERSION = 1
+HOURS_IN_WEEK = 168
+UNIT_SECONDS = 30  # one step of the quantized delay, 255 steps = 127.5 minutes
+
+
+def load_feature_engineering():
+    """Imports feature_engineering_and_merging.py.py (its file name is not a valid module name)."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "feature_engineering_and_merging.py.py")
+    spec = importlib.util.spec_from_file_location("feature_engineering_and_merging", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def make_query_rows(df):
+    """
+    Builds one row per (route, day in week, hour): the route's median trip moved to that hour and day.
+
+    Args:
+        df (pd.DataFrame): The combined history/GTFS/weather samples (`Tel-Aviv_latency_GFTS_weather_combine.csv`).
+
+    Returns:
+        pd.DataFrame: HOURS_IN_WEEK rows per `route_route_id`, ordered by route then bucket = (day-1)*24 + hour.
+
+    Notes:
+        - `trip_day_in_week` is taken as 1 = sunday, the same as the router's `Time.dayInWeek`.
+        - The target and the actual times are cleared, so the rows don't change the `avg_delay`/`avg_speed`
+          aggregates that `preprocess_features` computes over all the rows it gets.
+    """
+    rows = []
+    for route_id, group in df.groupby('route_route_id', sort=True):
+        template = group.sort_values('total_delay_min').iloc[len(group) // 2]
+        start = pd.to_datetime(template['scheduled_start_time'], errors='coerce')
+        end = pd.to_datetime(template['scheduled_end_time'], errors='coerce')
+        if pd.isna(start) or pd.isna(end):
+            continue
+        duration = end - start
+        for day in range(1, 8):
+            for hour in range(24):
+                row = template.copy()
+                row['trip_day_in_week'] = day
+                row['scheduled_start_time'] = start.replace(hour=hour, minute=0, second=0)
+                row['scheduled_end_time'] = row['scheduled_start_time'] + duration
+                row['total_delay_min'] = np.nan
+                row['actual_start_time'] = pd.NaT
+                row['actual_end_time'] = pd.NaT
+                rows.append(row)
+    return pd.DataFrame(rows)
+
+
+def quantize(delays_min, safety_factor):
+    """Minutes -> UNIT_SECONDS steps in a byte, early arrivals count as on time."""
+    steps = np.ceil(np.asarray(delays_min) * safety_factor * 60 / UNIT_SECONDS)
+    return np.clip(steps, 0, 255).astype(np.uint8)
+
+
+def write_table(path, route_ids, table):
+    """Writes the little endian table, see PublicTransportNavigator/delayTable.h for the layout."""
+    with open(path, "wb") as out:
+        out.write(TABLE_MAGIC)
+        out.write(struct.pack("<IIII", TABLE_VERSION, len(route_ids), HOURS_IN_WEEK, UNIT_SECONDS))
+        for route_id, delays in zip(route_ids, table):
+            out.write(struct.pack("<i", int(route_id)))
+            out.write(delays.tobytes())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile the delay predictions into the router's delay table")
+    parser.add_argument("--data", default=r"data\Tel-Aviv_latency_GFTS_weather_combine.csv")
+    parser.add_argument("--out", default="delay_table.bin")
+    parser.add_argument("--safety-factor", type=float, default=1.0,
+                        help="the transfer slack is this times the predicted delay")
+    args = parser.parse_args()
+
+    feature_engineering = load_feature_engineering()
+    df = pd.read_csv(args.data, encoding="utf-8-sig")
+    query_rows = make_query_rows(df)
+    # one preprocessing pass over both, so the one hot columns of the query rows match the training rows
+    X_all, _ = feature_engineering.preprocess_features(pd.concat([df, query_rows], ignore_index=True))
+    X_all = X_all.drop(columns=['total_delay_min'])
+    X_train, X_query = X_all.iloc[:len(df)], X_all.iloc[len(df):]
+
+    # the model chosen in model_evaluating.py
+    model = CatBoostRegressor(iterations=1000, learning_rate=0.1,
+                              depth=10, l2_leaf_reg=3,
+                              random_seed=42, verbose=0)
+    model.fit(X_train, df['total_delay_min'])
+    predictions = model.predict(X_query)
+
+    route_ids = query_rows['route_route_id'].iloc[::HOURS_IN_WEEK].to_numpy()
+    table = quantize(predictions, args.safety_factor).reshape(len(route_ids), HOURS_IN_WEEK)
+    write_table(args.out, route_ids, table)
+    print(f"wrote {len(route_ids)} routes x {HOURS_IN_WEEK} hours to {args.out}")
+
+
+if __name__ == "__main__":
+    main()
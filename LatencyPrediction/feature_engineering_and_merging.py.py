@@ -6,10 +6,13 @@ from meteostat import Point, Hourly
 from sklearn.compose import ColumnTransformer
 from sklearn.preprocessing import OneHotEncoder
 import os
+import subprocess
 
 # Define column names based on the data structure
 NUM_OF_WEATHER_LINES = 98123
 TEL_AVIV_LAT ,TEL_AVIV_LON = 32.0853, 34.7818
+# path of the compiled PublicTransportNavigator/tools/tripMatcher, if set it replaces the pandas trip matching
+TRIP_MATCHER = os.environ.get("TRIP_MATCHER")
 # Combining history and GTFS data:
 def filter_by_cluster(df,cluster_id = 11,cluster_name = "תל אביב"):
     """
@@ -224,7 +227,9 @@ def add_trip_info(history_routes_df, trips_df, stop_times_df, shapes_df):
         time_diff = (route_trips['aligned_scheduled_time'] - actual_start).abs()
         return route_trips.loc[time_diff.idxmin(), 'trip_id']
 
-    history_routes_df['gtfs_trip_id'] = history_routes_df.apply(find_closest_trip_cached, axis=1)
+    # the native matcher (PublicTransportNavigator/tools/tripMatcher) may have filled gtfs_trip_id already
+    if 'gtfs_trip_id' not in history_routes_df.columns:
+        history_routes_df['gtfs_trip_id'] = history_routes_df.apply(find_closest_trip_cached, axis=1)
     print("after the hard part")
     # 4. Map shape_id from trip_id
     history_routes_df['shape_id'] = history_routes_df['gtfs_trip_id'].map(dict(zip(trips_df['trip_id'], trips_df['shape_id'])))
@@ -309,7 +314,13 @@ def combine_history_with_GTFS():
     print("Merged route and history DataFrame shape:", merged_route_history_df.shape)
     #merge with GTFS stop_times
     merged_route_history_df.to_csv("routes_history_merged.csv", index=False, encoding='utf-8-sig')
-    merged_route_history_df = pd.read_csv(r'routes_history_merged.csv')
+    if TRIP_MATCHER:
+        # match the history to gtfs trips natively, add_trip_info then skips its row by row matching
+        subprocess.run([TRIP_MATCHER, "--data", "data/", "--history", "routes_history_merged.csv",
+                        "--out", "routes_history_matched.csv"], check=True)
+        merged_route_history_df = pd.read_csv(r'routes_history_matched.csv', encoding='utf-8-sig')
+    else:
+        merged_route_history_df = pd.read_csv(r'routes_history_merged.csv')
     print("start combining trip_id , num stops and distance with history")
     # Load GTFS files
     trips_df = pd.read_csv(r"data\trips.txt")  # contains route_id, trip_id, shape_id
@@ -0,0 +1,264 @@
+#include "batchRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "queryLog.h"
+#include "queryServer.h"
+#include "timeUtil.h"
+
+struct BatchQuery {
+    uint32_t index;
+    bool valid;
+    StopLocation startStop;
+    StopLocation endStop;
+    Time time;
+    int mode;
+};
+
+// ------------------------------ input ------------------------------
+
+template <typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+    return !text.empty() && std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+}
+static bool parseCsvQuery(std::string_view line, BatchQuery& query) {
+    std::string_view fields[8];
+    int numOfFields = 0;
+    while (numOfFields < 8) {
+        size_t comma = line.find(',');
+        fields[numOfFields++] = line.substr(0, comma);
+        if (comma == std::string_view::npos) break;
+        line.remove_prefix(comma + 1);
+    }
+    if (numOfFields < 7) return false;
+    query.mode = BEST_ARRIVAL_TIME;
+    if (numOfFields == 8) {
+        std::string_view mode = fields[7];
+        while (!mode.empty() && (mode.back() == '\r' || mode.back() == ' ')) mode.remove_suffix(1);
+        if (mode == "SAFEST") query.mode = SAFEST_JOURNEY;
+        else if (!mode.empty()) return false;
+    }
+    return parseNumber(fields[0], query.startStop.lat) && parseNumber(fields[1], query.startStop.lon) &&
+           parseNumber(fields[2], query.endStop.lat) && parseNumber(fields[3], query.endStop.lon) &&
+           timeUtil::parseTime(fields[4], query.time.curHourInSeconds) && parseNumber(fields[5], query.time.dayInWeek) &&
+           parseNumber(fields[6], query.time.date) && query.time.dayInWeek >= 1 && query.time.dayInWeek <= 7;
+}
+
+// the queries of the input file, the threads take them a chunk at a time
+class BatchInput {
+public:
+    bool open(const std::string& filename) {
+        std::ifstream probe(filename, std::ios::binary);
+        if (!probe.is_open()) {
+            std::cerr << "Could not open file: " << filename << std::endl;
+            return false;
+        }
+        char magic[4] = {};
+        queryLog = probe.read(magic, sizeof(magic)) && std::memcmp(magic, QUERY_LOG_MAGIC, 4) == 0;
+        if (queryLog) return logReader.open(filename);
+        csv.open(filename);
+        return csv.is_open();
+    }
+    bool take(std::vector<BatchQuery>& chunk) {
+        chunk.clear();
+        std::lock_guard<std::mutex> lock(inputMutex);
+        while (chunk.size() < BATCH_CHUNK) {
+            BatchQuery query{};
+            query.index = nextIndex;
+            if (queryLog) {
+                LoggedQuery logged;
+                if (!logReader.next(logged)) break;
+                query = {nextIndex, true, logged.startStop, logged.endStop, logged.time, logged.mode};
+            } else {
+                if (!std::getline(csv, line)) break;
+                if (line.empty() || line == "\r") continue;
+                if (firstLine && line.rfind("start_lat", 0) == 0) { // the header
+                    firstLine = false;
+                    continue;
+                }
+                query.valid = parseCsvQuery(line, query);
+            }
+            firstLine = false;
+            nextIndex++;
+            chunk.push_back(query);
+        }
+        return !chunk.empty();
+    }
+private:
+    bool queryLog = false;
+    QueryLogReader logReader;
+    std::ifstream csv;
+    std::string line;
+    bool firstLine = true;
+    uint32_t nextIndex = 0;
+    std::mutex inputMutex;
+};
+
+// ------------------------------ output ------------------------------
+
+static void appendInt(std::string& out, long long value) {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+static void appendBinaryInt(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+static void appendNdjson(std::string& out, const Preprocessor& timetable, const BatchQuery& query, const QueryResult& result) {
+    out += "{\"query\":";
+    appendInt(out, query.index);
+    if (!query.valid) {
+        out += ",\"error\":\"bad query\"}\n";
+        return;
+    }
+    out += result.partial ? ",\"partial\":true,\"journeys\":[" : ",\"partial\":false,\"journeys\":[";
+    bool first = true;
+    for (int numTransfers = 0; numTransfers <= MAX_NUM_OF_TRANSFERS; numTransfers++) {
+        const std::vector<UserStopState>& legs = result.journeys[numTransfers];
+        if (legs.empty()) continue;
+        out += first ? "{\"transfers\":" : ",{\"transfers\":";
+        first = false;
+        appendInt(out, numTransfers);
+        out += ",\"legs\":[";
+        for (size_t i = 0; i < legs.size(); i++) {
+            const UserStopState& leg = legs[i];
+            out += i ? ",{\"from\":" : "{\"from\":";
+            appendJsonString(out, leg.depStopName);
+            out += ",\"from_stop\":";
+            if (leg.depStopId == START_STOP_ID) out += "null";
+            else appendInt(out, timetable.gtfsStopIdOf(leg.depStopId));
+            out += ",\"to\":";
+            appendJsonString(out, leg.arrStopName);
+            out += ",\"to_stop\":";
+            if (leg.arrStopId == DEST_STOP_ID) out += "null";
+            else appendInt(out, timetable.gtfsStopIdOf(leg.arrStopId));
+            out += ",\"trip\":";
+            appendJsonString(out, leg.tripName);
+            out += ",\"dep\":";
+            appendInt(out, leg.aboardedTime);
+            out += ",\"arr\":";
+            appendInt(out, leg.arrTime);
+            out += '}';
+        }
+        out += "]}";
+    }
+    out += "]}\n";
+}
+
+static void appendBinary(std::string& out, const Preprocessor& timetable, const BatchQuery& query, const QueryResult& result) {
+    appendBinaryInt(out, query.index, 4);
+    int numOfJourneys = 0;
+    for (const std::vector<UserStopState>& legs : result.journeys) {
+        numOfJourneys += !legs.empty();
+    }
+    out += static_cast<char>(!query.valid ? BATCH_RECORD_ERROR : result.partial ? BATCH_RECORD_PARTIAL : 0);
+    out += static_cast<char>(query.valid ? numOfJourneys : 0);
+    if (!query.valid) return;
+    for (int numTransfers = 0; numTransfers <= MAX_NUM_OF_TRANSFERS; numTransfers++) {
+        const std::vector<UserStopState>& legs = result.journeys[numTransfers];
+        if (legs.empty()) continue;
+        out += static_cast<char>(numTransfers);
+        out += static_cast<char>(legs.size());
+        for (const UserStopState& leg : legs) {
+            appendBinaryInt(out, static_cast<uint32_t>(leg.depStopId == START_STOP_ID ? -1 : timetable.gtfsStopIdOf(leg.depStopId)), 4);
+            appendBinaryInt(out, static_cast<uint32_t>(leg.arrStopId == DEST_STOP_ID ? -1 : timetable.gtfsStopIdOf(leg.arrStopId)), 4);
+            appendBinaryInt(out, static_cast<uint32_t>(leg.aboardedTime), 4);
+            appendBinaryInt(out, static_cast<uint32_t>(leg.arrTime), 4);
+            const size_t nameLength = leg.tripId == FOOTPATH_TRIP_ID ? 0 : std::min<size_t>(leg.tripName.size(), 255);
+            out += static_cast<char>(nameLength);
+            out.append(leg.tripName.data(), nameLength);
+        }
+    }
+}
+
+// ------------------------------ run ------------------------------
+
+bool BatchRunner::run(const BatchOptions& options, BatchSummary& summary) {
+    summary = {};
+    BatchInput input;
+    if (!input.open(options.inputFile)) return false;
+    std::ofstream file(options.outputFile, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << options.outputFile << std::endl;
+        return false;
+    }
+    if (options.binary) {
+        std::string header = "OTJR";
+        appendBinaryInt(header, BATCH_RESULTS_VERSION, 4);
+        file.write(header.data(), static_cast<std::streamsize>(header.size()));
+        summary.outputBytes += static_cast<long long>(header.size());
+    }
+
+    std::mutex fileMutex;
+    std::atomic<long long> queries{0}, errors{0}, partials{0}, outputBytes{summary.outputBytes};
+    auto writeOut = [&](std::string& out) {
+        if (out.empty()) return;
+        std::lock_guard<std::mutex> lock(fileMutex);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        outputBytes += static_cast<long long>(out.size());
+        out.clear(); // keeps the capacity
+    };
+    auto worker = [&] {
+        RAPTOR raptor(timetable.tripProfiles, timetable.Aroutes, timetable.Astops, timetable.footpathGraph, timetable.stopsData,
+                      timetable.stopCoords, timetable.tripsData);
+        raptor.verbose = false;
+        raptor.delayTable = delayTable;
+        raptor.transferPatterns = transferPatterns;
+        raptor.streets = &timetable.streets;
+        std::string out;
+        out.reserve(BATCH_OUTPUT_BUFFER + (64 << 10)); // a record is far smaller than the slack
+        std::vector<BatchQuery> chunk;
+        chunk.reserve(BATCH_CHUNK);
+        while (input.take(chunk)) {
+            for (const BatchQuery& query : chunk) {
+                QueryResult result;
+                if (query.valid) {
+                    QueryOptions queryOptions;
+                    queryOptions.mode = query.mode;
+                    if (options.deadline.count() > 0) queryOptions.deadline = std::chrono::steady_clock::now() + options.deadline;
+                    result = raptor.query(query.startStop, query.endStop, query.time, queryOptions);
+                    partials += result.partial;
+                } else {
+                    errors++;
+                }
+                queries++;
+                if (options.binary) appendBinary(out, timetable, query, result);
+                else appendNdjson(out, timetable, query, result);
+                if (out.size() >= BATCH_OUTPUT_BUFFER) writeOut(out);
+            }
+        }
+        writeOut(out);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int thread = 1; thread < options.numOfThreads; thread++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    file.flush();
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summary.queries = queries;
+    summary.errors = errors;
+    summary.partials = partials;
+    summary.outputBytes = outputBytes;
+    if (!file) {
+        std::cerr << "Could not write file: " << options.outputFile << std::endl;
+        return false;
+    }
+    return true;
+}
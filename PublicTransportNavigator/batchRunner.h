@@ -0,0 +1,55 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+#include <chrono>
+#include <string>
+#include "preprocess.h"
+#include "routingAlgorithm.h"
+
+// runs a file of queries against one timetable on a pool of threads and streams the journeys to a file, for offline
+// analytics over millions of queries (main --batch).
+// input, read a chunk at a time: a query log ("OTQL", see queryLog.h - --log-queries or tools/replay --make-log) or csv
+// with one query per line, a first line starting with start_lat is a header:
+//   start_lat,start_lon,end_lat,end_lon,HH:MM:SS,dayInWeek 1-7,yyyymmdd[,SAFEST]
+// output, one record per query in the order the threads finish them, every record has the index of its query in the input:
+//   ndjson: {"query":0,"partial":false,"journeys":[...]} with the legs of the server ROUTE answers plus "from_stop" and
+//           "to_stop", the gtfs stop ids (null at the query locations). a line that isnt a query: {"query":0,"error":"..."}
+//   binary: "OTJR", uint32 version, then per query, little endian:
+//     uint32 query, uint8 flags (BATCH_RECORD_PARTIAL, BATCH_RECORD_ERROR), uint8 numOfJourneys
+//     numOfJourneys x { uint8 transfers, uint8 numOfLegs,
+//                       numOfLegs x { int32 fromGtfsStopId, int32 toGtfsStopId (-1 = the query location),
+//                                     int32 depTime, int32 arrTime, uint8 lineNameLength, lineName (empty = a walk) } }
+// every thread formats into an output buffer of its own, without allocating, and writes it out when it is full, so the
+// writing never holds up the searches
+#define BATCH_RESULTS_VERSION 1
+#define BATCH_CHUNK 64 // queries a thread takes from the input at a time
+#define BATCH_OUTPUT_BUFFER (4 << 20) // bytes a thread formats before it writes them out
+#define BATCH_RECORD_PARTIAL 1
+#define BATCH_RECORD_ERROR 2
+
+struct BatchOptions {
+    std::string inputFile;
+    std::string outputFile;
+    bool binary = false; // ndjson otherwise
+    int numOfThreads = 1;
+    std::chrono::milliseconds deadline{0}; // per query, 0 = none
+};
+struct BatchSummary {
+    long long queries = 0;
+    long long errors = 0; // lines that arent a query
+    long long partials = 0;
+    long long outputBytes = 0;
+    double seconds = 0;
+};
+
+class BatchRunner {
+public:
+    explicit BatchRunner(Preprocessor& timetable_) : timetable(timetable_) {}
+    bool run(const BatchOptions& options, BatchSummary& summary);
+    // what the searches of every thread use besides the timetable, like WorkerPool sets them
+    const DelayTable* delayTable = nullptr;
+    const TransferPatterns* transferPatterns = nullptr;
+private:
+    Preprocessor& timetable;
+};
+
+#endif //BATCHRUNNER_H
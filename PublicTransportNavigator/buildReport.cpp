@@ -0,0 +1,76 @@
+#include "buildReport.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+
+long BuildReport::peakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on linux
+}
+double BuildReport::cpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void BuildReport::runStage(const std::string& name, const std::function<void()>& stage) {
+    long rssBefore = peakRssKb();
+    double cpuBefore = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    stage();
+    auto end = std::chrono::steady_clock::now();
+    stages.push_back({name,
+                      std::chrono::duration<double>(end - start).count(),
+                      cpuSeconds() - cpuBefore,
+                      rssBefore,
+                      peakRssKb()});
+}
+void BuildReport::addFootprint(const std::string& name, size_t bytes) {
+    footprints.push_back({name, bytes});
+}
+double BuildReport::totalWallSeconds() const {
+    double total = 0;
+    for (const StageReport& stage : stages) {
+        total += stage.wallSeconds;
+    }
+    return total;
+}
+
+void BuildReport::writeJson(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return;
+    }
+    file << std::fixed << std::setprecision(6);
+    file << "{\n  \"total_wall_seconds\": " << totalWallSeconds() << ",\n";
+    file << "  \"peak_rss_kb\": " << peakRssKb() << ",\n";
+    file << "  \"stages\": [\n";
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageReport& stage = stages[i];
+        file << "    {\"name\": \"" << stage.name << "\", \"wall_seconds\": " << stage.wallSeconds
+             << ", \"cpu_seconds\": " << stage.cpuSeconds
+             << ", \"peak_rss_delta_kb\": " << stage.peakRssAfterKb - stage.peakRssBeforeKb << "}"
+             << (i + 1 < stages.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"footprint_bytes\": {\n";
+    for (size_t i = 0; i < footprints.size(); i++) {
+        file << "    \"" << footprints[i].name << "\": " << footprints[i].bytes
+             << (i + 1 < footprints.size() ? ",\n" : "\n");
+    }
+    file << "  }\n}\n";
+}
+
+void BuildReport::print() const {
+    for (const StageReport& stage : stages) {
+        std::cout << "stage " << stage.name << ": " << stage.wallSeconds << "s wall, " << stage.cpuSeconds
+                  << "s cpu, peak rss +" << (stage.peakRssAfterKb - stage.peakRssBeforeKb) / 1024 << " MB" << std::endl;
+    }
+    for (const FootprintReport& footprint : footprints) {
+        std::cout << "  " << footprint.name << ": " << footprint.bytes / (1024 * 1024) << " MB" << std::endl;
+    }
+}
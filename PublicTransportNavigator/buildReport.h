@@ -0,0 +1,62 @@
+#ifndef BUILDREPORT_H
+#define BUILDREPORT_H
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a profile of one preprocessing run: time and peak memory of every builder
+// and the live size of every data structure it left behind, dumped as json
+// so two feed versions (or two versions of the code) can be diffed
+struct StageReport {
+    std::string name;
+    double wallSeconds;
+    double cpuSeconds;
+    long peakRssBeforeKb;
+    long peakRssAfterKb; // the delta is how much this stage raised the high water mark
+};
+struct FootprintReport {
+    std::string name;
+    size_t bytes;
+};
+
+class BuildReport {
+public:
+    void runStage(const std::string& name, const std::function<void()>& stage);
+    void addFootprint(const std::string& name, size_t bytes);
+    double totalWallSeconds() const;
+    void writeJson(const std::string& filename) const;
+    void print() const;
+
+    std::vector<StageReport> stages;
+    std::vector<FootprintReport> footprints;
+
+    static long peakRssKb();
+    static double cpuSeconds();
+};
+
+// --- byte accounting helpers, they count the heap owned by the container and not the container object itself ---
+inline size_t heapBytes(const std::string& str) {
+    static const size_t ssoCapacity = std::string().capacity();
+    return str.capacity() > ssoCapacity ? str.capacity() + 1 : 0;
+}
+template <typename T>
+size_t heapBytes(const std::vector<T>& vec) {
+    return vec.capacity() * sizeof(T);
+}
+// for vectors of strings/vectors also count what the elements own
+template <typename T>
+size_t deepHeapBytes(const std::vector<T>& vec) {
+    size_t bytes = heapBytes(vec);
+    for (const T& item : vec) {
+        bytes += heapBytes(item);
+    }
+    return bytes;
+}
+// node based map: the bucket array plus one node per element (value, next pointer and the cached hash)
+template <typename K, typename V, typename H>
+size_t hashMapNodeBytes(const std::unordered_map<K, V, H>& map) {
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void*));
+}
+
+#endif //BUILDREPORT_H
@@ -0,0 +1,174 @@
+#include "delayOverlay.h"
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+
+DelayOverlay::DelayOverlay(Preprocessor& timetable_) : timetable(timetable_), tripRoute(NUM_OF_REAL_TRIPS, -1) {
+    for (int routeId = 0; routeId < NUM_OF_ALGO_ROUTES; routeId++) {
+        for (const std::vector<ATrip>& tripsOnDay : timetable.Aroutes[routeId].third) {
+            for (const ATrip& trip : tripsOnDay) {
+                tripRoute[trip.tripId] = routeId;
+            }
+        }
+    }
+    owned = std::make_unique<DelaySnapshot>();
+    owned->chunks.resize((NUM_OF_ALGO_ROUTES + DELAY_ROUTE_CHUNK - 1) / DELAY_ROUTE_CHUNK);
+    owned->tripRoute = &tripRoute;
+    current.store(owned.get());
+}
+
+// ------------------------------ readers ------------------------------
+
+DelayPin::DelayPin(DelayOverlay& overlay_) : overlay(overlay_) {
+    slot = overlay.readers.pin(overlay.current, pinned);
+}
+
+DelayPin::~DelayPin() {
+    // the same as ~TimetableGuard: nothing of the snapshot is read once the slot is empty
+    const bool retired = pinned->retired.load();
+    overlay.readers.unpin(slot);
+    if (retired || overlay.current.load() != pinned) {
+        overlay.reclaim(); // we might have been the last query on a replaced snapshot
+    }
+}
+
+// ------------------------------ writers ------------------------------
+
+void DelayOverlay::publish(std::unique_ptr<DelaySnapshot> next) {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    DelaySnapshot* previous = owned.release();
+    owned = std::move(next);
+    current.store(owned.get()); // from now on new queries read the new delays
+    previous->retired.store(true);
+    retired.emplace_back(previous);
+}
+
+void DelayOverlay::reclaim() {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    std::erase_if(retired, [this](const std::unique_ptr<DelaySnapshot>& snapshot) { return !readers.held(snapshot.get()); });
+}
+
+int DelayOverlay::apply(const std::vector<TripDelayUpdate>& updates) {
+    std::lock_guard<std::mutex> lock(applyMutex);
+    std::unordered_map<int,std::vector<const TripDelayUpdate*>> updatesByRoute;
+    for (const TripDelayUpdate& update : updates) {
+        if (update.tripId < 0 || update.tripId >= NUM_OF_REAL_TRIPS || tripRoute[update.tripId] == -1) continue;
+        updatesByRoute[tripRoute[update.tripId]].push_back(&update);
+    }
+    if (updatesByRoute.empty()) return 0;
+
+    // copy on write: the queries keep using the snapshot they pinned, the new one shares the chunks that dont change
+    auto next = std::make_unique<DelaySnapshot>();
+    next->chunks = owned->chunks;
+    next->tripRoute = &tripRoute;
+    next->batch = owned->batch + 1;
+    std::unordered_map<int,std::shared_ptr<DelayChunk>> copiedChunks; // the chunks of this batch, copied once each
+    auto setRoute = [&](int routeId, std::shared_ptr<const RouteDelays> delays) {
+        std::shared_ptr<DelayChunk>& chunk = copiedChunks[routeId / DELAY_ROUTE_CHUNK];
+        if (!chunk) {
+            const std::shared_ptr<const DelayChunk>& previousChunk = owned->chunks[routeId / DELAY_ROUTE_CHUNK];
+            chunk = previousChunk ? std::make_shared<DelayChunk>(*previousChunk) : std::make_shared<DelayChunk>();
+        }
+        (*chunk)[routeId % DELAY_ROUTE_CHUNK] = std::move(delays);
+    };
+    for (const auto& [routeId, routeUpdates] : updatesByRoute) {
+        const RouteDelays* previous = owned->route(routeId);
+        auto delays = previous ? std::make_shared<RouteDelays>(*previous) : std::make_shared<RouteDelays>();
+        for (const TripDelayUpdate* update : routeUpdates) {
+            std::vector<TripStop> delayed = timetable.tripProfiles.stops(update->tripId);
+            bool anyDelay = false;
+            size_t nextDelay = 0;
+            int delay = 0;
+            for (TripStop& tripStop : delayed) {
+                // the stops of a trip and the updates are both sorted by stop sequence
+                while (nextDelay < update->stopDelays.size() && update->stopDelays[nextDelay].first <= tripStop.stopSeqIndex) {
+                    delay = update->stopDelays[nextDelay].second;
+                    nextDelay++;
+                }
+                tripStop.arrTime += delay;
+                tripStop.depTime += delay;
+                anyDelay |= delay != 0;
+            }
+            if (anyDelay) {
+                delays->delayedTrips[update->tripId] = std::move(delayed);
+            } else {
+                delays->delayedTrips.erase(update->tripId); // back on time
+            }
+        }
+
+        if (delays->delayedTrips.empty()) {
+            if (previous) numOfDelayedRoutes--;
+            setRoute(routeId, nullptr);
+            continue;
+        }
+        // a delayed trip can now leave after the trips that were behind it, re sort every day by the delayed
+        // departure at the first stop and check that no trip overtakes another one further down the route
+        const auto& route = timetable.Aroutes[routeId];
+        const size_t numOfStops = route.second.size();
+        delays->fifo = true;
+        for (int day = 0; day < NUM_OF_DAYS; day++) {
+            std::vector<ATrip>& tripsOnDay = delays->tripsByDay[day];
+            tripsOnDay = route.third[day];
+            const RouteDelays& routeDelays = *delays;
+            std::stable_sort(tripsOnDay.begin(), tripsOnDay.end(), [this, &routeDelays](const ATrip& trip1, const ATrip& trip2) {
+                return routeDelays.stop(timetable.tripProfiles, trip1.tripId, 0).depTime <
+                       routeDelays.stop(timetable.tripProfiles, trip2.tripId, 0).depTime;
+            });
+            for (size_t i = 1; delays->fifo && i < tripsOnDay.size(); i++) {
+                for (size_t stopSeqIndex = 0; stopSeqIndex < numOfStops; stopSeqIndex++) {
+                    TripStop stopBefore = routeDelays.stop(timetable.tripProfiles, tripsOnDay[i - 1].tripId, stopSeqIndex);
+                    TripStop stopAfter = routeDelays.stop(timetable.tripProfiles, tripsOnDay[i].tripId, stopSeqIndex);
+                    if (stopBefore.depTime > stopAfter.depTime || stopBefore.arrTime > stopAfter.arrTime) {
+                        delays->fifo = false;
+                        break;
+                    }
+                }
+            }
+        }
+        if (!previous) numOfDelayedRoutes++;
+        setRoute(routeId, std::move(delays));
+    }
+    for (auto& [chunkId, chunk] : copiedChunks) {
+        // a chunk whose routes are all back on time goes away, the search then skips it with one null check
+        bool anyDelayed = std::any_of(chunk->begin(), chunk->end(), [](const auto& routeDelays) { return routeDelays != nullptr; });
+        next->chunks[chunkId] = anyDelayed ? std::move(chunk) : nullptr;
+    }
+    publish(std::move(next));
+    numOfBatches++; // after the swap, a search that sees the new count reads the new delays
+    reclaim();
+    return static_cast<int>(updatesByRoute.size());
+}
+
+std::vector<GtfsDelay> readDelayFeed(std::istream& in) {
+    std::vector<GtfsDelay> delays;
+    std::string line, tripId, stopSeqStr, delayStr;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line.rfind("trip_id", 0) == 0) continue;
+        std::istringstream iss(line);
+        std::getline(iss, tripId, ',');
+        std::getline(iss, stopSeqStr, ',');
+        std::getline(iss, delayStr, ',');
+        int stopSeq, delaySeconds;
+        if (std::from_chars(stopSeqStr.data(), stopSeqStr.data() + stopSeqStr.size(), stopSeq).ec != std::errc() ||
+            std::from_chars(delayStr.data(), delayStr.data() + delayStr.size(), delaySeconds).ec != std::errc()) {
+            std::cerr << "Bad delay line: " << line << std::endl;
+            continue;
+        }
+        delays.push_back({tripId, stopSeq, delaySeconds});
+    }
+    return delays;
+}
+
+std::vector<TripDelayUpdate> toTripUpdates(const std::unordered_map<std::string,std::vector<std::pair<int,int>>>& delaysByTrip,
+                                           const Preprocessor& timetable) {
+    std::vector<TripDelayUpdate> updates;
+    for (const auto& [gtfsTripId, stopDelays] : delaysByTrip) {
+        int tripId = timetable.findTripId(gtfsTripId);
+        if (tripId == -1) continue; // not in this version of the feed
+        TripDelayUpdate update{tripId, stopDelays};
+        std::sort(update.stopDelays.begin(), update.stopDelays.end());
+        updates.push_back(std::move(update));
+    }
+    return updates;
+}
@@ -0,0 +1,118 @@
+#ifndef DELAYOVERLAY_H
+#define DELAYOVERLAY_H
+#include <array>
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "preprocess.h"
+#include "readerSlots.h"
+
+// real time delays on top of a built timetable, without rebuilding it.
+// the timetable itself is never written: a route with delayed trips gets a copy on write RouteDelays that holds the
+// delayed stop times of those trips and the trips of every day re sorted by their delayed departure. only a route
+// that has one costs the search more than a null check.
+// every batch publishes a new DelaySnapshot, the RouteDelays of all the routes in chunks of DELAY_ROUTE_CHUNK, that
+// shares the chunks the batch didnt touch with the one before, so a batch costs the size of the routes it touches, a
+// chunk of pointers for each of them and one pointer per chunk. a query pins the snapshot when it starts (DelayPin)
+// and reads only that one, so it boards and arrives on the same delays.
+// a replaced snapshot is freed once no query holds it, pinned the same way as the timetable versions (readerSlots.h)
+#define MAX_DELAY_READERS 256 // queries holding a snapshot at once, more wait for a slot
+#define DELAY_ROUTE_CHUNK 64 // routes per chunk of a snapshot, a batch copies only the chunks of the routes it touches
+
+// the delays of one trip, like a gtfs realtime TripUpdate: each (stop_sequence, delay) holds from that stop on
+// until the next listed stop, so a delay reported at one stop propagates down the rest of the trip
+struct TripDelayUpdate {
+    int tripId;
+    std::vector<std::pair<int,int>> stopDelays; // (gtfs stop_sequence, delay in seconds), an empty list clears the trip
+};
+
+struct RouteDelays {
+    std::unordered_map<int,std::vector<TripStop>> delayedTrips; // key = trip id, only the trips that have a delay
+    std::array<std::vector<ATrip>,NUM_OF_DAYS> tripsByDay; // Aroutes third, sorted by the delayed departures
+    bool fifo = true; // false when a delayed trip overtook another one, the search cant binary search the route then
+
+    TripStop stop(const TripProfiles& scheduled, int tripId, int stopSeqIndex) const {
+        auto delayed = delayedTrips.find(tripId);
+        return delayed == delayedTrips.end() ? scheduled.stop(tripId, stopSeqIndex) : delayed->second[stopSeqIndex];
+    }
+};
+
+// DELAY_ROUTE_CHUNK consecutive route ids, null where no trip of the route is delayed
+using DelayChunk = std::array<std::shared_ptr<const RouteDelays>,DELAY_ROUTE_CHUNK>;
+
+// the delays of every route after one batch, never changed once it is published
+struct DelaySnapshot {
+    std::vector<std::shared_ptr<const DelayChunk>> chunks; // per chunk of route ids, null when none of them is delayed
+    const std::vector<int>* tripRoute; // of the overlay, trip id -> the route it belongs to
+    int batch = 0; // the batches that patched a route up to this one
+    std::atomic<bool> retired{false};
+
+    // null when no trip of the route is delayed, the search then reads the timetable directly
+    const RouteDelays* route(int routeId) const {
+        const DelayChunk* chunk = chunks[routeId / DELAY_ROUTE_CHUNK].get();
+        return chunk ? (*chunk)[routeId % DELAY_ROUTE_CHUNK].get() : nullptr;
+    }
+    int routeOfTrip(int tripId) const { return (*tripRoute)[tripId]; }
+};
+
+class DelayOverlay {
+public:
+    explicit DelayOverlay(Preprocessor& timetable_);
+    DelayOverlay(const DelayOverlay&) = delete;
+    DelayOverlay& operator=(const DelayOverlay&) = delete;
+
+    // returns the number of routes that got new delays
+    int apply(const std::vector<TripDelayUpdate>& updates);
+    int delayedRoutes() const { return numOfDelayedRoutes.load(); }
+    int batches() const { return numOfBatches.load(); } // the batches that patched a route, changes with every delay
+
+private:
+    friend class DelayPin;
+    void publish(std::unique_ptr<DelaySnapshot> next);
+    void reclaim(); // frees the replaced snapshots no query holds
+
+    Preprocessor& timetable;
+    std::vector<int> tripRoute; // trip id -> the route it belongs to
+    std::unique_ptr<DelaySnapshot> owned; // the published snapshot
+    std::atomic<const DelaySnapshot*> current{nullptr};
+    std::vector<std::unique_ptr<DelaySnapshot>> retired;
+    ReaderSlots<DelaySnapshot, MAX_DELAY_READERS> readers;
+    std::mutex applyMutex; // one writer at a time, the readers never take it
+    std::mutex retiredMutex; // the swap and the retired snapshots, taken by the last reader of a replaced one
+    std::atomic<int> numOfDelayedRoutes{0};
+    std::atomic<int> numOfBatches{0};
+};
+
+// holds the delay snapshot that is current when it is made until it goes away, one per query
+class DelayPin {
+public:
+    explicit DelayPin(DelayOverlay& overlay_);
+    ~DelayPin();
+    DelayPin(const DelayPin&) = delete;
+    DelayPin& operator=(const DelayPin&) = delete;
+    const DelaySnapshot& snapshot() const { return *pinned; }
+private:
+    DelayOverlay& overlay;
+    int slot;
+    const DelaySnapshot* pinned = nullptr;
+};
+
+// the delay feed format that stands in for gtfs realtime, one line per stop:
+//   trip_id,stop_sequence,delay_seconds
+// (a header line starting with trip_id is skipped). all the lines of a trip in one batch are its full update
+struct GtfsDelay {
+    std::string gtfsTripId;
+    int stopSeq;
+    int delaySeconds;
+};
+std::vector<GtfsDelay> readDelayFeed(std::istream& in);
+// groups the lines by trip and maps the gtfs trip ids to the ids of timetable, unknown trips are skipped
+std::vector<TripDelayUpdate> toTripUpdates(const std::unordered_map<std::string,std::vector<std::pair<int,int>>>& delaysByTrip,
+                                           const Preprocessor& timetable);
+
+#endif //DELAYOVERLAY_H
@@ -0,0 +1,54 @@
+#include "delayTable.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// the same explicit little endian reading as the query log
+static uint64_t getInt(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+bool DelayTable::load(const std::string& filename, const Preprocessor& timetable) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[20];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, "OTDT", 4) != 0 ||
+        getInt(header + 4, 4) != DELAY_TABLE_VERSION || getInt(header + 12, 4) != HOURS_IN_WEEK) {
+        std::cerr << "Not a delay table: " << filename << std::endl;
+        return false;
+    }
+    uint32_t numOfRoutes = getInt(header + 8, 4);
+    unitSeconds = static_cast<int>(getInt(header + 16, 4));
+    delays.assign(static_cast<size_t>(numOfRoutes) * HOURS_IN_WEEK, 0);
+    std::unordered_map<int,int> gtfsRouteRow;
+    unsigned char row[4 + HOURS_IN_WEEK];
+    for (uint32_t rowIndex = 0; rowIndex < numOfRoutes; rowIndex++) {
+        if (!file.read(reinterpret_cast<char*>(row), sizeof(row))) {
+            std::cerr << "Truncated delay table: " << filename << std::endl;
+            delays.clear();
+            return false;
+        }
+        gtfsRouteRow[static_cast<int32_t>(getInt(row, 4))] = static_cast<int>(rowIndex);
+        std::memcpy(&delays[rowIndex * HOURS_IN_WEEK], row + 4, HOURS_IN_WEEK);
+    }
+    tripRow.assign(NUM_OF_REAL_TRIPS, -1);
+    int tripsWithPrediction = 0;
+    for (int tripId = 0; tripId < NUM_OF_REAL_TRIPS; tripId++) {
+        if (!timetable.tripProfiles.hasTrip(tripId)) continue;
+        auto row = gtfsRouteRow.find(timetable.tripsData[tripId].gtfsRouteId);
+        if (row != gtfsRouteRow.end()) {
+            tripRow[tripId] = row->second;
+            tripsWithPrediction++;
+        }
+    }
+    std::cout << "delay table: " << numOfRoutes << " routes, " << tripsWithPrediction << " trips with a prediction" << std::endl;
+    return true;
+}
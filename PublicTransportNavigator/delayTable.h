@@ -0,0 +1,36 @@
+#ifndef DELAYTABLE_H
+#define DELAYTABLE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "preprocess.h"
+
+// the predicted delays of the LatencyPrediction model, compiled offline (LatencyPrediction/compile_delay_table.py)
+// into one byte per (gtfs route, hour of the week) so the search never runs the model, a lookup is two array reads.
+// file format, little endian:
+//   "OTDT", uint32 version, uint32 numOfRoutes, uint32 bucketsPerRoute (168), uint32 unitSeconds
+//   numOfRoutes x { int32 gtfsRouteId, uint8 delay[168] }   delay in unitSeconds, bucket = (dayInWeek-1)*24 + hour
+#define DELAY_TABLE_VERSION 1
+#define HOURS_IN_WEEK 168
+
+class DelayTable {
+public:
+    // maps every trip of timetable to its row, so the table is tied to one timetable version
+    bool load(const std::string& filename, const Preprocessor& timetable);
+    // the predicted delay of a trip that arrives at time on dayInWeek (1 = sunday), 0 when there is no prediction
+    int delaySeconds(int tripId, int dayInWeek, int time) const {
+        if (tripId < 0 || tripId >= NUM_OF_REAL_TRIPS) return 0; // a footpath
+        int row = tripRow[tripId];
+        if (row == -1) return 0;
+        int hours = time / 3600; // past midnight trips run into the next day
+        int bucket = ((dayInWeek - 1 + hours / 24) % NUM_OF_DAYS) * 24 + hours % 24;
+        return delays[row * HOURS_IN_WEEK + bucket] * unitSeconds;
+    }
+    int numOfRoutes() const { return static_cast<int>(delays.size() / HOURS_IN_WEEK); }
+private:
+    int unitSeconds = 0;
+    std::vector<uint8_t> delays; // row * HOURS_IN_WEEK + bucket
+    std::vector<int> tripRow; // trip id -> row, -1 = the route has no prediction
+};
+
+#endif //DELAYTABLE_H
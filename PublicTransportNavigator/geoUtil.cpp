@@ -88,16 +88,17 @@ std::vector<std::string>  Geohash::getGeohashNeighbors(const std::string &geohas
     double lon_err = (bbox.lon_max - bbox.lon_min) / 2;
 
     std::vector<std::string> neighbors;
-    // Offsets: north, south, east, west, NE, NW, SE, SW
+    // Offsets: north, south, east, west, NE, NW, SE, SW - a whole box away from the center, half a box is the edge
+    // and an edge belongs to the box below it
     std::vector<std::pair<double, double>> offsets = {
-        { lat_err,      0          },   // north
-        {-lat_err,      0          },   // south
-        { 0,            lon_err    },   // east
-        { 0,           -lon_err    },   // west
-        { lat_err,      lon_err    },   // northeast
-        { lat_err,     -lon_err    },   // northwest
-        {-lat_err,      lon_err    },   // southeast
-        {-lat_err,     -lon_err    }    // southwest
+        { 2 * lat_err,      0              },   // north
+        {-2 * lat_err,      0              },   // south
+        { 0,                2 * lon_err    },   // east
+        { 0,               -2 * lon_err    },   // west
+        { 2 * lat_err,      2 * lon_err    },   // northeast
+        { 2 * lat_err,     -2 * lon_err    },   // northwest
+        {-2 * lat_err,      2 * lon_err    },   // southeast
+        {-2 * lat_err,     -2 * lon_err    }    // southwest
     };
 
     for (const auto &offset : offsets) {
@@ -111,6 +112,62 @@ std::vector<std::string>  Geohash::getGeohashNeighbors(const std::string &geohas
     return neighbors;
 }
 
+uint32_t Geohash::encodeCell(double latitude, double longitude, int precision) {
+    // the bits encodeGeohash packs into its characters, in the same order (longitude first)
+    double lat_min = -90.0, lat_max = 90.0;
+    double lon_min = -180.0, lon_max = 180.0;
+    uint32_t cell = 0;
+    for (int bit = 0; bit < 5 * precision; bit++) {
+        cell <<= 1;
+        if (bit % 2 == 0) {
+            double mid = (lon_min + lon_max) / 2;
+            if (longitude > mid) {
+                cell |= 1;
+                lon_min = mid;
+            } else {
+                lon_max = mid;
+            }
+        } else {
+            double mid = (lat_min + lat_max) / 2;
+            if (latitude > mid) {
+                cell |= 1;
+                lat_min = mid;
+            } else {
+                lat_max = mid;
+            }
+        }
+    }
+    return cell;
+}
+
+std::vector<uint32_t> Geohash::getCellNeighbors(uint32_t cell, int precision) {
+    // split the bits into the column (longitude) and the row (latitude) of the box, step to the boxes around it and
+    // interleave them back. the columns wrap around the date line, there is nothing past the poles
+    const int numOfBits = 5 * precision;
+    const int lonBits = (numOfBits + 1) / 2, latBits = numOfBits / 2;
+    uint32_t column = 0, row = 0;
+    for (int bit = 0; bit < numOfBits; bit++) {
+        uint32_t value = (cell >> (numOfBits - 1 - bit)) & 1;
+        if (bit % 2 == 0) column = (column << 1) | value;
+        else row = (row << 1) | value;
+    }
+    std::vector<uint32_t> neighbors;
+    neighbors.reserve(9);
+    for (int rowStep = -1; rowStep <= 1; rowStep++) {
+        long long neighborRow = static_cast<long long>(row) + rowStep;
+        if (neighborRow < 0 || neighborRow >= (1LL << latBits)) continue;
+        for (int columnStep = -1; columnStep <= 1; columnStep++) {
+            uint32_t neighborColumn = (column + static_cast<uint32_t>(columnStep)) & ((1u << lonBits) - 1);
+            uint32_t neighbor = 0;
+            for (int bit = 0; bit < numOfBits; bit++) {
+                int shift = bit % 2 == 0 ? lonBits - 1 - bit / 2 : latBits - 1 - bit / 2;
+                neighbor = (neighbor << 1) | (((bit % 2 == 0 ? neighborColumn : static_cast<uint32_t>(neighborRow)) >> shift) & 1);
+            }
+            neighbors.push_back(neighbor);
+        }
+    }
+    return neighbors;
+}
 
 // Haversine formula (in meters)
 double haversineDistance(double lat1, double lon1, double lat2, double lon2) {
@@ -4,6 +4,7 @@
 
 #ifndef GEOHASH_H
 #define GEOHASH_H
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -19,6 +20,9 @@ class Geohash {
    static std::string encodeGeohash(double latitude, double longitude, int precision );
     static BoundingBox decodeGeohash(const std::string &geohash);
     static std::vector<std::string> getGeohashNeighbors(const std::string &geohash);
+    // the same boxes as integers: the bits of the geohash, 5 per character so at most 6 characters
+    static uint32_t encodeCell(double latitude, double longitude, int precision);
+    static std::vector<uint32_t> getCellNeighbors(uint32_t cell, int precision); // the box and the 8 around it
 };
 double haversineDistance(double lat1, double lon1, double lat2, double lon2);
 int calculateWalkTime(double distanceMeters) ;
@@ -0,0 +1,58 @@
+#include "interleavedRunner.h"
+#include <algorithm>
+
+InterleavedRunner::InterleavedRunner(Preprocessor& timetable, int width) {
+    // the lanes take turns on one thread and a walk over the streets runs without a break, so they share one search
+    if (!timetable.streets.empty()) streetSearch = std::make_unique<PedestrianSearch>(*timetable.streets.graph);
+    for (int lane = 0; lane < std::max(1, width); lane++) {
+        lanes.push_back(std::make_unique<RAPTOR>(timetable.tripProfiles, timetable.Aroutes, timetable.Astops, timetable.footpathGraph,
+                                                 timetable.stopsData, timetable.stopCoords, timetable.tripsData));
+        lanes.back()->verbose = false;
+        lanes.back()->interleaved = true;
+        lanes.back()->streets = &timetable.streets;
+        lanes.back()->streetSearch = streetSearch.get();
+    }
+}
+
+void InterleavedRunner::run(const std::function<bool(InterleavedQuery&)>& next,
+                            const std::function<void(const InterleavedQuery&, QueryResult&)>& done) {
+    std::vector<Flight> flights(lanes.size());
+    bool moreQueries = true;
+    size_t inFlight = 0;
+    // gives a free lane its next query, the ones the transfer patterns answer right away dont take the lane
+    auto startNext = [&](size_t lane) {
+        Flight& flight = flights[lane];
+        RAPTOR& raptor = *lanes[lane];
+        while (moreQueries) {
+            if (!next(flight.query)) {
+                moreQueries = false;
+                return;
+            }
+            flight.result = QueryResult{};
+            const InterleavedQuery& query = flight.query;
+            if (raptor.beginQuery(query.startStop, query.endStop, query.time, query.options, flight.result)) {
+                raptor.finishQuery(flight.result);
+                done(query, flight.result);
+                continue;
+            }
+            flight.task.emplace(raptor.searchSteps(query.startStop, query.endStop, query.time));
+            inFlight++;
+            return;
+        }
+    };
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        startNext(lane);
+    }
+    while (inFlight > 0) {
+        for (size_t lane = 0; lane < lanes.size(); lane++) {
+            Flight& flight = flights[lane];
+            if (!flight.task || flight.task->resume()) continue;
+            flight.result.journeys = std::move(flight.task->journeys());
+            flight.task.reset();
+            inFlight--;
+            lanes[lane]->finishQuery(flight.result);
+            done(flight.query, flight.result);
+            startNext(lane);
+        }
+    }
+}
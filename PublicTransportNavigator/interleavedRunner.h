@@ -0,0 +1,41 @@
+#ifndef INTERLEAVEDRUNNER_H
+#define INTERLEAVEDRUNNER_H
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "preprocess.h"
+#include "routingAlgorithm.h"
+
+// runs several queries on one thread at once for batch work (tools/replay, matrices): a query is mostly waiting for
+// cache misses, so every search prefetches the route, the stops or the footpaths it reads next and gives the thread
+// to the next query in the meantime (RAPTOR::searchSteps), round robin over up to width queries in flight.
+// the answers are the same as RAPTOR::query, only the order they are done in depends on the mix
+#define INTERLEAVE_WIDTH 8 // queries in flight per thread by default
+
+struct InterleavedQuery {
+    size_t index; // the caller's, handed back with the answer
+    StopLocation startStop;
+    StopLocation endStop;
+    Time time;
+    QueryOptions options;
+};
+
+class InterleavedRunner {
+public:
+    InterleavedRunner(Preprocessor& timetable, int width = INTERLEAVE_WIDTH);
+    // takes queries from next until it returns false and hands every answer to done as soon as it is ready,
+    // the query stats (collectStats) then include the time the thread spent on the other queries
+    void run(const std::function<bool(InterleavedQuery&)>& next,
+             const std::function<void(const InterleavedQuery&, QueryResult&)>& done);
+    std::vector<std::unique_ptr<RAPTOR>> lanes; // one per query in flight, their delays and tables are set like any RAPTOR
+private:
+    std::unique_ptr<PedestrianSearch> streetSearch; // of all the lanes, null without streets
+    struct Flight {
+        InterleavedQuery query;
+        QueryResult result;
+        std::optional<SearchTask> task; // empty = the lane is free
+    };
+};
+
+#endif //INTERLEAVEDRUNNER_H
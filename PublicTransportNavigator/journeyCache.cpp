@@ -0,0 +1,107 @@
+#include "journeyCache.h"
+#include <algorithm>
+#include <sstream>
+#include "geoUtil.h"
+
+std::size_t JourneyCacheKeyHash::operator()(const JourneyCacheKey& key) const {
+    std::size_t seed = key.startCell;
+    for (uint32_t value : {key.endCell, static_cast<uint32_t>(key.date), static_cast<uint32_t>(key.bucket), static_cast<uint32_t>(key.mode)}) {
+        seed ^= std::hash<uint32_t>()(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+JourneyCache::JourneyCache(size_t capacity) : capacityPerShard(std::max<size_t>(1, capacity / JOURNEY_CACHE_SHARDS)) {}
+
+JourneyCacheKey JourneyCache::keyOf(double startLat, double startLon, double endLat, double endLon, int time, int date, int mode) {
+    return {Geohash::encodeCell(startLat, startLon, JOURNEY_CACHE_CELL_PRECISION),
+            Geohash::encodeCell(endLat, endLon, JOURNEY_CACHE_CELL_PRECISION),
+            date, time / (JOURNEY_CACHE_BUCKET_MINUTES * 60), mode};
+}
+
+bool JourneyCache::current(uint64_t queryGeneration) {
+    uint64_t known = generation.load();
+    while (queryGeneration > known) {
+        if (generation.compare_exchange_weak(known, queryGeneration)) {
+            // only frees the old entries: lookup and insert compare the generation of the entry under the lock of its
+            // shard, so a query that comes in while the shards are cleared one by one never gets an old one
+            stats.invalidations++;
+            for (Shard& shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.entries.clear();
+                shard.lru.clear();
+            }
+            break;
+        }
+    }
+    return generation.load() == queryGeneration;
+}
+
+bool JourneyCache::lookup(const JourneyCacheKey& key, uint64_t queryGeneration, int time, CachedJourneys& journeys) {
+    if (!current(queryGeneration)) { // a query still on an older version
+        stats.misses++;
+        return false;
+    }
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.entries.find(key);
+    if (found == shard.entries.end() || found->second->generation != queryGeneration || time < found->second->validFrom) {
+        stats.misses++;
+        return false;
+    }
+    if (time > found->second->validUntil) {
+        // its first trips are gone, the search replaces it
+        stats.stale++;
+        stats.misses++;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    journeys = found->second->journeys; // a hit or stale, the caller that checks the journeys counts it
+    return true;
+}
+
+void JourneyCache::insert(const JourneyCacheKey& key, uint64_t queryGeneration, int validFrom, int validUntil, CachedJourneys journeys) {
+    if (!current(queryGeneration)) return;
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (generation.load() != queryGeneration) return; // dropped since
+    auto found = shard.entries.find(key);
+    if (found != shard.entries.end()) {
+        // a search after a stale hit or from before the entry, its journeys replace the ones that couldnt be used
+        *found->second = {key, queryGeneration, validFrom, validUntil, std::move(journeys)};
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    } else {
+        shard.lru.push_front({key, queryGeneration, validFrom, validUntil, std::move(journeys)});
+        shard.entries[key] = shard.lru.begin();
+        if (shard.lru.size() > capacityPerShard) {
+            shard.entries.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+            stats.evictions++;
+        }
+    }
+    stats.inserts++;
+}
+
+size_t JourneyCache::size() {
+    size_t entries = 0;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        entries += shard.lru.size();
+    }
+    return entries;
+}
+
+std::string JourneyCache::statsJson() {
+    long long hits = stats.hits.load(), misses = stats.misses.load();
+    std::ostringstream oss;
+    oss << "{\"entries\":" << size()
+        << ",\"capacity\":" << capacityPerShard * JOURNEY_CACHE_SHARDS
+        << ",\"hits\":" << hits
+        << ",\"misses\":" << misses
+        << ",\"stale\":" << stats.stale.load()
+        << ",\"hit_rate\":" << (hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0)
+        << ",\"inserts\":" << stats.inserts.load()
+        << ",\"evictions\":" << stats.evictions.load()
+        << ",\"invalidations\":" << stats.invalidations.load() << "}";
+    return oss.str();
+}
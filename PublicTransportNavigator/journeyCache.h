@@ -0,0 +1,93 @@
+#ifndef JOURNEYCACHE_H
+#define JOURNEYCACHE_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// the journeys of recent queries, shared by the workers of the server: requests from the same neighbourhood to the
+// same neighbourhood at about the same time are answered from the journeys of the first one. the key is the geohash
+// cells of the two locations, the service date, the departure bucket and the mode. the walks at both ends are redone
+// for the actual locations and the trips in between are the cached ones, so a hit is only used when the first trip of
+// every cached journey can still be caught from the actual start at the actual time (RAPTOR::searchJourneyCache).
+// an entry is valid for the departures from the one it was searched at until the first trip of its journeys leaves: an
+// earlier query in the same bucket could catch a trip the search never saw, it searches and its journeys replace the entry.
+// JOURNEY_CACHE_SHARDS shards with a lock and an lru list each, a query locks only the shard of its key.
+// an entry is only good for the timetable version and the delays it was searched on, it keeps that generation and
+// only a query of the same one gets it. the first query on a newer generation also drops every entry, to free them.
+#define JOURNEY_CACHE_SHARDS 16
+#define JOURNEY_CACHE_CELL_PRECISION 6 // geohash length of the key cells, about 1.2 x 0.6 km
+#define JOURNEY_CACHE_BUCKET_MINUTES 5
+
+struct JourneyCacheKey {
+    uint32_t startCell;
+    uint32_t endCell;
+    int date;
+    int bucket; // departure time / JOURNEY_CACHE_BUCKET_MINUTES
+    int mode;
+    bool operator==(const JourneyCacheKey& other) const = default;
+};
+struct JourneyCacheKeyHash {
+    std::size_t operator()(const JourneyCacheKey& key) const;
+};
+
+// a leg like RAPTORStopState, the names are looked up again on a hit
+struct CachedLeg {
+    int depStopId;
+    int arrStopId;
+    int tripId;
+    int depTime;
+    int arrTime;
+};
+typedef std::vector<std::vector<CachedLeg>> CachedJourneys; // index = round, like JourneysToDest
+
+struct JourneyCacheStats {
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+    std::atomic<long long> stale{0}; // found, but the actual start cant catch its first trip anymore (counted as misses too)
+    std::atomic<long long> inserts{0};
+    std::atomic<long long> evictions{0};
+    std::atomic<long long> invalidations{0}; // the whole cache dropped for a newer timetable or delays
+};
+
+class JourneyCache {
+public:
+    explicit JourneyCache(size_t capacity); // entries over all the shards
+    JourneyCache(const JourneyCache&) = delete;
+    JourneyCache& operator=(const JourneyCache&) = delete;
+
+    static JourneyCacheKey keyOf(double startLat, double startLon, double endLat, double endLon, int time, int date, int mode);
+    // generation: the timetable version and the delays the query reads (TimetableGuard::generation), only entries of
+    // the same generation whose validity has the departure time are returned. false on a miss, a found entry is counted
+    // as a hit or as stale by the caller
+    bool lookup(const JourneyCacheKey& key, uint64_t generation, int time, CachedJourneys& journeys);
+    // validFrom: the departure time the journeys were searched at, validUntil: the last one they can be reused for
+    void insert(const JourneyCacheKey& key, uint64_t generation, int validFrom, int validUntil, CachedJourneys journeys);
+    size_t size();
+    std::string statsJson();
+    JourneyCacheStats stats;
+private:
+    struct Entry {
+        JourneyCacheKey key;
+        uint64_t generation;
+        int validFrom, validUntil; // departure times, seconds from midnight
+        CachedJourneys journeys;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<JourneyCacheKey,std::list<Entry>::iterator,JourneyCacheKeyHash> entries;
+    };
+    Shard& shardOf(const JourneyCacheKey& key) { return shards[JourneyCacheKeyHash()(key) % JOURNEY_CACHE_SHARDS]; }
+    bool current(uint64_t queryGeneration); // drops everything when queryGeneration is newer, false when it is older
+
+    std::array<Shard,JOURNEY_CACHE_SHARDS> shards;
+    size_t capacityPerShard;
+    std::atomic<uint64_t> generation{0};
+};
+
+#endif //JOURNEYCACHE_H
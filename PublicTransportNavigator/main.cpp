@@ -3,6 +3,11 @@
 #include "preprocess.h"
 #include "routingAlgorithm.h"
 #include "timeUtil.h"
+#include "queryLog.h"
+#include "queryServer.h"
+#include "shardCoordinator.h"
+#include "batchRunner.h"
+#include <thread>
 #include <stack>
 
 
@@ -17,7 +22,7 @@ void print_journey(std::vector<UserStopState>&journey) {
         <<" at time "
           << timeUtil::convertSecondsToTime(stopInfo.arrTime)
           << " with trip: "
-          << stopInfo.tripName<< std::endl;
+          << stopInfo.tripName<< '\n'; // print_algo_results flushes once after the journey
 
     }
 }
@@ -39,27 +44,141 @@ void print_algo_results(RAPTOR& raptor,JourneysToDest& journeys_to_dest) {
 
 }
 void score_algorithm_results(){}
-int main() {
+// usage: main [--data <feed dir>] [--log-queries <file>] [--serve <unix socket path>] [--workers <n>] [--reload-interval <seconds>]
+//             [--delays <delay feed file>] [--delay-interval <seconds>] [--delay-table <compiled delay predictions>]
+//             [--layout gtfs|locality] [--stations on|off] [--max-footpaths <k nearest per stop, 0 = all>]
+//             [--transfer-patterns <tools/transferPatternBuilder output>] [--deadline-ms <per query budget of the server, the coordinator and --batch, 0 = none>]
+//             [--shards <shards config, with --serve: coordinator of the shard servers instead of a timetable>]
+//             [--walk-shortcuts <tools/walkShortcutBuilder output>] [--journey-cache <entries the server caches, 0 = off>]
+//             [--osm <openstreetmap extract in osm xml, the walks go over its streets>] [--stats on|off]
+//             [--batch <queries csv or query log> --out <results file> [--format ndjson|binary]]   (runs them on --workers threads)
+int main(int argc, char* argv[]) {
+    PreprocessOptions preprocessOptions;
+    std::string queryLogFile, socketPath, delayFile, shardsFile;
+    int numOfWorkers = std::max(1u, std::thread::hardware_concurrency());
+    int reloadIntervalSeconds = 60;
+    int delayIntervalSeconds = 30;
+    int deadlineMillis = 0;
+    int journeyCacheEntries = 0;
+    bool printStats = false; // the search stats of the single query, collecting them costs a little on every step
+    BatchOptions batchOptions;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--data") {
+            // a different feed (e.g. one from tools/feedGenerator), the checker only knows the israeli one
+            preprocessOptions.dataDir = argv[i + 1];
+            preprocessOptions.runChecker = false;
+        }
+        else if (arg == "--log-queries") queryLogFile = argv[i + 1];
+        else if (arg == "--serve") socketPath = argv[i + 1];
+        else if (arg == "--workers") numOfWorkers = std::stoi(argv[i + 1]);
+        else if (arg == "--reload-interval") reloadIntervalSeconds = std::stoi(argv[i + 1]);
+        else if (arg == "--delays") delayFile = argv[i + 1];
+        else if (arg == "--delay-interval") delayIntervalSeconds = std::stoi(argv[i + 1]);
+        else if (arg == "--delay-table") preprocessOptions.delayTableFile = argv[i + 1];
+        else if (arg == "--layout") preprocessOptions.localityOrder = std::string(argv[i + 1]) == "locality"; // gtfs (default) or locality
+        else if (arg == "--stations") preprocessOptions.stationAggregation = std::string(argv[i + 1]) == "on"; // default off = every platform is its own stop
+        else if (arg == "--max-footpaths") preprocessOptions.maxFootpathsPerStop = std::stoi(argv[i + 1]);
+        else if (arg == "--transfer-patterns") preprocessOptions.transferPatternsFile = argv[i + 1];
+        else if (arg == "--deadline-ms") deadlineMillis = std::stoi(argv[i + 1]);
+        else if (arg == "--shards") shardsFile = argv[i + 1];
+        else if (arg == "--walk-shortcuts") preprocessOptions.walkShortcutsFile = argv[i + 1];
+        else if (arg == "--journey-cache") journeyCacheEntries = std::stoi(argv[i + 1]);
+        else if (arg == "--osm") preprocessOptions.osmFile = argv[i + 1];
+        else if (arg == "--stats") printStats = std::string(argv[i + 1]) == "on"; // default off
+        else if (arg == "--batch") batchOptions.inputFile = argv[i + 1];
+        else if (arg == "--out") batchOptions.outputFile = argv[i + 1];
+        else if (arg == "--format") batchOptions.binary = std::string(argv[i + 1]) == "binary"; // ndjson (default) or binary
+    }
+    // record the queries so they can be replayed later with tools/replay
+    QueryLogWriter queryLog;
+    bool logQueries = !queryLogFile.empty() && queryLog.open(queryLogFile);
 
-    std::unique_ptr<Preprocessor> preprocessorPtr = std::make_unique<Preprocess>();
+    if (!socketPath.empty() && !shardsFile.empty()) {
+        // coordinator mode: no timetable here, every region is served by a shard process of its own
+        ShardCoordinator coordinator(deadlineMillis);
+        if (!coordinator.load(shardsFile) || !coordinator.listenUnix(socketPath)) {
+            return 1;
+        }
+        std::cout << "coordinating " << coordinator.numOfShards() << " shards with " << coordinator.numOfBorderStops()
+                  << " border stops on " << socketPath << std::endl;
+        coordinator.serve();
+        return 0;
+    }
+    if (!socketPath.empty()) {
+        // server mode: keep the timetable in memory and answer queries until killed,
+        // a republished feed is rebuilt in the background and swapped in without dropping queries
+        TimetableStore store(preprocessOptions);
+        store.load();
+        store.startReloader(std::chrono::seconds(reloadIntervalSeconds));
+        if (!delayFile.empty()) {
+            store.startDelayFeed(delayFile, std::chrono::seconds(delayIntervalSeconds));
+        }
+        std::unique_ptr<JourneyCache> journeyCache = journeyCacheEntries > 0 ? std::make_unique<JourneyCache>(journeyCacheEntries) : nullptr;
+        QueryServer server(store, numOfWorkers, logQueries ? &queryLog : nullptr, deadlineMillis, journeyCache.get());
+        if (!server.listenUnix(socketPath)) {
+            return 1;
+        }
+        std::cout << "serving on " << socketPath << " with " << numOfWorkers << " workers" << std::endl;
+        server.serve();
+        return 0;
+    }
+    std::unique_ptr<Preprocessor> preprocessorPtr = std::make_unique<Preprocess>(preprocessOptions);
 
     preprocessorPtr->process();
-    RAPTOR raptor(preprocessorPtr->trips,preprocessorPtr->Aroutes,preprocessorPtr->Astops,preprocessorPtr->stopsData,preprocessorPtr->geohashStops,preprocessorPtr->tripsData);
+    RAPTOR raptor(preprocessorPtr->tripProfiles,preprocessorPtr->Aroutes,preprocessorPtr->Astops,preprocessorPtr->footpathGraph,preprocessorPtr->stopsData,preprocessorPtr->stopCoords,preprocessorPtr->tripsData);
+    DelayTable delayTable;
+    bool safest = !preprocessOptions.delayTableFile.empty() && delayTable.load(preprocessOptions.delayTableFile, *preprocessorPtr);
+    raptor.delayTable = &delayTable;
+    raptor.streets = &preprocessorPtr->streets;
+    TransferPatterns transferPatterns;
+    if (!preprocessOptions.transferPatternsFile.empty() && transferPatterns.load(preprocessOptions.transferPatternsFile, *preprocessorPtr)) {
+        raptor.transferPatterns = &transferPatterns;
+    }
+    if (!batchOptions.inputFile.empty()) {
+        // batch mode: every query of the file instead of the one below, the journeys go to the output file
+        if (batchOptions.outputFile.empty()) {
+            std::cerr << "--batch needs --out <results file>" << std::endl;
+            return 1;
+        }
+        BatchRunner batch(*preprocessorPtr);
+        batch.delayTable = safest ? &delayTable : nullptr; // SAFEST lines without a table search like the others
+        batch.transferPatterns = raptor.transferPatterns;
+        batchOptions.numOfThreads = numOfWorkers;
+        batchOptions.deadline = std::chrono::milliseconds(deadlineMillis);
+        BatchSummary summary;
+        if (!batch.run(batchOptions, summary)) {
+            return 1;
+        }
+        std::cout << "ran " << summary.queries << " queries in " << summary.seconds << "s ("
+                  << (summary.seconds > 0 ? summary.queries / summary.seconds : 0) << " per second) on " << numOfWorkers
+                  << " threads, " << summary.errors << " bad lines, " << summary.partials << " partial, "
+                  << summary.outputBytes / 1024 << " KB written to " << batchOptions.outputFile << std::endl;
+        return 0;
+    }
 
     StopLocation startStop = {32.168997, 34.844180}; // h
     StopLocation endStop ={32.072571, 34.789531}; //Eilat 32.169319, 34.844108
     Time startTime = {timeUtil::calcTimeInSeconds("08:00:00"),4,20250507};
 
+    if (logQueries) {
+        queryLog.append(startStop, endStop, startTime, safest ? SAFEST_JOURNEY : BEST_ARRIVAL_TIME);
+    }
     std::cout<<"starting running algorithm..."<<std::endl;
     auto start = std::chrono::high_resolution_clock::now();
     // Run the Raptor algorithm and capture both the time table and trip data for each round.
-    JourneysToDest journeys_to_dest = raptor.run(startStop, endStop, startTime);
+    QueryOptions options;
+    options.collectStats = printStats;
+    options.mode = safest ? SAFEST_JOURNEY : BEST_ARRIVAL_TIME; // with a delay table the transfers leave room for the predicted delays
+    QueryResult result = raptor.query(startStop, endStop, startTime, options);
+    JourneysToDest& journeys_to_dest = result.journeys;
 
     // Measure and display the execution time.
     auto endTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - start);
     std::cout << "Execution time of the algorithm: " << duration.count() / 1000 << " seconds::"
               << duration.count() % 1000 << " milliseconds" << std::endl;
+    if (printStats) std::cout << "Search stats: " << result.stats.toJson() << std::endl;
     std::cout << "Start printing results..." << std::endl;
     print_algo_results(raptor,journeys_to_dest);
 
@@ -0,0 +1,308 @@
+#include "pedestrianGraph.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_set>
+#include "buildReport.h"
+#include "geoUtil.h"
+
+// ------------------------------ cells ------------------------------
+
+static uint64_t spreadBits(uint32_t value) { // bit i goes to bit 2i
+    uint64_t spread = value;
+    spread = (spread | (spread << 16)) & 0x0000FFFF0000FFFFULL;
+    spread = (spread | (spread << 8)) & 0x00FF00FF00FF00FFULL;
+    spread = (spread | (spread << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    spread = (spread | (spread << 2)) & 0x3333333333333333ULL;
+    spread = (spread | (spread << 1)) & 0x5555555555555555ULL;
+    return spread;
+}
+static uint64_t cellOfRowColumn(uint32_t row, uint32_t column) {
+    return (spreadBits(row) << 1) | spreadBits(column); // z order, close cells get close keys
+}
+static uint32_t rowOf(double lat) { return static_cast<uint32_t>((lat + 90.0) / PEDESTRIAN_SNAP_CELL_DEGREES); }
+static uint32_t columnOf(double lon) { return static_cast<uint32_t>((lon + 180.0) / PEDESTRIAN_SNAP_CELL_DEGREES); }
+
+uint64_t pedestrianCellOf(double lat, double lon) {
+    return cellOfRowColumn(rowOf(lat), columnOf(lon));
+}
+
+int64_t PedestrianGraph::snap(double lat, double lon, double& meters) const {
+    int64_t nearest = -1;
+    meters = PEDESTRIAN_SNAP_DISTANCE;
+    const uint32_t row = rowOf(lat), column = columnOf(lon);
+    for (uint32_t neighborRow = row - 1; neighborRow != row + 2; neighborRow++) {
+        for (uint32_t neighborColumn = column - 1; neighborColumn != column + 2; neighborColumn++) {
+            auto cell = std::lower_bound(cells.begin(), cells.end(), cellOfRowColumn(neighborRow, neighborColumn));
+            if (cell == cells.end() || *cell != cellOfRowColumn(neighborRow, neighborColumn)) continue;
+            const size_t index = cell - cells.begin();
+            for (uint32_t node = cellOffsets[index]; node < cellOffsets[index + 1]; node++) {
+                double distance = haversineDistance(lat, lon, this->lat(node), this->lon(node));
+                if (distance <= meters) {
+                    meters = distance;
+                    nearest = node;
+                }
+            }
+        }
+    }
+    return nearest;
+}
+
+size_t PedestrianGraph::memoryBytes() const {
+    return heapBytes(lats) + heapBytes(lons) + heapBytes(offsets) + heapBytes(targets) + heapBytes(lengths) +
+           heapBytes(cells) + heapBytes(cellOffsets);
+}
+
+// ------------------------------ osm xml ------------------------------
+
+// the value of name="..." (or name='...') in the line, empty when it isnt there
+static std::string_view attribute(std::string_view line, std::string_view name) {
+    size_t at = 0;
+    while ((at = line.find(name, at)) != std::string_view::npos) {
+        size_t quote = at + name.size() + 1;
+        if (at > 0 && line[at - 1] == ' ' && quote < line.size() && line[quote - 1] == '=' &&
+            (line[quote] == '"' || line[quote] == '\'')) {
+            size_t end = line.find(line[quote], quote + 1);
+            if (end == std::string_view::npos) return {};
+            return line.substr(quote + 1, end - quote - 1);
+        }
+        at += name.size();
+    }
+    return {};
+}
+template <typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    return !text.empty() && std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+}
+static bool startsWith(std::string_view line, std::string_view prefix) {
+    size_t first = line.find_first_not_of(" \t");
+    return first != std::string_view::npos && line.substr(first, prefix.size()) == prefix;
+}
+
+// the ways a pedestrian can walk: a walkable highway that isnt closed to people on foot, or any highway that allows them
+static bool walkable(const std::string& highway, const std::string& foot, const std::string& access) {
+    static const std::unordered_set<std::string> walkableHighways = {
+        "footway", "pedestrian", "path", "steps", "living_street", "residential", "service", "unclassified", "road",
+        "tertiary", "tertiary_link", "secondary", "secondary_link", "primary", "primary_link", "track", "cycleway",
+        "bridleway", "corridor", "platform"};
+    if (highway.empty() || foot == "no") return false;
+    if (foot == "yes" || foot == "designated" || foot == "permissive") return true; // e.g. a trunk road with a sidewalk
+    if (access == "no" || access == "private") return false;
+    return walkableHighways.contains(highway);
+}
+
+bool readOsmPedestrianGraph(const std::string& filename, PedestrianGraph& graph) {
+    graph = {};
+    // first pass: the walkable ways. the nodes come before the ways in the file, so their coordinates need a second
+    // pass - keeping every node of a country extract in memory would take far more than the graph itself
+    std::ifstream ways(filename);
+    if (!ways.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    std::vector<std::pair<uint32_t,uint32_t>> wayRanges; // [begin, end) in wayNodeIds
+    std::vector<int64_t> wayNodeIds;
+    std::string line, highway, foot, access;
+    bool inWay = false;
+    size_t wayBegin = 0;
+    auto endWay = [&] {
+        if (walkable(highway, foot, access) && wayNodeIds.size() - wayBegin >= 2) {
+            wayRanges.push_back({static_cast<uint32_t>(wayBegin), static_cast<uint32_t>(wayNodeIds.size())});
+        } else {
+            wayNodeIds.resize(wayBegin);
+        }
+        inWay = false;
+    };
+    while (std::getline(ways, line)) {
+        std::string_view view(line);
+        if (!inWay) {
+            if (!startsWith(view, "<way")) continue;
+            inWay = true;
+            wayBegin = wayNodeIds.size();
+            highway.clear();
+            foot.clear();
+            access.clear();
+            if (view.find("/>") != std::string_view::npos) endWay(); // a way without nodes
+        } else if (startsWith(view, "<nd")) {
+            int64_t nodeId;
+            if (parseNumber(attribute(view, "ref"), nodeId)) wayNodeIds.push_back(nodeId);
+        } else if (startsWith(view, "<tag")) {
+            std::string_view key = attribute(view, "k");
+            if (key == "highway") highway = attribute(view, "v");
+            else if (key == "foot") foot = attribute(view, "v");
+            else if (key == "access") access = attribute(view, "v");
+        } else if (startsWith(view, "</way")) {
+            endWay();
+        }
+    }
+    if (wayNodeIds.size() > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "More way nodes than the pedestrian graph can hold: " << filename << std::endl;
+        return false;
+    }
+
+    // second pass: the coordinates of the nodes the ways use
+    std::vector<int64_t> osmIds = wayNodeIds;
+    std::sort(osmIds.begin(), osmIds.end());
+    osmIds.erase(std::unique(osmIds.begin(), osmIds.end()), osmIds.end());
+    std::vector<int32_t> lats(osmIds.size(), 0), lons(osmIds.size(), 0);
+    std::vector<uint8_t> found(osmIds.size(), 0);
+    std::ifstream nodes(filename);
+    while (std::getline(nodes, line)) {
+        std::string_view view(line);
+        if (startsWith(view, "<way")) break; // the ways and relations come after all the nodes
+        if (!startsWith(view, "<node")) continue;
+        int64_t nodeId;
+        double lat, lon;
+        if (!parseNumber(attribute(view, "id"), nodeId)) continue;
+        auto osmId = std::lower_bound(osmIds.begin(), osmIds.end(), nodeId);
+        if (osmId == osmIds.end() || *osmId != nodeId) continue;
+        if (!parseNumber(attribute(view, "lat"), lat) || !parseNumber(attribute(view, "lon"), lon)) continue;
+        const size_t index = osmId - osmIds.begin();
+        lats[index] = static_cast<int32_t>(std::lround(lat * PEDESTRIAN_COORD_SCALE));
+        lons[index] = static_cast<int32_t>(std::lround(lon * PEDESTRIAN_COORD_SCALE));
+        found[index] = 1;
+    }
+
+    // number the nodes by cell, a node the extract cut off (a way that leaves the area) is left out with its segments
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> nodeCells(osmIds.size());
+    for (uint32_t index = 0; index < osmIds.size(); index++) {
+        if (!found[index]) continue;
+        order.push_back(index);
+        nodeCells[index] = pedestrianCellOf(lats[index] / PEDESTRIAN_COORD_SCALE, lons[index] / PEDESTRIAN_COORD_SCALE);
+    }
+    std::stable_sort(order.begin(), order.end(), [&nodeCells](uint32_t index1, uint32_t index2) {
+        return nodeCells[index1] < nodeCells[index2];
+    });
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> nodeOf(osmIds.size(), none); // osmIds index -> node
+    for (uint32_t node = 0; node < order.size(); node++) {
+        const uint32_t index = order[node];
+        nodeOf[index] = node;
+        graph.lats.push_back(lats[index]);
+        graph.lons.push_back(lons[index]);
+        if (graph.cells.empty() || graph.cells.back() != nodeCells[index]) {
+            graph.cells.push_back(nodeCells[index]);
+            graph.cellOffsets.push_back(node);
+        }
+    }
+    graph.cellOffsets.push_back(static_cast<uint32_t>(order.size()));
+
+    // the segments, counted first so the edges go straight into their rows
+    std::vector<std::pair<uint32_t,uint32_t>> segments;
+    for (const auto& [begin, end] : wayRanges) {
+        for (uint32_t i = begin + 1; i < end; i++) {
+            auto node1 = nodeOf[std::lower_bound(osmIds.begin(), osmIds.end(), wayNodeIds[i - 1]) - osmIds.begin()];
+            auto node2 = nodeOf[std::lower_bound(osmIds.begin(), osmIds.end(), wayNodeIds[i]) - osmIds.begin()];
+            if (node1 == none || node2 == none || node1 == node2) continue;
+            segments.push_back({node1, node2});
+        }
+    }
+    std::vector<uint32_t>().swap(nodeOf);
+    std::vector<int64_t>().swap(wayNodeIds);
+    graph.offsets.assign(graph.numOfNodes() + 1, 0);
+    for (const auto& [node1, node2] : segments) {
+        graph.offsets[node1 + 1]++;
+        graph.offsets[node2 + 1]++;
+    }
+    std::partial_sum(graph.offsets.begin(), graph.offsets.end(), graph.offsets.begin());
+    graph.targets.resize(graph.offsets.back());
+    graph.lengths.resize(graph.offsets.back());
+    std::vector<uint32_t> next(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (const auto& [node1, node2] : segments) {
+        double decimeters = std::ceil(haversineDistance(graph.lat(node1), graph.lon(node1), graph.lat(node2), graph.lon(node2)) * 10);
+        auto length = static_cast<uint16_t>(std::min<double>(decimeters, std::numeric_limits<uint16_t>::max()));
+        graph.targets[next[node1]] = node2;
+        graph.lengths[next[node1]++] = length;
+        graph.targets[next[node2]] = node1;
+        graph.lengths[next[node2]++] = length;
+    }
+    std::cout << wayRanges.size() << " walkable ways, " << graph.numOfNodes() << " street nodes and " << segments.size()
+              << " segments in the pedestrian graph" << std::endl;
+    if (graph.numOfNodes() == 0) {
+        std::cerr << "No walkable ways in: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ------------------------------ search ------------------------------
+
+PedestrianSearch::PedestrianSearch(const PedestrianGraph& graph_)
+    : graph(graph_), distances(graph_.numOfNodes()), epochs(graph_.numOfNodes(), 0) {}
+
+const std::vector<std::pair<uint32_t,uint32_t>>& PedestrianSearch::run(const std::vector<std::pair<uint32_t,uint32_t>>& sources,
+                                                                        uint32_t maxDecimeters) {
+    maxDecimeters = std::min<uint32_t>(maxDecimeters, PEDESTRIAN_MAX_DECIMETERS);
+    if (++epoch == 0) { // wrapped around, the old epochs could look current again
+        std::fill(epochs.begin(), epochs.end(), 0);
+        epoch = 1;
+    }
+    settled.clear();
+    heap.clear();
+    auto improve = [this, maxDecimeters](uint32_t node, uint32_t decimeters) {
+        if (decimeters >= maxDecimeters || (epochs[node] == epoch && distances[node] <= decimeters)) return;
+        epochs[node] = epoch;
+        distances[node] = static_cast<uint16_t>(decimeters);
+        heap.push_back({decimeters, node});
+        std::push_heap(heap.begin(), heap.end(), std::greater<>());
+    };
+    for (const auto& [node, decimeters] : sources) {
+        improve(node, decimeters);
+    }
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        const auto [decimeters, node] = heap.back();
+        heap.pop_back();
+        if (decimeters != distances[node]) continue; // an older entry of a node that got closer since
+        settled.push_back({node, decimeters});
+        for (uint32_t edge = graph.offsets[node]; edge < graph.offsets[node + 1]; edge++) {
+            improve(graph.targets[edge], decimeters + graph.lengths[edge]);
+        }
+    }
+    return settled;
+}
+
+// ------------------------------ stops ------------------------------
+
+void StreetNetwork::setStops(std::vector<StreetStop> stops, size_t numOfStopIds) {
+    nodeStops = std::move(stops);
+    std::sort(nodeStops.begin(), nodeStops.end(), [](const StreetStop& stop1, const StreetStop& stop2) {
+        return stop1.node < stop2.node || (stop1.node == stop2.node && stop1.stopId < stop2.stopId);
+    });
+    nodeHasStops.assign(graph ? graph->numOfNodes() : 0, 0);
+    snappedStops.assign(numOfStopIds, 0);
+    for (const StreetStop& stop : nodeStops) {
+        nodeHasStops[stop.node] = 1;
+        snappedStops[stop.stopId] = 1;
+    }
+}
+
+bool StreetNetwork::walkableStops(PedestrianSearch& search, double lat, double lon, double maxMeters,
+                                  std::vector<std::pair<int,double>>& stops) const {
+    stops.clear();
+    double snapMeters;
+    int64_t source = graph->snap(lat, lon, snapMeters);
+    if (source == -1) return false;
+    const uint32_t maxDecimeters = static_cast<uint32_t>(maxMeters * 10);
+    for (const auto& [node, decimeters] : search.run({{static_cast<uint32_t>(source), static_cast<uint32_t>(snapMeters * 10)}}, maxDecimeters)) {
+        if (!nodeHasStops[node]) continue;
+        auto stop = std::lower_bound(nodeStops.begin(), nodeStops.end(), node, [](const StreetStop& stop, uint32_t node) {
+            return stop.node < node;
+        });
+        for (; stop != nodeStops.end() && stop->node == node; ++stop) {
+            if (decimeters + stop->snapDecimeters < maxDecimeters) {
+                stops.push_back({stop->stopId, (decimeters + stop->snapDecimeters) / 10.0});
+            }
+        }
+    }
+    // settled nearest first, but the walk from the node to the stop can reorder them
+    std::stable_sort(stops.begin(), stops.end(), [](const auto& stop1, const auto& stop2) { return stop1.second < stop2.second; });
+    return true;
+}
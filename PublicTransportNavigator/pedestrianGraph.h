@@ -0,0 +1,83 @@
+#ifndef PEDESTRIANGRAPH_H
+#define PEDESTRIANGRAPH_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the streets and paths a pedestrian can walk, from a local openstreetmap extract, so the footpaths are walks over the
+// streets and not in a straight line (that cuts through blocks and across highways). the extract is osm xml with one
+// element per line, like `osmium cat israel.osm.pbf -o israel.osm` writes it (a `osmium tags-filter ... w/highway`
+// first makes it a lot smaller). only the ways with a walkable highway tag are kept, every segment of a way is an edge
+// both ways.
+// the graph is compressed sparse rows like the footpaths: the edges of node n are [offsets[n], offsets[n + 1]) of
+// targets and lengths. the nodes are numbered in the z order of their snap cells, so the nodes a walk visits are
+// mostly close in memory too, and the nodes of one cell are consecutive
+#define PEDESTRIAN_COORD_SCALE 1e7 // fixed point like the stop coordinates
+#define PEDESTRIAN_SNAP_CELL_DEGREES 0.001 // ~110 m, a stop or a query location snaps to a node of the 3 x 3 cells around it
+#define PEDESTRIAN_SNAP_DISTANCE 100 // meters, farther than this from every node walks in a straight line
+#define PEDESTRIAN_MAX_DECIMETERS 65535 // the longest walk a search follows (6.5 km), its distances are 16 bit
+
+struct PedestrianGraph {
+    std::vector<int32_t> lats; // per node
+    std::vector<int32_t> lons;
+    std::vector<uint32_t> offsets; // numOfNodes + 1 entries
+    std::vector<uint32_t> targets;
+    std::vector<uint16_t> lengths; // decimeters, a segment longer than 6.5 km is cut to that (it is never walked anyway)
+    std::vector<uint64_t> cells; // the snap cells that have nodes, sorted
+    std::vector<uint32_t> cellOffsets; // the nodes of cells[i] are [cellOffsets[i], cellOffsets[i + 1])
+
+    size_t numOfNodes() const { return lats.size(); }
+    size_t numOfEdges() const { return targets.size(); }
+    double lat(uint32_t node) const { return lats[node] / PEDESTRIAN_COORD_SCALE; }
+    double lon(uint32_t node) const { return lons[node] / PEDESTRIAN_COORD_SCALE; }
+    // the nearest node of the 3 x 3 cells around the location, -1 when none is within PEDESTRIAN_SNAP_DISTANCE
+    int64_t snap(double lat, double lon, double& meters) const;
+    size_t memoryBytes() const;
+};
+uint64_t pedestrianCellOf(double lat, double lon);
+// reads the walkable ways of the extract, false (and an empty graph) when it cant be read
+bool readOsmPedestrianGraph(const std::string& filename, PedestrianGraph& graph);
+
+// a bounded dijkstra over the graph. one per thread: the heap and the distances are kept between the runs, a run
+// starts by bumping the epoch instead of clearing the distances. 4 bytes per node, so a thread of a country graph
+// stays at a few tens of MB
+class PedestrianSearch {
+public:
+    explicit PedestrianSearch(const PedestrianGraph& graph_);
+    // every node closer than maxDecimeters (at most PEDESTRIAN_MAX_DECIMETERS) to one of the sources (node,
+    // decimeters already walked to it), as (node, decimeters) in the order they were settled, nearest first.
+    // valid until the next run
+    const std::vector<std::pair<uint32_t,uint32_t>>& run(const std::vector<std::pair<uint32_t,uint32_t>>& sources, uint32_t maxDecimeters);
+    const PedestrianGraph& graph;
+private:
+    std::vector<uint16_t> distances;
+    std::vector<uint16_t> epochs; // distances[n] is of this run only when epochs[n] == epoch
+    uint16_t epoch = 0;
+    std::vector<std::pair<uint32_t,uint32_t>> heap; // (decimeters, node), min heap
+    std::vector<std::pair<uint32_t,uint32_t>> settled;
+};
+
+// the stops snapped to the graph, what the footpaths and the walks from and to the query locations read
+struct StreetStop {
+    uint32_t node;
+    int stopId;
+    uint32_t snapDecimeters; // the straight walk between the stop and its node
+};
+struct StreetNetwork {
+    std::shared_ptr<const PedestrianGraph> graph; // null = no extract, every walk is a straight line
+    std::vector<StreetStop> nodeStops; // sorted by node
+    std::vector<uint8_t> nodeHasStops; // per node, 1 when some stop snapped to it
+    std::vector<uint8_t> snappedStops; // per stop id, 1 when its walks go over the streets
+
+    bool empty() const { return !graph; }
+    bool snapped(int stopId) const { return graph && snappedStops[stopId]; }
+    void setStops(std::vector<StreetStop> stops, size_t numOfStopIds);
+    // the snapped stops closer than maxMeters to the location over the streets, (stop id, meters) nearest first.
+    // false when the location isnt near the graph, the caller walks in a straight line then
+    bool walkableStops(PedestrianSearch& search, double lat, double lon, double maxMeters,
+                       std::vector<std::pair<int,double>>& stops) const;
+};
+
+#endif //PEDESTRIANGRAPH_H
@@ -1,30 +1,533 @@
 #include "preprocess.h"
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <thread>
 #include "timeUtil.h"
 
+// by the departure at the first stop, then at the next ones - the order of the trips of a route
+static bool tripRunsBefore(const std::vector<TripStop>& trip1, const std::vector<TripStop>& trip2) {
+    for (size_t stopSeqIndex = 0; stopSeqIndex < trip1.size() && stopSeqIndex < trip2.size(); stopSeqIndex++) {
+        if (trip1[stopSeqIndex].depTime != trip2[stopSeqIndex].depTime) return trip1[stopSeqIndex].depTime < trip2[stopSeqIndex].depTime;
+        if (trip1[stopSeqIndex].arrTime != trip2[stopSeqIndex].arrTime) return trip1[stopSeqIndex].arrTime < trip2[stopSeqIndex].arrTime;
+    }
+    return false;
+}
+
 
 void Preprocess::process()  {
     auto start = std::chrono::high_resolution_clock::now();
 
-    build_trip_stops(); // first load the trips that exsist with thier stops from stop_times
-    lineNamesBuilder(); // save the line names - connect trip id to a line name
-    build_trip_data(); // this include service id - which later be translated intp working days and the line name based on my id
-
+    // every builder runs as a stage of the build report so we can see which one dominates
+    ingestTrips();
+    buildReport.runStage("frequencyBuilder", [this] { frequencyBuilder(); }); // every run of a frequencies.txt trip becomes a trip
 
-    serviceBuilder();// connect between service id to its working days and start/end dates
-    stopsBuilder(); // save information about the actual stops - names and location
-    algoRouteBuilder(); // connect trips with the same stop sequence to be under the same route
-    footpathBuilder(); // create footpath for each stop to other walkable stop
+    buildReport.runStage("serviceBuilder", [this] { serviceBuilder(); });// connect between service id to its working days and start/end dates
+    buildReport.runStage("stopsBuilder", [this] { stopsBuilder(); }); // save information about the actual stops - names and location
+    buildReport.runStage("stationBuilder", [this] { stationBuilder(); }); // merge the platforms of a station into one stop
+    buildReport.runStage("algoRouteBuilder", [this] { algoRouteBuilder(); }); // connect trips with the same stop sequence to be under the same route
+    if (!options.walkShortcutsFile.empty()) {
+        buildReport.runStage("walkShortcutsLoader", [this] { walkShortcutsLoader(); }); // the long walks some journey needs
+    }
+    if (!options.osmFile.empty()) {
+        buildReport.runStage("pedestrianGraphBuilder", [this] { pedestrianGraphBuilder(nullptr); }); // the streets the walks go over
+    }
+    buildReport.runStage("footpathBuilder", [this] { footpathBuilder(); }); // create footpath for each stop to other walkable stop
     // testing - see in the terminal
-    checker();
+    if (options.runChecker) {
+        buildReport.runStage("checker", [this] { checker(); });
+    }
+    if (options.localityOrder) {
+        buildReport.runStage("renumberForLocality", [this] { renumberForLocality(); }); // lay out the ids in the order the search reads them
+    }
+    buildReport.runStage("footpathGraphBuilder", [this] { footpathGraphBuilder(); }); // pack the footpaths into one array for the search
+    buildReport.runStage("tripProfileBuilder", [this] { tripProfileBuilder(); }); // store the trips with the same times once
+    buildReport.runStage("departureBoardBuilder", [this] { departureBoardBuilder(); }); // the departures of every stop by time
+    finishBuild(start);
+}
+void Preprocess::ingestTrips() {
+    buildReport.runStage("build_trip_stops", [this] { build_trip_stops(); }); // first load the trips that exsist with thier stops from stop_times
+    buildReport.runStage("lineNamesBuilder", [this] { lineNamesBuilder(); }); // save the line names - connect trip id to a line name
+    buildReport.runStage("build_trip_data", [this] { build_trip_data(); }); // this include service id - which later be translated intp working days and the line name based on my id
+}
+void Preprocess::finishBuild(std::chrono::high_resolution_clock::time_point start) {
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - start);
 
+    reportFootprint();
+    buildReport.print();
+    if (!options.buildReportFile.empty()) {
+        buildReport.writeJson(options.buildReportFile);
+    }
     std::cout << "Execution time: " << duration.count() << "seconds" << std::endl;
     std::cout << "finished Processing..." << std::endl;
 }
 
+bool Preprocess::processIncremental(const Preprocess& previous) {
+    if (previous.renumbered) return false; // its ids dont follow the feed anymore, there is nothing to match them with
+    auto start = std::chrono::high_resolution_clock::now();
+    // the files are still parsed in full (cheap compared to the grouping, sorting and footpaths), but the trips keep
+    // the ids of the previous build so the two builds can be compared trip by trip
+    tripsIdsMap = previous.tripsIdsMap;
+    lastTripId = previous.lastTripId;
+    buildReport.runStage("build_trip_stops", [this] { build_trip_stops(); });
+    buildReport.runStage("lineNamesBuilder", [this] { lineNamesBuilder(); });
+    buildReport.runStage("build_trip_data", [this] { build_trip_data(); });
+    buildReport.runStage("frequencyBuilder", [this] { frequencyBuilder(); });
+    if (tripIdsExhausted) return false;
+    // trips that are gone from stop_times (or runs gone from frequencies.txt), a full build wouldnt know them at all
+    std::erase_if(tripsIdsMap, [this](const auto& entry) { return trips[entry.second].empty(); });
+    buildReport.runStage("serviceBuilder", [this] { serviceBuilder(); });
+    buildReport.runStage("stopsBuilder", [this] { stopsBuilder(); });
+    buildReport.runStage("stationBuilder", [this] { stationBuilder(); });
+    // the trips were moved to the stations of this feed, a different grouping would touch every route of those stations
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        if (stationIds[stopId] != previous.stationIds[stopId] || Astops[stopId].transferTime != previous.Astops[stopId].transferTime) {
+            std::cout << "the stations changed" << std::endl;
+            return false;
+        }
+    }
+
+    // ---- the diff: a trip changed if its stops, times, service or line name did, or its service days/dates did
+    std::vector<int> changedTrips;
+    buildReport.runStage("diffTrips", [this, &previous, &changedTrips] {
+        std::unordered_map<int,bool> serviceChanged;
+        auto isServiceChanged = [this, &previous, &serviceChanged](int serviceId) {
+            auto known = serviceChanged.find(serviceId);
+            if (known != serviceChanged.end()) return known->second;
+            auto now = services.find(serviceId);
+            auto before = previous.services.find(serviceId);
+            bool changed = (now == services.end()) != (before == previous.services.end()) ||
+                (now != services.end() && (now->second.startDate != before->second.startDate ||
+                    now->second.endDate != before->second.endDate || now->second.weekArr != before->second.weekArr));
+            serviceChanged[serviceId] = changed;
+            return changed;
+        };
+        int maxTripId = std::max(lastTripId, previous.lastTripId);
+        const TripProfiles& before = previous.tripProfiles; // the previous build only has the profiles left
+        for (int tripId = 0; tripId <= maxTripId; tripId++) {
+            const std::vector<TripStop>& now = trips[tripId];
+            size_t numOfStopsBefore = before.hasTrip(tripId) ? before.numOfStops(tripId) : 0;
+            if (now.empty() && numOfStopsBefore == 0) continue;
+            bool changed = now.size() != numOfStopsBefore ||
+                tripsData[tripId].serviceId != previous.tripsData[tripId].serviceId ||
+                tripsData[tripId].lineName != previous.tripsData[tripId].lineName ||
+                isServiceChanged(tripsData[tripId].serviceId);
+            for (size_t i = 0; !changed && i < now.size(); i++) {
+                TripStop stopBefore = before.stop(tripId, static_cast<int>(i));
+                changed = !(now[i] == stopBefore) || now[i].depTime != stopBefore.depTime || now[i].arrTime != stopBefore.arrTime;
+            }
+            if (changed) changedTrips.push_back(tripId);
+        }
+    });
+
+    // ---- the routes: move the changed trips between route keys and rebuild only the keys that were touched
+    bool outOfRouteIds = false;
+    buildReport.runStage("patchRoutes", [this, &previous, &changedTrips, &outOfRouteIds] {
+        algoRoutesMap = previous.algoRoutesMap;
+        stopsSeqToRouteIdMap = previous.stopsSeqToRouteIdMap;
+        Aroutes = previous.Aroutes;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            Astops[stopId].routes = previous.Astops[stopId].routes;
+        }
+        numOfAlgoRoutes = previous.numOfAlgoRoutes;
+        freeRouteIds = previous.freeRouteIds;
+
+        std::unordered_map<std::vector<ARouteStop>,bool,VectorRouteStopHash> touchedRoutes;
+        auto routeKey = [](const std::vector<TripStop>& tripStops) {
+            return std::vector<ARouteStop>(tripStops.begin(), tripStops.end());
+        };
+        for (int tripId : changedTrips) {
+            if (previous.tripProfiles.hasTrip(tripId)) {
+                std::vector<ARouteStop> oldKey = routeKey(previous.tripProfiles.stops(tripId));
+                std::erase(algoRoutesMap[oldKey], tripId);
+                touchedRoutes[oldKey] = true;
+            }
+            if (!trips[tripId].empty()) {
+                std::vector<ARouteStop> newKey = routeKey(trips[tripId]);
+                std::vector<int>& tripIds = algoRoutesMap[newKey];
+                // keep the trips of a route in id order like a full build, the order of equal departures depends on it
+                tripIds.insert(std::lower_bound(tripIds.begin(), tripIds.end(), tripId), tripId);
+                touchedRoutes[newKey] = true;
+            }
+        }
+        for (const auto& [routeStopsVector, touched] : touchedRoutes) {
+            const std::vector<int>& tripIds = algoRoutesMap[routeStopsVector];
+            std::vector<std::vector<int>> fifoRoutes = partitionFifo(tripIds);
+            std::vector<int> oldRouteIds;
+            if (auto existing = stopsSeqToRouteIdMap.find(routeStopsVector); existing != stopsSeqToRouteIdMap.end()) {
+                oldRouteIds = std::move(existing->second);
+                stopsSeqToRouteIdMap.erase(existing);
+            }
+            // the sub routes of the stops keep their ids (same stops, only the trips changed), extra ones get new ids
+            std::vector<int> routeIds;
+            for (size_t i = 0; i < fifoRoutes.size(); i++) {
+                int routeId;
+                if (i < oldRouteIds.size()) {
+                    routeId = oldRouteIds[i];
+                } else if (!freeRouteIds.empty()) {
+                    routeId = freeRouteIds.back();
+                    freeRouteIds.pop_back();
+                } else if (numOfAlgoRoutes < NUM_OF_ALGO_ROUTES) {
+                    routeId = numOfAlgoRoutes++;
+                } else {
+                    outOfRouteIds = true;
+                    return;
+                }
+                buildRoute(routeId, routeStopsVector, fifoRoutes[i]);
+                if (i >= oldRouteIds.size()) buildAStops(routeId, Aroutes[routeId].first);
+                routeIds.push_back(routeId);
+            }
+            // and the sub routes that arent needed anymore (all of them when the stops lost all of their trips)
+            for (size_t i = fifoRoutes.size(); i < oldRouteIds.size(); i++) {
+                for (const ARouteStop& routeStop : Aroutes[oldRouteIds[i]].first) {
+                    std::erase(Astops[routeStop.id].routes, oldRouteIds[i]);
+                }
+                Aroutes[oldRouteIds[i]] = {};
+                freeRouteIds.push_back(oldRouteIds[i]);
+            }
+            if (routeIds.empty()) {
+                algoRoutesMap.erase(routeStopsVector);
+            } else {
+                stopsSeqToRouteIdMap[routeStopsVector] = std::move(routeIds);
+            }
+        }
+        std::cout << changedTrips.size() << " trips changed, " << touchedRoutes.size() << " routes rebuilt" << std::endl;
+    });
+    if (outOfRouteIds) {
+        std::cerr << "More routes than NUM_OF_ALGO_ROUTES" << std::endl;
+        return false;
+    }
+
+    if (!options.walkShortcutsFile.empty()) {
+        buildReport.runStage("walkShortcutsLoader", [this] { walkShortcutsLoader(); });
+    }
+    if (!options.osmFile.empty()) {
+        buildReport.runStage("pedestrianGraphBuilder", [this, &previous] { pedestrianGraphBuilder(&previous); });
+    }
+    // ---- the footpaths: only stops that moved, appeared or disappeared, and the stops around their old and new place
+    buildReport.runStage("patchFootpaths", [this, &previous] {
+        const FootpathGraph& previousGraph = previous.footpathGraph;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            Astops[stopId].footpaths.clear();
+            for (uint32_t edge = previousGraph.begin(stopId); edge < previousGraph.end(stopId); edge++) {
+                Astops[stopId].footpaths.push_back({previousGraph.otherStopIds[edge], previousGraph.walkTimes[edge]});
+            }
+        }
+        std::vector<int> movedStops;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            // a stop that got its first route or lost its last one counts as moved too, the footpaths to it are
+            // only kept while some route serves it
+            if (stopsData[stopId].name.empty() != previous.stopsData[stopId].name.empty() ||
+                stopCoords.lats[stopId] != previous.stopCoords.lats[stopId] || stopCoords.lons[stopId] != previous.stopCoords.lons[stopId] ||
+                Astops[stopId].routes.empty() != previous.Astops[stopId].routes.empty()) {
+                movedStops.push_back(stopId);
+            }
+        }
+        // a stop sees the stops of the 9 boxes around its own box, so every stop whose boxes hold the old or the new
+        // place of a moved stop gets new footpaths
+        std::unordered_map<uint32_t,bool> dirtyBoxes;
+        // new shortcuts (or none anymore) or other streets change the footpaths of every stop
+        std::vector<bool> recompute(NUM_OF_STOPS, shortcutTargets != previous.shortcutTargets || streets.graph != previous.streets.graph);
+        for (int stopId : movedStops) {
+            recompute[stopId] = true;
+            dirtyBoxes[previous.stopCoords.cells[stopId]] = true;
+            dirtyBoxes[stopCoords.cells[stopId]] = true;
+        }
+        if (!movedStops.empty()) {
+            for (const auto& [cell, stopIds] : stopCoords.cellStops) {
+                for (uint32_t neighborCell : Geohash::getCellNeighbors(cell, GEO_HASH_PRESITION)) {
+                    if (dirtyBoxes.contains(neighborCell)) {
+                        for (int stopId : stopIds) recompute[stopId] = true;
+                        break;
+                    }
+                }
+            }
+        }
+        std::vector<int> recomputed;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            if (!recompute[stopId]) continue;
+            Astops[stopId].footpaths.clear();
+            bool hasFootpaths = !stopsData[stopId].name.empty() && stationIds[stopId] == stopId; // not a platform of a station
+            if (hasFootpaths) recomputed.push_back(stopId);
+        }
+        buildFootpaths(recomputed);
+        std::cout << movedStops.size() << " stops moved, " << recomputed.size() << " stops got new footpaths" << std::endl;
+    });
+    buildReport.runStage("footpathGraphBuilder", [this] { footpathGraphBuilder(); });
+    buildReport.runStage("tripProfileBuilder", [this] { tripProfileBuilder(); });
+    buildReport.runStage("departureBoardBuilder", [this] { departureBoardBuilder(); });
+    finishBuild(start);
+    return true;
+}
+
+void Preprocess::reportFootprint() {
+    // live bytes of every data structure after the build: the fixed size arrays themselves plus the heap they own
+    size_t tripsBytes = sizeof(trips);
+    for (const std::vector<TripStop>& trip : trips) {
+        tripsBytes += heapBytes(trip);
+    }
+    size_t tripProfilesBytes = deepHeapBytes(tripProfiles.profiles) + heapBytes(tripProfiles.tripTimes);
+    size_t tripsDataBytes = sizeof(tripsData);
+    for (const MyTrip& trip : tripsData) {
+        tripsDataBytes += heapBytes(trip.lineName) + heapBytes(trip.headsign);
+    }
+    size_t routesFirstBytes = 0, routesSecondBytes = 0, routesThirdBytes = 0;
+    for (const auto& route : Aroutes) {
+        routesFirstBytes += sizeof(route.first) + heapBytes(route.first);
+        routesSecondBytes += sizeof(route.second) + heapBytes(route.second);
+        routesThirdBytes += sizeof(route.third);
+        for (const std::vector<ATrip>& tripsOnDay : route.third) {
+            routesThirdBytes += heapBytes(tripsOnDay);
+            for (const ATrip& trip : tripsOnDay) {
+                routesThirdBytes += heapBytes(trip.lineName);
+            }
+        }
+    }
+    size_t stopRoutesBytes = 0, stopFootpathsBytes = 0;
+    for (const AStop& stop : Astops) {
+        stopRoutesBytes += sizeof(stop.routes) + heapBytes(stop.routes);
+        stopFootpathsBytes += sizeof(stop.footpaths) + heapBytes(stop.footpaths);
+    }
+    size_t stopsDataBytes = sizeof(stopsData);
+    for (const StopData& stop : stopsData) {
+        stopsDataBytes += heapBytes(stop.name);
+    }
+    size_t stopCoordsBytes = heapBytes(stopCoords.lats) + heapBytes(stopCoords.lons) + heapBytes(stopCoords.cells);
+    size_t cellStopsBytes = hashMapNodeBytes(stopCoords.cellStops);
+    for (const auto& [cell, stopIds] : stopCoords.cellStops) {
+        cellStopsBytes += heapBytes(stopIds);
+    }
+    // the transient maps are only needed while building
+    size_t lineNamesBytes = hashMapNodeBytes(gftsRouteIdToLineName);
+    for (const auto& [routeId, lineName] : gftsRouteIdToLineName) {
+        lineNamesBytes += heapBytes(lineName);
+    }
+    size_t tripsIdsBytes = hashMapNodeBytes(tripsIdsMap);
+    for (const auto& [gtfsTripId, tripId] : tripsIdsMap) {
+        tripsIdsBytes += heapBytes(gtfsTripId);
+    }
+    size_t algoRoutesBytes = hashMapNodeBytes(algoRoutesMap);
+    for (const auto& [routeStops, tripIds] : algoRoutesMap) {
+        algoRoutesBytes += heapBytes(routeStops) + heapBytes(tripIds);
+    }
+    size_t stopsSeqToRouteIdBytes = hashMapNodeBytes(stopsSeqToRouteIdMap);
+    for (const auto& [routeStops, routeIds] : stopsSeqToRouteIdMap) {
+        stopsSeqToRouteIdBytes += heapBytes(routeStops) + heapBytes(routeIds);
+    }
+
+    buildReport.addFootprint("trips", tripsBytes);
+    buildReport.addFootprint("tripProfiles", tripProfilesBytes);
+    buildReport.addFootprint("tripsData", tripsDataBytes);
+    buildReport.addFootprint("Aroutes.first", routesFirstBytes);
+    buildReport.addFootprint("Aroutes.second", routesSecondBytes);
+    buildReport.addFootprint("Aroutes.third", routesThirdBytes);
+    buildReport.addFootprint("Astops.routes", stopRoutesBytes);
+    buildReport.addFootprint("Astops.footpaths", stopFootpathsBytes);
+    buildReport.addFootprint("footpathGraph", heapBytes(footpathGraph.offsets) + heapBytes(footpathGraph.otherStopIds) +
+                                              heapBytes(footpathGraph.walkTimes));
+    size_t departureBoardBytes = heapBytes(departureBoard.offsets) + heapBytes(departureBoard.events) +
+                                 deepHeapBytes(departureBoard.headsigns) + heapBytes(departureBoard.services);
+    buildReport.addFootprint("departureBoard", departureBoardBytes);
+    if (streets.graph) {
+        // shared with the other timetable versions
+        buildReport.addFootprint("pedestrianGraph", streets.graph->memoryBytes());
+        buildReport.addFootprint("streetStops", heapBytes(streets.nodeStops) + heapBytes(streets.nodeHasStops) + heapBytes(streets.snappedStops));
+    }
+    buildReport.addFootprint("stopsData", stopsDataBytes);
+    buildReport.addFootprint("stopCoords", stopCoordsBytes);
+    buildReport.addFootprint("stopCoords.cellStops", cellStopsBytes);
+    buildReport.addFootprint("transient.gftsRouteIdToLineName", lineNamesBytes);
+    buildReport.addFootprint("transient.tripsIdsMap", tripsIdsBytes);
+    buildReport.addFootprint("transient.algoRoutesMap", algoRoutesBytes);
+    buildReport.addFootprint("transient.services", hashMapNodeBytes(services));
+    buildReport.addFootprint("transient.stopsSeqToRouteIdMap", stopsSeqToRouteIdBytes);
+    buildReport.addFootprint("gtfsStopIdMaps", heapBytes(stopIdsByGtfs) + heapBytes(gtfsStopIds));
+    buildReport.addFootprint("stationIds", heapBytes(stationIds));
+}
+
+
 
 
+int Preprocess::findTripId(const std::string& gtfsTripId) const {
+    auto tripId = tripsIdsMap.find(gtfsTripId);
+    return tripId == tripsIdsMap.end() ? -1 : tripId->second;
+}
+std::string Preprocess::gtfsTripIdOf(int tripId) const {
+    // a scan of the map, for printing and not for the search
+    for (const auto& [gtfsTripId, myTripId] : tripsIdsMap) {
+        if (myTripId == tripId) return gtfsTripId;
+    }
+    return "";
+}
+int Preprocess::stopIdOfGtfs(int gtfsStopId) const {
+    int stopId = gtfsStopId - 1; // what getStopId gave it while parsing
+    if (stopId < 0 || stopId >= NUM_OF_STOPS) return -1;
+    return renumbered ? stopIdsByGtfs[stopId] : stopId;
+}
+int Preprocess::gtfsStopIdOf(int stopId) const {
+    if (stopId < 0 || stopId >= NUM_OF_STOPS) return -1;
+    return renumbered ? gtfsStopIds[stopId] : stopId + 1;
+}
+int Preprocess::stationOf(int stopId) const {
+    if (stopId < 0 || stopId >= NUM_OF_STOPS) return -1;
+    return stationIds.empty() ? stopId : stationIds[stopId];
+}
+
+void Preprocess::renumberForLocality() {
+    // the ids that come out of the feed are scattered: a stop id is its gtfs stop_id and a route id is the iteration
+    // order of a hashmap, so the stops of one route and the routes of one area are far apart in Astops, stopsData,
+    // Aroutes and trips. this lays them out in the order the search reads them: the routes along a geohash (z order)
+    // curve of their first stop, the stops route by route in that order (the stops of a route are scanned one after
+    // the other) and the trips route by route in the order of the route.
+    std::vector<std::string> curveKeys(NUM_OF_STOPS);
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        if (!stopsData[stopId].name.empty()) {
+            curveKeys[stopId] = Geohash::encodeGeohash(stopCoords.lat(stopId), stopCoords.lon(stopId), LOCALITY_CURVE_PRECISION);
+        }
+    }
+    std::vector<int> routeOrder(numOfAlgoRoutes);
+    std::iota(routeOrder.begin(), routeOrder.end(), 0);
+    std::stable_sort(routeOrder.begin(), routeOrder.end(), [this, &curveKeys](int routeId1, int routeId2) {
+        const auto& stops1 = Aroutes[routeId1].second;
+        const auto& stops2 = Aroutes[routeId2].second;
+        if (stops1.empty() || stops2.empty()) return !stops1.empty() && stops2.empty(); // the route of the unused trip slots last
+        return curveKeys[stops1[0].id] < curveKeys[stops2[0].id];
+    });
+
+    std::vector<int> newRouteIds(NUM_OF_ALGO_ROUTES), newStopIds(NUM_OF_STOPS, -1), newTripIds(NUM_OF_REAL_TRIPS, -1);
+    std::iota(newRouteIds.begin(), newRouteIds.end(), 0); // the ids past numOfAlgoRoutes arent used
+    int nextStopId = 0, nextTripId = 0;
+    for (int routeIndex = 0; routeIndex < numOfAlgoRoutes; routeIndex++) {
+        const auto& route = Aroutes[routeOrder[routeIndex]];
+        newRouteIds[routeOrder[routeIndex]] = routeIndex;
+        for (const ARouteStop& routeStop : route.second) {
+            if (newStopIds[routeStop.id] == -1) newStopIds[routeStop.id] = nextStopId++;
+        }
+        std::vector<int> routeTripIds; // of every day, each day is a subsequence of the order of the route
+        for (const std::vector<ATrip>& tripsOnDay : route.third) {
+            for (const ATrip& trip : tripsOnDay) routeTripIds.push_back(trip.tripId);
+        }
+        std::sort(routeTripIds.begin(), routeTripIds.end());
+        routeTripIds.erase(std::unique(routeTripIds.begin(), routeTripIds.end()), routeTripIds.end());
+        std::stable_sort(routeTripIds.begin(), routeTripIds.end(), [this](int tripId1, int tripId2) {
+            return tripRunsBefore(trips[tripId1], trips[tripId2]);
+        });
+        for (int tripId : routeTripIds) newTripIds[tripId] = nextTripId++;
+    }
+    // stops no route serves along the curve too, then the empty slots. trips that run on no day and the unused slots after
+    // all of them, in id order so the trips with stops still come before the unused slots
+    std::vector<int> otherStopIds;
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        if (newStopIds[stopId] == -1) otherStopIds.push_back(stopId);
+    }
+    std::stable_sort(otherStopIds.begin(), otherStopIds.end(), [this, &curveKeys](int stopId1, int stopId2) {
+        bool empty1 = stopsData[stopId1].name.empty(), empty2 = stopsData[stopId2].name.empty();
+        if (empty1 != empty2) return empty2;
+        return curveKeys[stopId1] < curveKeys[stopId2];
+    });
+    for (int stopId : otherStopIds) newStopIds[stopId] = nextStopId++;
+    for (int tripId = 0; tripId < NUM_OF_REAL_TRIPS; tripId++) {
+        if (newTripIds[tripId] == -1) newTripIds[tripId] = nextTripId++;
+    }
+
+    // move everything to its new id
+    {
+        std::vector<std::vector<TripStop>> renumberedTrips(NUM_OF_REAL_TRIPS);
+        std::vector<MyTrip> renumberedTripsData(NUM_OF_REAL_TRIPS);
+        for (int tripId = 0; tripId < NUM_OF_REAL_TRIPS; tripId++) {
+            for (TripStop& tripStop : trips[tripId]) tripStop.id = newStopIds[tripStop.id];
+            renumberedTrips[newTripIds[tripId]] = std::move(trips[tripId]);
+            renumberedTripsData[newTripIds[tripId]] = tripsData[tripId];
+            renumberedTripsData[newTripIds[tripId]].tripId = newTripIds[tripId];
+        }
+        for (int tripId = 0; tripId < NUM_OF_REAL_TRIPS; tripId++) {
+            trips[tripId] = std::move(renumberedTrips[tripId]);
+            tripsData[tripId] = renumberedTripsData[tripId];
+        }
+    }
+    {
+        std::vector<std::remove_reference_t<decltype(Aroutes[0])>> renumberedRoutes(numOfAlgoRoutes);
+        for (int routeId = 0; routeId < numOfAlgoRoutes; routeId++) {
+            auto& route = renumberedRoutes[newRouteIds[routeId]];
+            route = Aroutes[routeId];
+            for (ARouteStop& routeStop : route.first) routeStop.id = newStopIds[routeStop.id];
+            for (ARouteStop& routeStop : route.second) routeStop.id = newStopIds[routeStop.id];
+            std::sort(route.first.begin(), route.first.end(), [](const ARouteStop& stop1, const ARouteStop& stop2) {
+                return stop1.id < stop2.id;
+            });
+            for (std::vector<ATrip>& tripsOnDay : route.third) {
+                for (ATrip& trip : tripsOnDay) trip.tripId = newTripIds[trip.tripId];
+            }
+        }
+        for (int routeId = 0; routeId < numOfAlgoRoutes; routeId++) {
+            Aroutes[routeId] = renumberedRoutes[routeId];
+        }
+    }
+    {
+        std::vector<AStop> renumberedStops(NUM_OF_STOPS);
+        std::vector<StopData> renumberedStopsData(NUM_OF_STOPS);
+        StopCoords renumberedCoords = stopCoords;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            AStop& stop = Astops[stopId];
+            for (int& routeId : stop.routes) routeId = newRouteIds[routeId];
+            std::sort(stop.routes.begin(), stop.routes.end()); // the routes of a stop are then read in memory order
+            for (Footpath& footpath : stop.footpaths) footpath.otherStopId = newStopIds[footpath.otherStopId];
+            renumberedStops[newStopIds[stopId]] = std::move(stop);
+            renumberedStopsData[newStopIds[stopId]] = std::move(stopsData[stopId]);
+            if (!renumberedStopsData[newStopIds[stopId]].name.empty()) renumberedStopsData[newStopIds[stopId]].id = newStopIds[stopId];
+            renumberedCoords.lats[newStopIds[stopId]] = stopCoords.lats[stopId];
+            renumberedCoords.lons[newStopIds[stopId]] = stopCoords.lons[stopId];
+            renumberedCoords.cells[newStopIds[stopId]] = stopCoords.cells[stopId];
+        }
+        stopCoords = std::move(renumberedCoords);
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            Astops[stopId] = std::move(renumberedStops[stopId]);
+            stopsData[stopId] = std::move(renumberedStopsData[stopId]);
+        }
+    }
+    for (auto& [cell, stopIds] : stopCoords.cellStops) {
+        for (int& stopId : stopIds) stopId = newStopIds[stopId];
+        std::sort(stopIds.begin(), stopIds.end());
+    }
+    for (auto& [gtfsTripId, tripId] : tripsIdsMap) {
+        tripId = newTripIds[tripId];
+    }
+    // the maps of the stop sequences, their keys hold stop ids
+    auto renumberedKey = [&newStopIds](std::vector<ARouteStop> routeStopsVector) {
+        for (ARouteStop& routeStop : routeStopsVector) routeStop.id = newStopIds[routeStop.id];
+        return routeStopsVector;
+    };
+    decltype(algoRoutesMap) renumberedAlgoRoutesMap;
+    for (const auto& [routeStopsVector, tripIds] : algoRoutesMap) {
+        std::vector<int>& renumberedTripIds = renumberedAlgoRoutesMap[renumberedKey(routeStopsVector)];
+        for (int tripId : tripIds) renumberedTripIds.push_back(newTripIds[tripId]);
+        std::sort(renumberedTripIds.begin(), renumberedTripIds.end());
+    }
+    algoRoutesMap = std::move(renumberedAlgoRoutesMap);
+    decltype(stopsSeqToRouteIdMap) renumberedStopsSeqToRouteIdMap;
+    for (const auto& [routeStopsVector, routeIds] : stopsSeqToRouteIdMap) {
+        std::vector<int>& renumberedRouteIds = renumberedStopsSeqToRouteIdMap[renumberedKey(routeStopsVector)];
+        for (int routeId : routeIds) renumberedRouteIds.push_back(newRouteIds[routeId]);
+    }
+    stopsSeqToRouteIdMap = std::move(renumberedStopsSeqToRouteIdMap);
+
+    std::vector<int> renumberedStationIds(NUM_OF_STOPS);
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        renumberedStationIds[newStopIds[stopId]] = newStopIds[stationIds[stopId]];
+    }
+    stationIds = std::move(renumberedStationIds);
+    stopIdsByGtfs = newStopIds;
+    gtfsStopIds.assign(NUM_OF_STOPS, -1);
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        gtfsStopIds[newStopIds[stopId]] = stopId + 1;
+    }
+    renumbered = true;
+    std::cout << "renumbered " << nextStopId << " stops, " << numOfAlgoRoutes << " routes and " << nextTripId << " trips for locality" << std::endl;
+}
+
 
 //*********************** Testing function: *****************************************
 
@@ -34,27 +537,52 @@ void Preprocess::checker()
     // and the 29 line stop on thuersday and all the routes that go throw herzelia train station
     std::string herzelia29 = "17020800_280325";
     std::string herzeliaTrainJerusalmId  ="1_293699";
-    int herTrainRouteId = stopsSeqToRouteIdMap[getRouteStopsFromTripStops(tripsIdsMap[herzeliaTrainJerusalmId])];
-    std::vector<ATrip> tripsForHerOnDay = Aroutes[herTrainRouteId].third[5]; // on friday
-    // for entire route between herzelia and jerusalm on  during the daylight
-    printTrip(tripsForHerOnDay);
+    // the first route of the trip stop sequence, -1 when the trip or its route is not in this feed
+    // (a sequence can be split into several overtaking free routes, or none when its trips were all dropped)
+    auto routeOfTrip = [&](int tripId, const std::string& name) {
+        if (tripId < 0 || tripId >= (int)trips.size()) {
+            std::cerr << "checker: no trip " << name << std::endl;
+            return -1;
+        }
+        auto it = stopsSeqToRouteIdMap.find(getRouteStopsFromTripStops(tripId));
+        if (it == stopsSeqToRouteIdMap.end() || it->second.empty()) {
+            std::cerr << "checker: no route for the stops of trip " << name << std::endl;
+            return -1;
+        }
+        return it->second[0];
+    };
+    auto tripIdOf = [&](const std::string& gtfsTripId) {
+        auto it = tripsIdsMap.find(gtfsTripId);
+        return it == tripsIdsMap.end() ? -1 : it->second;
+    };
+    std::vector<ATrip> tripsForHerOnDay;
+    int herTrainRouteId = routeOfTrip(tripIdOf(herzeliaTrainJerusalmId), herzeliaTrainJerusalmId);
+    if (herTrainRouteId != -1) {
+        tripsForHerOnDay = Aroutes[herTrainRouteId].third[5]; // on friday
+        // for entire route between herzelia and jerusalm on  during the daylight
+        printTrip(tripsForHerOnDay);
+    }
     std::cout << "  "<< std::endl;
     std::cout << "*****************************"<< std::endl;
     std::cout << "  "<< std::endl;
     // for late night route
-    int lateHerRouteId = stopsSeqToRouteIdMap[getRouteStopsFromTripStops(findTripWithStops())]; // for night, a located the stops at night and found a trip
-    tripsForHerOnDay = Aroutes[lateHerRouteId].third[5]; // on friday
-    // for entire route between herzelia and jerusalm
-    printTrip(tripsForHerOnDay);
+    int lateHerRouteId = routeOfTrip(findTripWithStops(), "of the night stops"); // for night, a located the stops at night and found a trip
+    if (lateHerRouteId != -1) {
+        tripsForHerOnDay = Aroutes[lateHerRouteId].third[5]; // on friday
+        // for entire route between herzelia and jerusalm
+        printTrip(tripsForHerOnDay);
+    }
 
     std::cout << "  "<< std::endl;
     std::cout << "*****************************"<< std::endl;
     std::cout << "  "<< std::endl;
     // print the bus 29 in herzelia:
 
-    int herBusRouteId = stopsSeqToRouteIdMap[getRouteStopsFromTripStops(tripsIdsMap[herzelia29])];
-    tripsForHerOnDay = Aroutes[herBusRouteId].third[4]; // on thuersday
-    printTrip(tripsForHerOnDay);
+    int herBusRouteId = routeOfTrip(tripIdOf(herzelia29), herzelia29);
+    if (herBusRouteId != -1) {
+        tripsForHerOnDay = Aroutes[herBusRouteId].third[4]; // on thuersday
+        printTrip(tripsForHerOnDay);
+    }
 
 
     // now print all the routes id given a stop id of herzelia and print some trip name under this route:
@@ -74,7 +602,7 @@ void Preprocess::printStopFootpaths(int stopId) {
     std::cout << " ******************** foopaths *********************** "<< std::endl;
     std::cout << "Footpaths from Stop ID: " << stopId << " (" << stopsData[stopId].name << ")\n";
     for (const Footpath& footpath : Astops[stopId].footpaths) {
-        std::cout << "  To Stop ID: " << footpath.otherStopId << " (" << stopsData[footpath.otherStopId].name << ") , lat lon: "<<stopsData[footpath.otherStopId].lat<<" " <<stopsData[footpath.otherStopId].lon<<" \n";
+        std::cout << "  To Stop ID: " << footpath.otherStopId << " (" << stopsData[footpath.otherStopId].name << ") , lat lon: "<<stopCoords.lat(footpath.otherStopId)<<" " <<stopCoords.lon(footpath.otherStopId)<<" \n";
         std::cout << "    Walk Time: " << footpath.walkTime/60 << " minutes\n";
     }
 }
@@ -156,26 +684,295 @@ void Preprocess::printService(const MyService& service) {
 //*********************** Testing End *****************************************
 
 void Preprocess::footpathBuilder() {
+    // the boxes hold every stop but the platforms of a station, they walk from the station
+    std::vector<int> fromStops;
+    for (const auto& [cell, stopIds] : stopCoords.cellStops) {
+        fromStops.insert(fromStops.end(), stopIds.begin(), stopIds.end());
+    }
+    buildFootpaths(fromStops);
+}
+void Preprocess::buildFootpaths(const std::vector<int>& stopIds) {
+    // the stops are independent, every thread takes the next one and walks the streets with a search of its own
+    std::atomic<size_t> nextStop{0};
+    auto worker = [this, &stopIds, &nextStop] {
+        std::unique_ptr<PedestrianSearch> streetSearch = streets.empty() ? nullptr : std::make_unique<PedestrianSearch>(*streets.graph);
+        for (size_t i = nextStop++; i < stopIds.size(); i = nextStop++) {
+            Astops[stopIds[i]].footpaths = footpathsForStop(stopIds[i], streetSearch.get());
+        }
+    };
+    // the straight line footpaths are cheap, threads only pay off for the searches over the streets
+    const unsigned numOfThreads = streets.empty() ? 1 : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned thread = 1; thread < numOfThreads; thread++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+void Preprocess::pedestrianGraphBuilder(const Preprocess* previous) {
+    // the streets dont come with the feed, a reload takes the graph of the previous version and only snaps the stops again
+    if (previous && previous->streets.graph) {
+        streets.graph = previous->streets.graph;
+    } else {
+        auto graph = std::make_shared<PedestrianGraph>();
+        if (!readOsmPedestrianGraph(options.osmFile, *graph)) {
+            streets = {}; // the straight line walks then
+            return;
+        }
+        streets.graph = std::move(graph);
+    }
+    std::vector<StreetStop> snapped;
+    int farStops = 0;
+    for (const auto& [cell, stopIds] : stopCoords.cellStops) {
+        for (int stopId : stopIds) {
+            double meters;
+            int64_t node = streets.graph->snap(stopCoords.lat(stopId), stopCoords.lon(stopId), meters);
+            if (node == -1) {
+                farStops++;
+                continue;
+            }
+            snapped.push_back({static_cast<uint32_t>(node), stopId, static_cast<uint32_t>(meters * 10)});
+        }
+    }
+    std::cout << snapped.size() << " stops snapped to the streets";
+    if (farStops > 0) std::cout << ", " << farStops << " farther than " << PEDESTRIAN_SNAP_DISTANCE << "m walk in a straight line";
+    std::cout << std::endl;
+    streets.setStops(std::move(snapped), NUM_OF_STOPS);
+}
+void Preprocess::walkShortcutsLoader() {
+    // the shortcuts are between the stops of the search like the footpaths, a platform in the file stands for its station
+    WalkShortcutFile file;
+    shortcutTargets.clear();
+    shortcutWalkDistance = MAX_WALK_DISTANCE;
+    if (!readWalkShortcuts(options.walkShortcutsFile, file)) return; // the usual footpaths then
+    shortcutTargets.assign(NUM_OF_STOPS, {});
+    shortcutWalkDistance = file.maxWalkDistance;
+    int numOfShortcuts = 0, unknownStops = 0;
+    for (const WalkShortcut& shortcut : file.shortcuts) {
+        int from = stationOf(stopIdOfGtfs(shortcut.fromGtfsStopId)), to = stationOf(stopIdOfGtfs(shortcut.toGtfsStopId));
+        if (from == -1 || to == -1 || stopsData[from].name.empty() || stopsData[to].name.empty()) {
+            unknownStops++;
+            continue;
+        }
+        if (from == to) continue; // two platforms of one station
+        shortcutTargets[from].push_back(to);
+        numOfShortcuts++;
+    }
+    for (std::vector<int>& targets : shortcutTargets) {
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    }
+    std::cout << numOfShortcuts << " walk shortcuts up to " << shortcutWalkDistance << "m";
+    if (unknownStops > 0) std::cout << ", " << unknownStops << " left out, their stops arent in the feed";
+    std::cout << std::endl;
+}
+std::vector<Footpath> Preprocess::footpathsForStop(int fromStopId, PedestrianSearch* streetSearch) {
+    std::vector<Footpath> footpaths;
+    if (Astops[fromStopId].routes.empty()) return footpaths; // never reached by a trip, so never walked from
+    const double lat = stopCoords.lat(fromStopId), lon = stopCoords.lon(fromStopId);
+    // the walks over the streets to the snapped stops, sorted by stop id. a stop that isnt snapped (or without an
+    // extract) walks in a straight line to every stop, and every stop walks in a straight line to it
+    std::vector<std::pair<int,double>> streetWalks;
+    const bool onStreets = streetSearch && streets.snapped(fromStopId) &&
+        streets.walkableStops(*streetSearch, lat, lon, shortcutTargets.empty() ? MAX_WALK_DISTANCE : shortcutWalkDistance, streetWalks);
+    std::sort(streetWalks.begin(), streetWalks.end());
+    auto walkDistance = [&](int stopId) {
+        if (!onStreets || !streets.snapped(stopId)) {
+            return haversineDistance(lat, lon, stopCoords.lat(stopId), stopCoords.lon(stopId));
+        }
+        auto walk = std::lower_bound(streetWalks.begin(), streetWalks.end(), std::make_pair(stopId, 0.0));
+        return walk != streetWalks.end() && walk->first == stopId ? walk->second : std::numeric_limits<double>::max();
+    };
+    if (!shortcutTargets.empty()) {
+        // only the walks of the shortcuts, whatever their length. a stop that moved out of reach loses its shortcuts
+        for (int stopId : shortcutTargets[fromStopId]) {
+            if (Astops[stopId].routes.empty()) continue;
+            double distance = walkDistance(stopId);
+            if (distance <= shortcutWalkDistance) footpaths.push_back({stopId, calculateWalkTime(distance)});
+        }
+    } else if (onStreets) {
+        for (const auto& [stopId, meters] : streetWalks) {
+            if (stopId != fromStopId && !Astops[stopId].routes.empty()) footpaths.push_back({stopId, calculateWalkTime(meters)});
+        }
+        for (const Footpath& footpath : footpathsInWalkingDistance(fromStopId)) {
+            if (!streets.snapped(footpath.otherStopId)) footpaths.push_back(footpath);
+        }
+    } else {
+        footpaths = footpathsInWalkingDistance(fromStopId);
+    }
+    std::sort(footpaths.begin(), footpaths.end(), [](const Footpath& footpath1, const Footpath& footpath2) {
+        return footpath1.walkTime < footpath2.walkTime || (footpath1.walkTime == footpath2.walkTime && footpath1.otherStopId < footpath2.otherStopId);
+    });
+    if (options.maxFootpathsPerStop > 0 && static_cast<int>(footpaths.size()) > options.maxFootpathsPerStop) {
+        footpaths.resize(options.maxFootpathsPerStop);
+    }
+    return footpaths;
+}
+std::vector<Footpath> Preprocess::footpathsInWalkingDistance(int fromStopId) {
+    std::vector<Footpath> footpaths;
+    // get all og the suspects in the cirece :  the 9 boxes
+    // for each stop suspect calcuate the actual distance using the formula if it is under 500mm
+    const double lat = stopCoords.lat(fromStopId), lon = stopCoords.lon(fromStopId);
+    for (uint32_t cell : Geohash::getCellNeighbors(stopCoords.cells[fromStopId], GEO_HASH_PRESITION)) { // 9 in total
+        auto box = stopCoords.cellStops.find(cell);
+        if (box == stopCoords.cellStops.end()) continue;
+        for (const int& stopId : box->second) { // for each stop calculate its distance using haversineDistance
+            // a stop that no route serves is a dead end: a stop reached on foot is only left by a trip, never by
+            // another footpath, and walking to the stop itself never improves anything
+            if (stopId == fromStopId || Astops[stopId].routes.empty()) continue;
+            double distance = haversineDistance(lat, lon, stopCoords.lat(stopId), stopCoords.lon(stopId));
+            if (distance<MAX_WALK_DISTANCE) {
+                int walkTime = calculateWalkTime(distance);
+                footpaths.push_back({stopId,walkTime});
+            }
+        }
 
-    for (const StopData& stop : stopsData) {
-        if (!stop.name.empty()) {
-            // get all og the suspects in the cirece :  the 9 boxes
-            // for each stop suspect calcuate the actual distance using the formula if it is under 500mm
-            std::vector<std::string>geohashBoxs=Geohash::getGeohashNeighbors(stop.geohash);
-            for (const std::string& geohashBox : geohashBoxs) { // 9 in total
-                for (const int& stopId : geohashStops[geohashBox]) { // for each stop calculate its distance using haversineDistance
-
-                    double distance = haversineDistance(stop.lat,stop.lon,stopsData.at(stopId).lat,stopsData.at(stopId).lon);
-                    if (distance<MAX_WALK_DISTANCE) {
-                        int walkTime = calculateWalkTime(distance);
-                        Astops[stop.id].footpaths.push_back({stopId,walkTime});
-                    }
+    }
+    // no need to close the footpaths transitively: the walk time grows with the straight line distance, so a walk
+    // over another stop that stays under MAX_WALK_DISTANCE always has a direct footpath that is at least as fast
+    // (the same holds for the walks over the streets, they are the shortest ones)
+    return footpaths;
+}
+void Preprocess::footpathGraphBuilder() {
+    static_assert(MAX_WALK_DISTANCE / 1.111 < std::numeric_limits<uint16_t>::max(), "walk times must fit in 16 bits");
+    static_assert(WALK_SHORTCUT_MAX_DISTANCE / 1.111 < std::numeric_limits<uint16_t>::max(), "walk times must fit in 16 bits");
+    footpathGraph = {};
+    footpathGraph.maxWalkDistance = shortcutTargets.empty() ? MAX_WALK_DISTANCE : shortcutWalkDistance;
+    footpathGraph.offsets.reserve(NUM_OF_STOPS + 1);
+    size_t numOfFootpaths = 0;
+    for (const AStop& stop : Astops) {
+        footpathGraph.offsets.push_back(static_cast<uint32_t>(numOfFootpaths));
+        numOfFootpaths += stop.footpaths.size();
+    }
+    footpathGraph.offsets.push_back(static_cast<uint32_t>(numOfFootpaths));
+    if (numOfFootpaths > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "More footpaths than the footpath graph offsets can hold" << std::endl;
+    }
+    footpathGraph.otherStopIds.reserve(numOfFootpaths);
+    footpathGraph.walkTimes.reserve(numOfFootpaths);
+    for (AStop& stop : Astops) {
+        for (const Footpath& footpath : stop.footpaths) {
+            footpathGraph.otherStopIds.push_back(footpath.otherStopId);
+            footpathGraph.walkTimes.push_back(static_cast<uint16_t>(footpath.walkTime));
+        }
+        std::vector<Footpath>().swap(stop.footpaths); // the graph is the only copy now
+    }
+    std::cout << numOfFootpaths << " footpaths in the footpath graph" << std::endl;
+}
+// profiles are equal when all of their stop times are, TripStop == only compares the stops
+struct TripProfileHash {
+    std::size_t operator()(const std::vector<TripStop>& profile) const {
+        std::size_t seed = profile.size();
+        for (const TripStop& tripStop : profile) {
+            for (int value : {tripStop.id, tripStop.stopSeqIndex, tripStop.depTime, tripStop.arrTime}) {
+                seed ^= std::hash<int>()(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+            }
+        }
+        return seed;
+    }
+};
+struct TripProfileEqual {
+    bool operator()(const std::vector<TripStop>& profile1, const std::vector<TripStop>& profile2) const {
+        return std::equal(profile1.begin(), profile1.end(), profile2.begin(), profile2.end(),
+                          [](const TripStop& stop1, const TripStop& stop2) {
+                              return stop1 == stop2 && stop1.depTime == stop2.depTime && stop1.arrTime == stop2.arrTime;
+                          });
+    }
+};
+void Preprocess::tripProfileBuilder() {
+    // every trip is moved to the start of its profile, the trips with the same profile then share its stop times
+    tripProfiles = {};
+    tripProfiles.tripTimes.assign(NUM_OF_REAL_TRIPS, {});
+    std::unordered_map<std::vector<TripStop>,int,TripProfileHash,TripProfileEqual> profileIds;
+    int numOfTrips = 0;
+    for (int tripId = 0; tripId < NUM_OF_REAL_TRIPS; tripId++) {
+        std::vector<TripStop>& tripStops = trips[tripId];
+        if (tripStops.empty()) continue;
+        const int startTime = tripStops.front().depTime;
+        for (TripStop& tripStop : tripStops) {
+            tripStop.depTime -= startTime;
+            tripStop.arrTime -= startTime;
+        }
+        auto profile = profileIds.find(tripStops);
+        if (profile == profileIds.end()) {
+            profile = profileIds.emplace(tripStops, static_cast<int>(tripProfiles.profiles.size())).first;
+            tripProfiles.profiles.push_back(std::move(tripStops));
+        }
+        tripProfiles.tripTimes[tripId] = {profile->second, startTime};
+        std::vector<TripStop>().swap(tripStops); // the profile is the only copy now
+        numOfTrips++;
+    }
+    std::cout << numOfTrips << " trips in " << tripProfiles.profiles.size() << " time profiles" << std::endl;
+}
+void Preprocess::departureBoardBuilder() {
+    // every trip departs from every stop of its route but the last one, the stop ids and the trip ids are the final
+    // ones (after the stations and the renumbering) and the times come from the profiles.
+    // two passes over the trips like a counting sort, the first counts the departures of every stop and the second
+    // writes them into their place, so the events are allocated once
+    departureBoard = {};
+    std::unordered_map<std::string,int> headsignIds;
+    std::unordered_map<int,int> serviceIds; // gtfs service id -> index in departureBoard.services
+    std::vector<uint32_t> next(NUM_OF_STOPS + 1, 0);
+    std::vector<bool> seen(NUM_OF_REAL_TRIPS, false);
+    auto forEachTrip = [this, &seen](auto visit) {
+        std::fill(seen.begin(), seen.end(), false);
+        for (int routeId = 0; routeId < NUM_OF_ALGO_ROUTES; routeId++) {
+            if (Aroutes[routeId].second.size() < 2) continue;
+            for (const std::vector<ATrip>& tripsOnDay : Aroutes[routeId].third) {
+                for (const ATrip& trip : tripsOnDay) {
+                    if (seen[trip.tripId]) continue; // a trip is in the list of every day it runs on
+                    seen[trip.tripId] = true;
+                    visit(routeId, trip.tripId, Aroutes[routeId].second);
                 }
-
             }
-
+        }
+    };
+    forEachTrip([&next](int, int, const std::vector<ARouteStop>& routeStops) {
+        for (size_t stopSeqIndex = 0; stopSeqIndex + 1 < routeStops.size(); stopSeqIndex++) {
+            next[routeStops[stopSeqIndex].id + 1]++;
+        }
+    });
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        next[stopId + 1] += next[stopId];
+    }
+    departureBoard.offsets = next;
+    departureBoard.events.resize(next[NUM_OF_STOPS]);
+    forEachTrip([&](int routeId, int tripId, const std::vector<ARouteStop>& routeStops) {
+        const MyTrip& data = tripsData[tripId];
+        const std::string& headsign = data.headsign.empty() ? stopsData[routeStops.back().id].name : data.headsign;
+        auto [headsignId, newHeadsign] = headsignIds.try_emplace(headsign, static_cast<int>(departureBoard.headsigns.size()));
+        if (newHeadsign) departureBoard.headsigns.push_back(headsign);
+        auto [serviceId, newService] = serviceIds.try_emplace(data.serviceId, static_cast<int>(departureBoard.services.size()));
+        if (newService) departureBoard.services.push_back(services[data.serviceId]);
+        for (size_t stopSeqIndex = 0; stopSeqIndex + 1 < routeStops.size(); stopSeqIndex++) {
+            departureBoard.events[next[routeStops[stopSeqIndex].id]++] =
+                {tripProfiles.depTime(tripId, static_cast<int>(stopSeqIndex)), routeId, tripId, headsignId->second, serviceId->second};
+        }
+    });
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        std::sort(departureBoard.events.begin() + departureBoard.offsets[stopId],
+                  departureBoard.events.begin() + departureBoard.offsets[stopId + 1],
+                  [](const StopEvent& event1, const StopEvent& event2) {
+                      return event1.depTime != event2.depTime ? event1.depTime < event2.depTime : event1.tripId < event2.tripId;
+                  });
+    }
+    std::cout << departureBoard.events.size() << " departures, " << departureBoard.headsigns.size() << " headsigns" << std::endl;
+}
+std::vector<StopEvent> DepartureBoard::departures(int stopId, int dayInWeek, int date, int time, int count) const {
+    std::vector<StopEvent> next;
+    if (stopId < 0 || stopId >= NUM_OF_STOPS || dayInWeek < 1 || dayInWeek > NUM_OF_DAYS) return next;
+    auto end = events.begin() + offsets[stopId + 1];
+    auto it = std::lower_bound(events.begin() + offsets[stopId], end, time,
+                               [](const StopEvent& event, int t) { return event.depTime < t; });
+    for (; it != end && static_cast<int>(next.size()) < count; ++it) {
+        const MyService& service = services[it->serviceId];
+        if (service.weekArr[dayInWeek - 1] && service.startDate <= date && date <= service.endDate) {
+            next.push_back(*it);
         }
     }
+    return next;
 }
 
 
@@ -197,6 +994,57 @@ void Preprocess::algoRouteBuilder() {
     int routeId = 0;
     std::cout<< algoRoutesMap.size()<<std::endl;
     for ( auto& [routeStopsVector,tripIdsVector] : algoRoutesMap) {
+        for (const std::vector<int>& fifoTripIds : partitionFifo(tripIdsVector)) {
+            if (routeId < NUM_OF_ALGO_ROUTES) { // past it only count how many ids the feed needs
+                buildRoute(routeId, routeStopsVector, fifoTripIds);
+                buildAStops(routeId,Aroutes[routeId].first);
+                stopsSeqToRouteIdMap[routeStopsVector].push_back(routeId);
+            }
+            routeId++;
+        }
+    }
+    if (routeId > NUM_OF_ALGO_ROUTES) {
+        std::cerr << "More routes than NUM_OF_ALGO_ROUTES, compile with -DNUM_OF_ALGO_ROUTES=" << routeId << std::endl;
+        routeId = NUM_OF_ALGO_ROUTES;
+    }
+    numOfAlgoRoutes = routeId;
+    std::cout<<"num of real routes: "<<algoRoutesMap.size()<<", fifo routes: "<<numOfAlgoRoutes<<std::endl;
+}
+std::vector<std::vector<int>> Preprocess::partitionFifo(std::vector<int> tripIdsVector) const {
+    // a trip that overtakes another one (leaves after it but gets somewhere down the route before it) cant share a route
+    // with it - the search binary searches the trips of a route by their departure at any stop, not only the first one.
+    // the trips are split into chains where each trip is no earlier than the one before it at every stop and every
+    // chain becomes its own route with the same stops. most stop sequences stay one route
+    auto isNoEarlier = [this](int tripId, int previousTripId) {
+        const std::vector<TripStop>& trip = trips[tripId];
+        const std::vector<TripStop>& previousTrip = trips[previousTripId];
+        for (size_t stopSeqIndex = 0; stopSeqIndex < trip.size(); stopSeqIndex++) {
+            if (trip[stopSeqIndex].depTime < previousTrip[stopSeqIndex].depTime ||
+                trip[stopSeqIndex].arrTime < previousTrip[stopSeqIndex].arrTime) {
+                return false;
+            }
+        }
+        return true;
+    };
+    // a trip is never placed before one it doesnt overtake
+    std::stable_sort(tripIdsVector.begin(), tripIdsVector.end(), [this](int tripId1, int tripId2) {
+        return tripRunsBefore(trips[tripId1], trips[tripId2]);
+    });
+    std::vector<std::vector<int>> fifoRoutes;
+    for (int tripId : tripIdsVector) {
+        // the first chain it can follow, a chain is sorted at every stop so its last trip is its latest one everywhere
+        auto fifoRoute = std::find_if(fifoRoutes.begin(), fifoRoutes.end(), [&](const std::vector<int>& fifoTripIds) {
+            return isNoEarlier(tripId, fifoTripIds.back());
+        });
+        if (fifoRoute == fifoRoutes.end()) {
+            fifoRoutes.push_back({tripId});
+        } else {
+            fifoRoute->push_back(tripId);
+        }
+    }
+    return fifoRoutes;
+}
+void Preprocess::buildRoute(int routeId, const std::vector<ARouteStop>& routeStopsVector, const std::vector<int>& tripIdsVector) {
         std::vector<ARouteStop> routeStopsVectorSortedBySeq = routeStopsVector; // already sorted by seq
         std::vector<ARouteStop> routeStopsVectorSortedById = routeStopsVector;
 
@@ -218,21 +1066,10 @@ void Preprocess::algoRouteBuilder() {
 
             }
         }
-        // for each day sort its trip by their dep time
-        // sort based on the depTime at the first stop because thats enought
-        for(int day = 0;day<NUM_OF_DAYS;day++){
-                std::sort(tripDays[day].begin(), tripDays[day].end(),
-             [this](const ATrip& trip1, const ATrip&  trip2) {
-                 return trips[trip1.tripId][0].depTime < trips[trip2.tripId][0].depTime;
-             });
-        }
+        // no sorting needed: the trips come from partitionFifo already sorted by their dep time at every stop
+        // and the trips of a day keep that order
         // after adding all the trips add sorting to each day
         Aroutes [routeId] = {routeStopsVectorSortedById,routeStopsVectorSortedBySeq,tripDays};
-        buildAStops(routeId,routeStopsVectorSortedById);
-        stopsSeqToRouteIdMap[routeStopsVectorSortedBySeq] = routeId;
-        routeId++;
-    }
-    std::cout<<"num of real routes: "<<algoRoutesMap.size()<<std::endl;
 }
 void Preprocess::buildAStops(int routeId,const std::vector<ARouteStop>& routeStopsVector) {
     // a function that builds that Astops data structe - connect stop_id to routes_ids and footpath
@@ -245,7 +1082,7 @@ void Preprocess::buildAStops(int routeId,const std::vector<ARouteStop>& routeSto
     }
 }
 void Preprocess::serviceBuilder() {
-    std::string filename = "data/calendar.txt";
+    std::string filename = options.dataDir + "calendar.txt";
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Could not open file: " << filename << std::endl;
@@ -275,19 +1112,24 @@ void Preprocess::serviceBuilder() {
     }
 }
 void Preprocess::stopsBuilder() {
-    std::string filename = "data/stops.txt";
+    std::string filename = options.dataDir + "stops.txt";
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Could not open file: " << filename << std::endl;
         return;
     }
 
-    //  header: stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon
+    //  header: stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon,location_type,parent_station
     std::string line;
     std::string stopIdStr, stopCode, stopName, stopDesc; // stopDesc is unused, so we can skip it
-    std::string stopLatStr, stopLonStr;
-    int stopId;
+    std::string stopLatStr, stopLonStr, locationTypeStr, parentStationStr;
+    int stopId, locationType, parentStation;
     double lat, lon;
+    stationIds.assign(NUM_OF_STOPS, -1); // the parent station of each stop for now, stationBuilder resolves them
+    stopCoords = {};
+    stopCoords.lats.assign(NUM_OF_STOPS, 0);
+    stopCoords.lons.assign(NUM_OF_STOPS, 0);
+    stopCoords.cells.assign(NUM_OF_STOPS, 0);
 
     std::getline(file, line); // Skip the header line
     while (std::getline(file, line)) {
@@ -302,27 +1144,112 @@ void Preprocess::stopsBuilder() {
         std::getline(iss, stopDesc, ',');     // stop_desc (skip)
         std::getline(iss, stopLatStr, ',');   // stop_lat
         std::getline(iss, stopLonStr, ',');   // stop_lon
+        locationTypeStr.clear();
+        parentStationStr.clear();
+        std::getline(iss, locationTypeStr, ',');   // location_type (optional)
+        std::getline(iss, parentStationStr, ',');  // parent_station (optional)
 
         // Convert strings to numeric values:
         std::from_chars(stopIdStr.data(), stopIdStr.data() + stopIdStr.size(), stopId);
         std::from_chars(stopLatStr.data(), stopLatStr.data() + stopLatStr.size(), lat);
         std::from_chars(stopLonStr.data(), stopLonStr.data() + stopLonStr.size(), lon);
 
-        std::string geohash = Geohash::encodeGeohash(lat, lon, GEO_HASH_PRESITION);
         int myStopId = getStopId(stopId);
-        stopsData[myStopId] = {myStopId,stopName, lat, lon,geohash};
-        geohashStops[geohash] .push_back(myStopId) ; // grouping together stops under that same geohash box
+        stopsData[myStopId] = {myStopId,stopName};
+        stopCoords.lats[myStopId] = static_cast<int32_t>(std::llround(lat * COORD_SCALE));
+        stopCoords.lons[myStopId] = static_cast<int32_t>(std::llround(lon * COORD_SCALE));
+        // the box of the stored coordinates, so a stop is always in the box its coordinates say
+        uint32_t cell = Geohash::encodeCell(stopCoords.lat(myStopId), stopCoords.lon(myStopId), GEO_HASH_PRESITION);
+        stopCoords.cells[myStopId] = cell;
+        stopCoords.cellStops[cell].push_back(myStopId); // grouping together stops under that same geohash box
+        // only stops the trips can stop at are merged: a platform (0 or empty) or a boarding area (4) of a platform,
+        // entrances and the other nodes of a station stay as they are
+        locationType = 0;
+        std::from_chars(locationTypeStr.data(), locationTypeStr.data() + locationTypeStr.size(), locationType);
+        if ((locationType == 0 || locationType == 4) &&
+            std::from_chars(parentStationStr.data(), parentStationStr.data() + parentStationStr.size(), parentStation).ec == std::errc()) {
+            int parentStopId = getStopId(parentStation);
+            if (parentStopId >= 0 && parentStopId < NUM_OF_STOPS) stationIds[myStopId] = parentStopId;
+        }
     }
 }
+void Preprocess::stationBuilder() {
+    // big interchanges are dozens of platform stops, each with its own routes and footpaths to all of the others, so
+    // the search marks and relaxes every one of them. here the platforms are merged into their station: the trips stop
+    // at the station, only the station is left in the boxes of stopCoords (so only it has footpaths and only it is near a query)
+    // and the walk between its platforms becomes the transfer time of the station.
+    // a feed without parent stations gets stations of the stops with the same name within STATION_CLUSTER_RADIUS
+    std::vector<int> parentStopIds = std::move(stationIds);
+    stationIds.resize(NUM_OF_STOPS);
+    std::iota(stationIds.begin(), stationIds.end(), 0);
+    if (!options.stationAggregation) return;
+    bool hasStations = std::any_of(parentStopIds.begin(), parentStopIds.end(), [](int parentStopId) { return parentStopId != -1; });
+    if (hasStations) {
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            // a boarding area belongs to a platform that belongs to the station, a parent that isnt in stops.txt is ignored
+            int stationId = stopId;
+            for (int depth = 0; depth < 2 && parentStopIds[stationId] != -1 && !stopsData[parentStopIds[stationId]].name.empty(); depth++) {
+                stationId = parentStopIds[stationId];
+            }
+            stationIds[stopId] = stationId;
+        }
+    } else {
+        std::unordered_map<std::string,std::vector<int>> stationsByName; // the first stop of every cluster
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            const StopData& stop = stopsData[stopId];
+            if (stop.name.empty()) continue;
+            std::vector<int>& stations = stationsByName[stop.name];
+            auto station = std::find_if(stations.begin(), stations.end(), [this, stopId](int stationId) {
+                return haversineDistance(stopCoords.lat(stopId), stopCoords.lon(stopId), stopCoords.lat(stationId),
+                                         stopCoords.lon(stationId)) < STATION_CLUSTER_RADIUS;
+            });
+            if (station == stations.end()) {
+                stations.push_back(stopId);
+            } else {
+                stationIds[stopId] = *station;
+            }
+        }
+    }
+
+    // the trips stop at the stations from now on, the platforms they stopped at give the transfer time of the station
+    std::unordered_map<int,std::vector<int>> platformsOfStation;
+    std::vector<bool> served(NUM_OF_STOPS, false);
+    for (std::vector<TripStop>& trip : trips) {
+        for (TripStop& tripStop : trip) {
+            if (!served[tripStop.id]) {
+                served[tripStop.id] = true;
+                platformsOfStation[stationIds[tripStop.id]].push_back(tripStop.id);
+            }
+            tripStop.id = stationIds[tripStop.id];
+        }
+    }
+    for (const auto& [stationId, platformIds] : platformsOfStation) {
+        int farthest = 0;
+        for (size_t i = 0; i < platformIds.size(); i++) {
+            for (size_t j = i + 1; j < platformIds.size(); j++) {
+                int platform1 = platformIds[i], platform2 = platformIds[j];
+                farthest = std::max(farthest, calculateWalkTime(haversineDistance(stopCoords.lat(platform1), stopCoords.lon(platform1),
+                                                                                  stopCoords.lat(platform2), stopCoords.lon(platform2))));
+            }
+        }
+        Astops[stationId].transferTime = farthest;
+    }
+    int mergedStops = 0;
+    for (auto& [cell, stopIds] : stopCoords.cellStops) {
+        mergedStops += std::erase_if(stopIds, [this](int stopId) { return stationIds[stopId] != stopId; });
+    }
+    std::erase_if(stopCoords.cellStops, [](const auto& box) { return box.second.empty(); });
+    std::cout << mergedStops << " platform stops merged into their stations" << std::endl;
+}
 void Preprocess::build_trip_data() {
-    std::string filename = "data/trips.txt";
+    std::string filename = options.dataDir + "trips.txt";
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Could not open file: " << filename << std::endl;
         return;
     }
     int routeId, serviceId,tripIntId;
-    std::string line,tripId,serviceIdStr,routeIdStr;
+    std::string line,tripId,serviceIdStr,routeIdStr,headsign;
     std::getline(file, line); // Skip header
     while (std::getline(file, line)) {
         if (line.empty()) continue;
@@ -330,6 +1257,7 @@ void Preprocess::build_trip_data() {
         std::getline(iss, routeIdStr, ',');
         std::getline(iss, serviceIdStr, ',');
         std::getline(iss, tripId, ',');
+        std::getline(iss, headsign, ',');
 
 
         std::from_chars(routeIdStr.data(), routeIdStr.data() + routeIdStr.size(), routeId);
@@ -340,7 +1268,7 @@ void Preprocess::build_trip_data() {
         if (tripsIdsMap.contains(tripId)) {
             std::string lineName = gftsRouteIdToLineName.at(routeId);
             tripIntId=tripsIdsMap[tripId]; // that way i am taking the trip information only with trips that i sure that exsist with stops in it
-            tripsData [tripIntId ] = { tripIntId,serviceId,lineName}; // add the line name here***************************************************************************************************************
+            tripsData [tripIntId ] = { tripIntId,serviceId,lineName,routeId,headsign}; // add the line name here***************************************************************************************************************
         }
 
 
@@ -348,8 +1276,72 @@ void Preprocess::build_trip_data() {
     }
 
 }
+void Preprocess::frequencyBuilder() {
+    // frequencies.txt is optional: a trip listed there runs every headway_secs from start_time until end_time and its
+    // stop_times only give the travel times. every run becomes a trip of its own (the profile builder then stores
+    // the runs as one profile and a start time each). the first run keeps the id of the gtfs trip, the others are
+    // "<trip_id>@<start time>" in tripsIdsMap. exact_times=0 (headway only service) is read as the same exact runs
+    std::string filename = options.dataDir + "frequencies.txt";
+    std::ifstream file(filename);
+    if (!file.is_open()) return; // no frequency based trips in this feed
+    std::unordered_map<int,std::vector<int>> runStarts; // trip id -> start time of every run
+    std::unordered_map<int,std::string> gtfsTripIds;
+    std::string line, tripId, startTimeStr, endTimeStr, headwayStr;
+    std::getline(file, line); // Skip header
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        std::istringstream iss(line);
+        std::getline(iss, tripId, ',');
+        std::getline(iss, startTimeStr, ',');
+        std::getline(iss, endTimeStr, ',');
+        std::getline(iss, headwayStr, ',');
+        int tripIntId = findTripId(tripId);
+        int headway = 0;
+        std::from_chars(headwayStr.data(), headwayStr.data() + headwayStr.size(), headway);
+        if (tripIntId == -1 || trips[tripIntId].empty() || headway <= 0) continue;
+        int endTime = timeUtil::calcTimeInSeconds(endTimeStr);
+        for (int runStart = timeUtil::calcTimeInSeconds(startTimeStr); runStart < endTime; runStart += headway) {
+            runStarts[tripIntId].push_back(runStart);
+        }
+        gtfsTripIds[tripIntId] = tripId;
+    }
+    int numOfRuns = 0;
+    for (auto& [templateId, starts] : runStarts) {
+        std::sort(starts.begin(), starts.end());
+        starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+        const std::vector<TripStop> travelTimes = trips[templateId];
+        const MyTrip& templateData = tripsData[templateId]; // the first run is the template itself, the others copy it with operator=
+        const int templateStart = travelTimes.front().depTime;
+        for (size_t run = 0; run < starts.size(); run++) {
+            int runId = templateId;
+            if (run > 0) {
+                std::string runKey = gtfsTripIds[templateId] + "@" + timeUtil::convertSecondsToTime(starts[run]);
+                auto known = tripsIdsMap.find(runKey);
+                if (known != tripsIdsMap.end()) {
+                    runId = known->second;
+                } else if (lastTripId + 1 < NUM_OF_REAL_TRIPS) {
+                    runId = ++lastTripId;
+                    tripsIdsMap[runKey] = runId;
+                } else {
+                    std::cerr << "More trips than NUM_OF_REAL_TRIPS, skipping runs of trip " << gtfsTripIds[templateId] << std::endl;
+                    tripIdsExhausted = true;
+                    break;
+                }
+            }
+            trips[runId] = travelTimes;
+            for (TripStop& tripStop : trips[runId]) {
+                tripStop.depTime += starts[run] - templateStart;
+                tripStop.arrTime += starts[run] - templateStart;
+            }
+            tripsData[runId] = templateData;
+            tripsData[runId].tripId = runId;
+            numOfRuns++;
+        }
+    }
+    std::cout << runStarts.size() << " frequency based trips, " << numOfRuns << " runs" << std::endl;
+}
 void Preprocess::build_trip_stops()  {
-    std::string filename = "data/stop_times.txt";
+    std::string filename = options.dataDir + "stop_times.txt";
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Could not open file: " << filename << std::endl;
@@ -357,8 +1349,9 @@ void Preprocess::build_trip_stops()  {
     }
 
     std::string line,tripId, arrivalTime,departureTime, stopIdStr,stopSeqIndexStr;
+    std::string curTripId;
     int id, stopSeqIndex;
-    int tripIntId = -1; // in the first time it is gonna be 0
+    int tripIntId = -1;
     std::getline(file, line) ;// Skip the header line
     while (std::getline(file, line)) {
         if (line.empty()) {
@@ -375,19 +1368,30 @@ void Preprocess::build_trip_stops()  {
         id = getStopId(id);// doing -1 for my convetion
         std::from_chars(stopSeqIndexStr.data(), stopSeqIndexStr.data() + stopSeqIndexStr.size(),  stopSeqIndex);
         // only if i am encoutring a trip then incerment the trip counter becasue in route.txt file there are trips that doesnt exsist = not stops
-        if (!tripsIdsMap.contains(tripId)) {
-            tripIntId++;
-            tripsIdsMap[tripId]=tripIntId;
-            trips[tripIntId].push_back({id, stopSeqIndex,timeUtil::calcTimeInSeconds(departureTime),timeUtil::calcTimeInSeconds(arrivalTime)});
-
-        }
-        else {
-            trips[tripIntId].push_back({id, stopSeqIndex,timeUtil::calcTimeInSeconds(departureTime),timeUtil::calcTimeInSeconds(arrivalTime)});
+        // (an incremental update seeds tripsIdsMap with the ids of the previous build so unchanged trips keep their id)
+        if (tripId != curTripId) {
+            curTripId = tripId;
+            auto known = tripsIdsMap.find(tripId);
+            if (known == tripsIdsMap.end()) {
+                if (lastTripId + 1 >= NUM_OF_REAL_TRIPS) {
+                    std::cerr << "More trips than NUM_OF_REAL_TRIPS, skipping trip " << tripId << std::endl;
+                    tripIdsExhausted = true;
+                    tripIntId = -1;
+                    continue;
+                }
+                tripIntId = ++lastTripId;
+                tripsIdsMap[tripId]=tripIntId;
+            }
+            else {
+                tripIntId = known->second;
+            }
         }
+        if (tripIntId == -1) continue;
+        trips[tripIntId].push_back({id, stopSeqIndex,timeUtil::calcTimeInSeconds(departureTime),timeUtil::calcTimeInSeconds(arrivalTime)});
 
 
     }
-    std::cout << tripsIdsMap.size() << " " <<tripIntId<<std::endl;
+    std::cout << tripsIdsMap.size() << " " <<lastTripId<<std::endl;
     for (auto& trip : trips) {
         // sort the stops inside every trip by thier seq_index
         std::sort(trip.begin(), trip.end(), StopsComparator());
@@ -396,7 +1400,7 @@ void Preprocess::build_trip_stops()  {
 }
 void Preprocess::lineNamesBuilder() {
     // here i am working with the gfts route id and not mine, this function is for linking a trip with its public name
-    std::string filename = "data/routes.txt";
+    std::string filename = options.dataDir + "routes.txt";
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Could not open file: " << filename << std::endl;
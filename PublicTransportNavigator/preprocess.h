@@ -5,14 +5,25 @@
 #ifndef PREPROCESS_H
 #define PREPROCESS_H
 
+// the sizes of the israeli feed, can be overridden with -D for other feeds (tools/feedGenerator prints them)
+#ifndef NUM_OF_STOPS
 #define NUM_OF_STOPS 51229 // this is diffrent than stops which have thier id start from 1 i want it to start from 0
+#endif
+#ifndef NUM_OF_ALGO_ROUTES
 #define NUM_OF_ALGO_ROUTES 7377
+#endif
 #define NUM_OF_DAYS 7
+#ifndef NUM_OF_REAL_TRIPS
 #define NUM_OF_REAL_TRIPS 282523 // the actual size is 282523  i decide such that the id would start from 0 not 1
+#endif
 
 #define GEO_HASH_PRESITION 5
 #define MAX_WALK_DISTANCE 1000 // ie 1 km
+#define STATION_CLUSTER_RADIUS 50 // meters, same name stops this close are one station when the feed has no parent stations
+#define LOCALITY_CURVE_PRECISION 8 // geohash length of the curve the locality renumbering orders routes along (~20m)
+#define COORD_SCALE 1e7 // the stop coordinates are fixed point in 1e-7 degrees (about a centimeter)
 
+#include <cstdint>
 #include <charconv>
 #include <iostream>
 #include <fstream>
@@ -22,6 +33,9 @@
 #include  <unordered_map>
 #include <vector>
 #include "geoUtil.h"
+#include "buildReport.h"
+#include "walkShortcuts.h"
+#include "pedestrianGraph.h"
 #include <chrono>
 #include <iomanip>
 
@@ -56,12 +70,20 @@ struct ATrip{
     std::string lineName; // could be a bus number or names of 2 train stations
 };
 
-struct StopData {
+struct StopData { // what only the output reads, the coordinates are in StopCoords
     int id;
     std::string name;
-    double lat;
-    double lon;
-    std::string geohash;
+};
+// the coordinates of the stops apart from their names, what the footpaths, the stations and the walks from and to a
+// query location read: one array per field in fixed point (the feeds have 6 decimals, no stop moves) and the geohash
+// box of every stop as an integer (Geohash::encodeCell), plus the stops of every box
+struct StopCoords {
+    std::vector<int32_t> lats; // NUM_OF_STOPS entries, 0 for an id that isnt a stop
+    std::vector<int32_t> lons;
+    std::vector<uint32_t> cells;
+    std::unordered_map<uint32_t,std::vector<int>> cellStops; // a station stands for its platforms
+    double lat(int stopId) const { return lats[stopId] / COORD_SCALE; }
+    double lon(int stopId) const { return lons[stopId] / COORD_SCALE; }
 };
 struct Footpath {
     int otherStopId;
@@ -70,16 +92,91 @@ struct Footpath {
 
 struct AStop {
     std::vector<int> routes; // route ids that serve this stop
-    std::vector<Footpath> footpaths;
+    std::vector<Footpath> footpaths; // only while building, the search reads the footpathGraph
+    int transferTime = 0; // seconds, the walk between the two farthest platforms of a station, 0 for a single stop
 };
 
+// the footpaths of all the stops in one compressed sparse row array: the footpaths of stop s are the entries
+// [offsets[s], offsets[s + 1]) of otherStopIds and walkTimes, nearest first. 16 bit walk times are enough,
+// MAX_WALK_DISTANCE is a walk of about 15 minutes and WALK_SHORTCUT_MAX_DISTANCE of about an hour
+struct FootpathGraph {
+    std::vector<uint32_t> offsets; // NUM_OF_STOPS + 1 entries
+    std::vector<int> otherStopIds;
+    std::vector<uint16_t> walkTimes;
+    int maxWalkDistance = MAX_WALK_DISTANCE; // meters, the query locations walk this far to and from the stops too
+    uint32_t begin(int stopId) const { return offsets[stopId]; }
+    uint32_t end(int stopId) const { return offsets[stopId + 1]; }
+};
 
+// the stop times of every trip, stored once per time profile: trips with the same stops and the same travel and dwell
+// times between them (a line that runs every few minutes, the runs of a frequencies.txt trip) share one profile and
+// cost only their start time. the stop times of a trip are its profile shifted by its start time
+struct TripTimes {
+    int profileId = -1; // -1 = no trip with this id
+    int startTime = 0; // the departure from the first stop
+};
+struct TripProfiles {
+    std::vector<std::vector<TripStop>> profiles; // stop times relative to the departure from the first stop
+    std::vector<TripTimes> tripTimes; // key = trip_id
+
+    bool hasTrip(int tripId) const { return tripTimes[tripId].profileId != -1; }
+    size_t numOfStops(int tripId) const { return profiles[tripTimes[tripId].profileId].size(); }
+    int depTime(int tripId, int stopSeqIndex) const {
+        const TripTimes& times = tripTimes[tripId];
+        return profiles[times.profileId][stopSeqIndex].depTime + times.startTime;
+    }
+    int arrTime(int tripId, int stopSeqIndex) const {
+        const TripTimes& times = tripTimes[tripId];
+        return profiles[times.profileId][stopSeqIndex].arrTime + times.startTime;
+    }
+    TripStop stop(int tripId, int stopSeqIndex) const {
+        const TripTimes& times = tripTimes[tripId];
+        TripStop tripStop = profiles[times.profileId][stopSeqIndex];
+        tripStop.depTime += times.startTime;
+        tripStop.arrTime += times.startTime;
+        return tripStop;
+    }
+    std::vector<TripStop> stops(int tripId) const { // a copy, for the code that needs the whole trip
+        std::vector<TripStop> tripStops;
+        if (!hasTrip(tripId)) return tripStops;
+        for (size_t stopSeqIndex = 0; stopSeqIndex < numOfStops(tripId); stopSeqIndex++) {
+            tripStops.push_back(stop(tripId, static_cast<int>(stopSeqIndex)));
+        }
+        return tripStops;
+    }
+};
 
 struct MyService {
     int startDate;
     int endDate;
     std::array<int,NUM_OF_DAYS> weekArr;
 };
+
+#define DEPARTURE_BOARD_MAX 100 // departures one board query returns at most
+
+// a departure of a trip from a stop, the entries of a departure board
+struct StopEvent {
+    int depTime; // seconds from the midnight of the service day, past 24:00 for trips that run after midnight
+    int routeId;
+    int tripId;
+    int headsignId; // in DepartureBoard::headsigns
+    int serviceId; // in DepartureBoard::services
+};
+// the departures of every stop sorted by time, one compressed sparse row array like the footpaths: the departures of
+// stop s are the entries [offsets[s], offsets[s + 1]) of events. the trips of every day of the week are in the same
+// array, the days and dates a trip runs on are checked while reading, so a board is one binary search and a short
+// sequential read and never touches the routes or the search
+struct DepartureBoard {
+    std::vector<uint32_t> offsets; // NUM_OF_STOPS + 1 entries
+    std::vector<StopEvent> events;
+    std::vector<std::string> headsigns; // every headsign once, a trip without one shows its last stop
+    std::vector<MyService> services;
+
+    // the next departures from stopId at or after time on date (dayInWeek 1 = sunday, like Time), at most count of
+    // them. only the trips of that service day, like the search: a trip of the day before that leaves after midnight
+    // isnt on it
+    std::vector<StopEvent> departures(int stopId, int dayInWeek, int date, int time, int count) const;
+};
 // Custom hash for a single ARouteStop, i dont need those in my algorithm, it is for the preprosccing to group toghther trips under a route
 struct RouteStopHash {
     std::size_t operator()(const ARouteStop& ts) const {
@@ -109,11 +206,15 @@ struct MyTrip {
     int tripId;
     int serviceId;
     std::string lineName;
+    int gtfsRouteId; // the route_id of the feed, the delay predictions are per gtfs route
+    std::string headsign; // trip_headsign, can be empty
     MyTrip& operator=(const MyTrip& other) {
         if (this != &other) { // Check for self-assignment
             tripId = other.tripId;
             serviceId = other.serviceId;
              lineName = other.lineName;
+            gtfsRouteId = other.gtfsRouteId;
+            headsign = other.headsign;
         }
         return *this;
     }
@@ -145,47 +246,119 @@ struct Triple {
         return *this;
     }
 };
+struct PreprocessOptions {
+    std::string dataDir = "data/"; // where the gtfs txt files are
+    bool runChecker = true; // the checker prints known israeli trips, turn it off for other feeds
+    std::string buildReportFile = "build_report.json"; // empty = dont write the report
+    std::string delayTableFile; // LatencyPrediction/compile_delay_table.py output for SAFEST_JOURNEY, empty = none
+    std::string transferPatternsFile; // tools/transferPatternBuilder output, empty = every query runs the search
+    bool incrementalUpdates = true; // a reload patches the previous timetable instead of building from scratch
+    // renumber stops, routes and trips in the order the search reads them (see renumberForLocality), the ids then
+    // no longer follow the feed so reloads are always full builds
+    bool localityOrder = false;
+    // one stop per station: the platforms of a parent_station (or same name stops close to each other when the feed
+    // has no stations) are merged into the station, see stationBuilder. off by default: the station gets a single
+    // transfer time (the walk between its farthest platforms), so changing between close platforms gets slower
+    bool stationAggregation = false;
+    // keep only the k nearest footpaths of every stop, 0 = all of them. the walks to farther stops are then lost
+    // (the footpaths are relaxed one step only), smaller graph but some journeys get later
+    int maxFootpathsPerStop = 0;
+    // tools/walkShortcutBuilder output: the footpaths are its shortcuts instead of all the stops within MAX_WALK_DISTANCE,
+    // and the walks from and to the query locations go as far as the shortcuts do. empty = none
+    std::string walkShortcutsFile;
+    // an openstreetmap extract (osm xml, see pedestrianGraph.h): the footpaths and the walks from and to the query
+    // locations go over its streets instead of in a straight line. read once, the reloads keep the first graph. empty = none
+    std::string osmFile;
+};
 class Preprocessor {
 public:
     virtual ~Preprocessor() = default;
 
     // must have data structure
     std::array< MyTrip,NUM_OF_REAL_TRIPS> tripsData = {}; // key  = trip_id
-    std::array< std::vector<TripStop>,NUM_OF_REAL_TRIPS> trips; // key  = trip_id holds the trip and the stop times he visit
+    std::array< std::vector<TripStop>,NUM_OF_REAL_TRIPS> trips; // key  = trip_id holds the trip and the stop times he visit, only while building
+    TripProfiles tripProfiles; // the stop times the search reads, built from trips at the end of the build
     // the main data structure, route to stops to trips within day
     // need to change the trip stop to a RStop
     std::array<Triple<std::vector<ARouteStop>,std::vector<ARouteStop>,std::array<std::vector<ATrip>,NUM_OF_DAYS>>,NUM_OF_ALGO_ROUTES> Aroutes = {};// the final data structure for the algorithm
     std::array<AStop,NUM_OF_STOPS> Astops = {}; // the stops data strutcure i am gonna use for my algorithm, maps between stop to routes that serve it
-    std::array<StopData,NUM_OF_STOPS> stopsData = {} ; // hold the data about a stop - name, lat/lon not used in the algorithm but for later purpuse
-
+    std::array<StopData,NUM_OF_STOPS> stopsData = {} ; // the names of the stops, read only for the output
+    StopCoords stopCoords; // where the stops are, the hot part of stopsData
+    FootpathGraph footpathGraph; // the footpaths the search relaxes, built from Astops footpaths at the end of the build
+    DepartureBoard departureBoard; // the departures of every stop for the departure boards, built at the end of the build
+    StreetNetwork streets; // the streets the walks go over and the stops snapped to them, empty without osmFile
 
-    std::unordered_map<std::string,std::vector<int>>geohashStops;
+    BuildReport buildReport; // time/memory of each builder and the size of each data structure, filled by process()
     virtual void process() = 0; // Pure virtual function
+    virtual int findTripId(const std::string& gtfsTripId) const = 0; // my trip id of a gtfs trip id, -1 if it isnt in the feed
+    // gtfs <-> my ids for input and output, the internal ids are only the gtfs ones when the build didnt renumber them
+    virtual std::string gtfsTripIdOf(int tripId) const = 0;
+    virtual int stopIdOfGtfs(int gtfsStopId) const = 0; // -1 if it isnt a stop of the feed
+    virtual int gtfsStopIdOf(int stopId) const = 0;
+    virtual int stationOf(int stopId) const = 0; // the stop the search uses for a platform, the stop itself if it isnt one
 
 };
 class Preprocess : public Preprocessor {
 public:
+    explicit Preprocess(PreprocessOptions options_ = {}) : options(std::move(options_)) {}
 
     void process() override;
+    // builds the same timetable as process() by patching previous, which was built from an older version of the feed:
+    // only the routes whose trips changed and the footpaths around stops that moved are rebuilt.
+    // returns false when the feed cant be patched (out of trip/route ids), the object must then be thrown away
+    bool processIncremental(const Preprocess& previous);
+    int findTripId(const std::string& gtfsTripId) const override;
+    std::string gtfsTripIdOf(int tripId) const override;
+    int stopIdOfGtfs(int gtfsStopId) const override;
+    int gtfsStopIdOf(int stopId) const override;
+    int stationOf(int stopId) const override;
+    // only trips, tripsData and the trip ids - the first stages of process(), for tools that dont route
+    void ingestTrips();
      ~Preprocess() override = default ;
 private:
+    PreprocessOptions options;
+    int lastTripId = -1; // the highest trip id given so far, new trips of an incremental update get the ids after it
+    bool tripIdsExhausted = false;
+    int numOfAlgoRoutes = 0; // route ids in use are below it
+    std::vector<int> freeRouteIds; // ids of routes an incremental update deleted, reused for new routes
+    bool renumbered = false; // the ids were laid out by renumberForLocality
+    std::vector<int> stationIds; // stop id -> the stop id of its station (itself for a station or a single stop)
+    std::vector<int> stopIdsByGtfs; // getStopId(gtfs stop_id) -> my stop id, filled by renumberForLocality
+    std::vector<int> gtfsStopIds; // my stop id -> gtfs stop_id, filled by renumberForLocality
+    std::vector<std::vector<int>> shortcutTargets; // stop id -> the stops of its walk shortcuts, empty without walkShortcutsFile
+    int shortcutWalkDistance = MAX_WALK_DISTANCE;
     std::unordered_map<int,std::string> gftsRouteIdToLineName = {};
     std::unordered_map<std::string,int> tripsIdsMap; // maps between the string id of the gtfs to my int id for efficent
     // all of the arrays are serve as a hasmap with direct acsses such that the key is simply the index
     std::unordered_map<std::vector<ARouteStop>,std::vector<int>,VectorRouteStopHash> algoRoutesMap;
     std::unordered_map<int,MyService> services; // not sequential -> therefore the hashmap
-    // for testing only -  a map between a seqOfStops to it route id***************
-    std::unordered_map<std::vector<ARouteStop>,int,VectorRouteStopHash>stopsSeqToRouteIdMap;
+    // a map between a seqOfStops to its route ids, one per fifo sub route (see partitionFifo)
+    std::unordered_map<std::vector<ARouteStop>,std::vector<int>,VectorRouteStopHash>stopsSeqToRouteIdMap;
 
     void build_trip_stops();
     void lineNamesBuilder();
     void build_trip_data();
+    void frequencyBuilder();
+    void tripProfileBuilder();
+    void departureBoardBuilder();
     void serviceBuilder();
     void stopsBuilder();
+    void stationBuilder();
+    void walkShortcutsLoader();
+    void pedestrianGraphBuilder(const Preprocess* previous);
     void footpathBuilder();
+    void buildFootpaths(const std::vector<int>& stopIds);
+    std::vector<Footpath> footpathsForStop(int stopId, PedestrianSearch* streetSearch);
+    std::vector<Footpath> footpathsInWalkingDistance(int stopId);
+    void footpathGraphBuilder();
     void algoRouteBuilder();
+    std::vector<std::vector<int>> partitionFifo(std::vector<int> tripIdsVector) const;
+    void buildRoute(int routeId, const std::vector<ARouteStop>& routeStopsVector, const std::vector<int>& tripIdsVector);
+    void renumberForLocality();
+    void finishBuild(std::chrono::high_resolution_clock::time_point start);
     void buildAStops(int routeId, const std::vector<ARouteStop>& routeStopsVector);
     void checker();
+    void reportFootprint();
     void printStopFootpaths(int stopId);
     void printRoutesGivenStop(int stopId);
     void printTrip(const std::vector<ATrip>& tripsForHerOnDay);
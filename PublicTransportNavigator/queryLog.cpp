@@ -0,0 +1,101 @@
+#include "queryLog.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// explicit little endian packing so the log is portable between machines
+static void putInt(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+static uint64_t getInt(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+static int32_t toMicroDegrees(double degrees) {
+    return static_cast<int32_t>(std::lround(degrees * 1e6));
+}
+
+bool QueryLogWriter::open(const std::string& filename) {
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[8];
+    std::memcpy(header, QUERY_LOG_MAGIC, 4);
+    putInt(header + 4, QUERY_LOG_VERSION, 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    openedAt = std::chrono::steady_clock::now();
+    return true;
+}
+
+void QueryLogWriter::append(StopLocation startStop, StopLocation endStop, const Time& time, int mode) {
+    append(startStop, endStop, time, std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - openedAt).count(), mode);
+}
+
+void QueryLogWriter::append(StopLocation startStop, StopLocation endStop, const Time& time, int64_t recordedAt, int mode) {
+    unsigned char record[QUERY_LOG_RECORD_SIZE];
+    putInt(record, static_cast<uint32_t>(toMicroDegrees(startStop.lat)), 4);
+    putInt(record + 4, static_cast<uint32_t>(toMicroDegrees(startStop.lon)), 4);
+    putInt(record + 8, static_cast<uint32_t>(toMicroDegrees(endStop.lat)), 4);
+    putInt(record + 12, static_cast<uint32_t>(toMicroDegrees(endStop.lon)), 4);
+    putInt(record + 16, static_cast<uint32_t>(time.curHourInSeconds), 4);
+    putInt(record + 20, static_cast<uint32_t>(time.date), 4);
+    record[24] = static_cast<unsigned char>(time.dayInWeek);
+    putInt(record + 25, static_cast<uint64_t>(recordedAt), 8);
+    record[33] = static_cast<unsigned char>(mode);
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    file.write(reinterpret_cast<const char*>(record), sizeof(record));
+}
+
+void QueryLogWriter::flush() {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    file.flush();
+}
+
+std::vector<LoggedQuery> QueryLogReader::readAll(const std::string& filename) {
+    std::vector<LoggedQuery> queries;
+    QueryLogReader reader;
+    if (!reader.open(filename)) return queries;
+    LoggedQuery query;
+    while (reader.next(query)) {
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+bool QueryLogReader::open(const std::string& filename) {
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[8];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, QUERY_LOG_MAGIC, 4) != 0 ||
+        (getInt(header + 4, 4) != QUERY_LOG_VERSION && getInt(header + 4, 4) != 1)) {
+        std::cerr << "Not a query log: " << filename << std::endl;
+        file.close();
+        return false;
+    }
+    recordSize = getInt(header + 4, 4) == 1 ? QUERY_LOG_V1_RECORD_SIZE : QUERY_LOG_RECORD_SIZE;
+    return true;
+}
+
+bool QueryLogReader::next(LoggedQuery& query) {
+    unsigned char record[QUERY_LOG_RECORD_SIZE];
+    if (!file.is_open() || !file.read(reinterpret_cast<char*>(record), recordSize)) return false;
+    query = {};
+    query.startStop = {static_cast<int32_t>(getInt(record, 4)) / 1e6, static_cast<int32_t>(getInt(record + 4, 4)) / 1e6};
+    query.endStop = {static_cast<int32_t>(getInt(record + 8, 4)) / 1e6, static_cast<int32_t>(getInt(record + 12, 4)) / 1e6};
+    query.time = {static_cast<int>(getInt(record + 16, 4)), record[24], static_cast<int>(getInt(record + 20, 4))};
+    query.recordedAtMicros = static_cast<int64_t>(getInt(record + 25, 8));
+    query.mode = recordSize > QUERY_LOG_V1_RECORD_SIZE && record[33] == SAFEST_JOURNEY ? SAFEST_JOURNEY : BEST_ARRIVAL_TIME;
+    return true;
+}
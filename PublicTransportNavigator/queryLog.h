@@ -0,0 +1,56 @@
+#ifndef QUERYLOG_H
+#define QUERYLOG_H
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "routingAlgorithm.h"
+
+// compact binary log of the queries the navigator served, so a real query stream can be replayed
+// later against any build (tools/replay.cpp).
+// file layout: the 4 bytes magic "OTQL", a uint32 version and then fixed size little endian records:
+//   int32 startLat, startLon, endLat, endLon (micro degrees)
+//   int32 depTime (seconds from midnight), int32 date (yyyymmdd), uint8 dayInWeek
+//   int64 recordedAt (microseconds since the log was opened)
+//   uint8 mode (BEST_ARRIVAL_TIME or SAFEST_JOURNEY) = 34 bytes per query
+// version 1 logs have no mode byte (33 bytes per record), their queries read as BEST_ARRIVAL_TIME
+#define QUERY_LOG_MAGIC "OTQL"
+#define QUERY_LOG_VERSION 2
+#define QUERY_LOG_RECORD_SIZE 34
+#define QUERY_LOG_V1_RECORD_SIZE 33
+
+struct LoggedQuery {
+    StopLocation startStop;
+    StopLocation endStop;
+    Time time;
+    int64_t recordedAtMicros;
+    int mode = BEST_ARRIVAL_TIME;
+};
+
+class QueryLogWriter {
+public:
+    bool open(const std::string& filename);
+    // safe to call from several worker threads
+    void append(StopLocation startStop, StopLocation endStop, const Time& time, int mode = BEST_ARRIVAL_TIME);
+    // with the recordedAt of the record given, for logs made up by a tool instead of recorded
+    void append(StopLocation startStop, StopLocation endStop, const Time& time, int64_t recordedAtMicros, int mode);
+    void flush();
+private:
+    std::ofstream file;
+    std::mutex writeMutex;
+    std::chrono::steady_clock::time_point openedAt;
+};
+
+class QueryLogReader {
+public:
+    static std::vector<LoggedQuery> readAll(const std::string& filename);
+    // one query at a time, for logs too big to hold in memory
+    bool open(const std::string& filename);
+    bool next(LoggedQuery& query);
+private:
+    std::ifstream file;
+    int recordSize = QUERY_LOG_RECORD_SIZE; // of the version of the file
+};
+
+#endif //QUERYLOG_H
@@ -0,0 +1,386 @@
+#include "queryServer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "timeUtil.h"
+
+// ------------------------------ worker pool ------------------------------
+
+WorkerPool::WorkerPool(TimetableStore& store, int numOfWorkers, JourneyCache* journeyCache) {
+    for (int i = 0; i < numOfWorkers; i++) {
+        workers.emplace_back([this, &store, journeyCache] {
+            // the search over the streets of this thread, made again only when a reload brings other streets. the graph
+            // is held with it so it outlives the search even after the versions that had it are gone
+            std::shared_ptr<const PedestrianGraph> streetGraph;
+            std::unique_ptr<PedestrianSearch> streetSearch;
+            while (true) {
+                std::packaged_task<std::string(RAPTOR&)> job;
+                {
+                    std::unique_lock<std::mutex> lock(jobsMutex);
+                    jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (stopping && jobs.empty()) return;
+                    job = std::move(jobs.front());
+                    jobs.pop();
+                }
+                // pin the live version for this query only, a swap in the middle doesnt affect it
+                TimetableGuard guard(store);
+                Preprocessor& timetable = guard.timetable();
+                RAPTOR raptor(timetable.tripProfiles, timetable.Aroutes, timetable.Astops, timetable.footpathGraph, timetable.stopsData,
+                              timetable.stopCoords, timetable.tripsData);
+                raptor.verbose = false;
+                raptor.delays = guard.delays();
+                raptor.delayTable = guard.delayTable();
+                raptor.transferPatterns = guard.transferPatterns();
+                raptor.journeyCache = journeyCache;
+                raptor.streets = &timetable.streets;
+                if (timetable.streets.graph != streetGraph) {
+                    streetSearch.reset();
+                    streetGraph = timetable.streets.graph;
+                    if (streetGraph) streetSearch = std::make_unique<PedestrianSearch>(*streetGraph);
+                }
+                raptor.streetSearch = streetSearch.get();
+                raptor.journeyCacheGeneration = guard.generation();
+                job(raptor);
+            }
+        });
+    }
+}
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+std::future<std::string> WorkerPool::submit(std::function<std::string(RAPTOR&)> job) {
+    std::packaged_task<std::string(RAPTOR&)> task(std::move(job));
+    std::future<std::string> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push(std::move(task));
+    }
+    jobsReady.notify_one();
+    return result;
+}
+size_t WorkerPool::queueDepth() {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    return jobs.size();
+}
+
+// ------------------------------ stats ------------------------------
+
+void ServerStats::recordSearch(long long micros) {
+    requests++;
+    totalSearchMicros += micros;
+    long long curMax = maxSearchMicros.load();
+    while (micros > curMax && !maxSearchMicros.compare_exchange_weak(curMax, micros)) {}
+    int bucket = 0;
+    while (bucket + 1 < SERVER_LATENCY_BUCKETS && (1LL << bucket) < micros) bucket++;
+    searchMicrosBuckets[bucket]++;
+}
+long long ServerStats::searchPercentileMicros(double p) const {
+    long long total = 0;
+    for (const auto& bucket : searchMicrosBuckets) total += bucket.load();
+    long long seen = 0;
+    for (int bucket = 0; bucket < SERVER_LATENCY_BUCKETS; bucket++) {
+        seen += searchMicrosBuckets[bucket].load();
+        if (total > 0 && seen >= p * total) return 1LL << bucket;
+    }
+    return 0;
+}
+
+// ------------------------------ server ------------------------------
+
+void appendJsonString(std::string& out, const std::string& str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' '; // control characters have no place in a stop name
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void readRouteOptions(std::istream& in, std::chrono::milliseconds serverDeadline, QueryOptions& options) {
+    std::chrono::milliseconds deadline = serverDeadline;
+    std::string word;
+    while (in >> word) {
+        if (word == "SAFEST") {
+            options.mode = SAFEST_JOURNEY;
+        } else if (long long millis; word == "DEADLINE" && in >> millis && millis > 0) {
+            if (deadline.count() <= 0 || millis < deadline.count()) deadline = std::chrono::milliseconds(millis);
+        }
+    }
+    if (deadline.count() > 0) {
+        options.deadline = std::chrono::steady_clock::now() + deadline;
+    }
+}
+
+std::string QueryServer::journeysToJson(const JourneysToDest& journeys) {
+    // compact: times stay in seconds from midnight, the client formats them
+    std::string out = "[";
+    bool first = true;
+    for (int numTransfers = 0; numTransfers <= MAX_NUM_OF_TRANSFERS; numTransfers++) {
+        if (journeys[numTransfers].empty()) continue;
+        out += first ? "" : ",";
+        first = false;
+        out += "{\"transfers\":" + std::to_string(numTransfers) + ",\"legs\":[";
+        for (size_t i = 0; i < journeys[numTransfers].size(); i++) {
+            const UserStopState& leg = journeys[numTransfers][i];
+            out += i ? ",{\"from\":" : "{\"from\":";
+            appendJsonString(out, leg.depStopName);
+            out += ",\"to\":";
+            appendJsonString(out, leg.arrStopName);
+            out += ",\"trip\":";
+            appendJsonString(out, leg.tripName);
+            out += ",\"dep\":" + std::to_string(leg.aboardedTime) + ",\"arr\":" + std::to_string(leg.arrTime) + "}";
+        }
+        out += "]}";
+    }
+    out += "]";
+    return out;
+}
+
+std::string QueryServer::statsJson() {
+    long long requests = stats.requests.load();
+    std::ostringstream oss;
+    oss << "{\"uptime_s\":" << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - startedAt).count()
+        << ",\"timetable_version\":" << store.currentVersion()
+        << ",\"delayed_routes\":" << store.delayedRoutes()
+        << ",\"workers\":" << pool.size()
+        << ",\"queue_depth\":" << pool.queueDepth()
+        << ",\"requests\":" << requests
+        << ",\"errors\":" << stats.errors.load()
+        << ",\"batches\":" << stats.batches.load()
+        << ",\"partials\":" << stats.partials.load()
+        << ",\"boards\":" << stats.boards.load()
+        << ",\"avg_search_us\":" << (requests ? stats.totalSearchMicros.load() / requests : 0)
+        << ",\"p50_search_us\":" << stats.searchPercentileMicros(0.5)
+        << ",\"p99_search_us\":" << stats.searchPercentileMicros(0.99)
+        << ",\"max_search_us\":" << stats.maxSearchMicros.load();
+    if (journeyCache) oss << ",\"journey_cache\":" << journeyCache->statsJson();
+    oss << "}";
+    return oss.str();
+}
+
+std::string QueryServer::boardJson(int gtfsStopId, int dayInWeek, int date, int time, int count) {
+    // a board is a binary search and a few reads, cheaper than the hop to a worker
+    TimetableGuard guard(store);
+    const Preprocessor& timetable = guard.timetable();
+    int stopId = timetable.stationOf(timetable.stopIdOfGtfs(gtfsStopId)); // a platform shows the board of its station
+    if (stopId == -1 || timetable.stopsData[stopId].name.empty()) {
+        stats.errors++;
+        return "{\"error\":\"unknown stop\"}";
+    }
+    stats.boards++;
+    const DepartureBoard& board = timetable.departureBoard;
+    std::string out = "{\"stop\":";
+    appendJsonString(out, timetable.stopsData[stopId].name);
+    out += ",\"departures\":[";
+    bool first = true;
+    for (const StopEvent& event : board.departures(stopId, dayInWeek, date, time, count)) {
+        out += first ? "{\"dep\":" : ",{\"dep\":";
+        first = false;
+        out += std::to_string(event.depTime) + ",\"line\":";
+        appendJsonString(out, timetable.tripsData[event.tripId].lineName);
+        out += ",\"headsign\":";
+        appendJsonString(out, board.headsigns[event.headsignId]);
+        out += "}";
+    }
+    out += "]}";
+    return out;
+}
+
+std::future<std::string> QueryServer::dispatch(const std::string& request) {
+    std::istringstream iss(request);
+    std::string command;
+    iss >> command;
+    if (command == "HEALTH") {
+        std::promise<std::string> ready;
+        ready.set_value("{\"status\":\"ok\"}");
+        return ready.get_future();
+    }
+    if (command == "RELOAD") {
+        store.requestReload();
+        std::promise<std::string> ready;
+        ready.set_value("{\"reloading\":true}");
+        return ready.get_future();
+    }
+    if (command == "DELAY") {
+        // DELAY <trip_id> <stop_sequence> <delay_seconds> [<stop_sequence> <delay_seconds> ...]
+        std::vector<GtfsDelay> delays;
+        std::string gtfsTripId;
+        int stopSeq, delaySeconds;
+        iss >> gtfsTripId;
+        while (iss >> stopSeq >> delaySeconds) {
+            delays.push_back({gtfsTripId, stopSeq, delaySeconds});
+        }
+        std::promise<std::string> ready;
+        if (delays.empty()) {
+            stats.errors++;
+            ready.set_value("{\"error\":\"bad request\"}");
+        } else {
+            ready.set_value("{\"routes_patched\":" + std::to_string(store.applyDelays(delays)) + "}");
+        }
+        return ready.get_future();
+    }
+    if (command == "BOARD") {
+        // BOARD <stop_id> <HH:MM:SS> <dayInWeek> <yyyymmdd> [count]
+        int gtfsStopId, dayInWeek, date, count = 10;
+        std::string timeStr;
+        std::promise<std::string> ready;
+        int seconds;
+        if (!(iss >> gtfsStopId >> timeStr >> dayInWeek >> date) || !timeUtil::parseTime(timeStr, seconds) || dayInWeek < 1 ||
+            dayInWeek > NUM_OF_DAYS) {
+            stats.errors++;
+            ready.set_value("{\"error\":\"bad request\"}");
+            return ready.get_future();
+        }
+        iss >> count;
+        count = std::clamp(count, 1, DEPARTURE_BOARD_MAX);
+        ready.set_value(boardJson(gtfsStopId, dayInWeek, date, seconds, count));
+        return ready.get_future();
+    }
+    if (command == "STATS") {
+        std::promise<std::string> ready;
+        ready.set_value(statsJson());
+        return ready.get_future();
+    }
+    StopLocation startStop{}, endStop{};
+    std::string timeStr;
+    Time time{};
+    QueryOptions options;
+    if (command != "ROUTE" || !(iss >> startStop.lat >> startStop.lon >> endStop.lat >> endStop.lon >> timeStr >> time.dayInWeek >> time.date) ||
+        !timeUtil::parseTime(timeStr, time.curHourInSeconds) || time.dayInWeek < 1 || time.dayInWeek > NUM_OF_DAYS) {
+        stats.errors++;
+        std::promise<std::string> ready;
+        ready.set_value("{\"error\":\"bad request\"}");
+        return ready.get_future();
+    }
+    readRouteOptions(iss, deadline, options);
+    if (queryLog) {
+        queryLog->append(startStop, endStop, time, options.mode);
+    }
+    return pool.submit([this, startStop, endStop, time, options](RAPTOR& raptor) {
+        auto start = std::chrono::steady_clock::now();
+        QueryResult result = raptor.query(startStop, endStop, time, options);
+        long long searchMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        stats.recordSearch(searchMicros);
+        if (result.partial) stats.partials++;
+        return "{\"search_us\":" + std::to_string(searchMicros) + (result.partial ? ",\"partial\":true" : "") +
+               ",\"journeys\":" + journeysToJson(result.journeys) + "}";
+    });
+}
+
+void QueryServer::handleConnection(int clientFd) {
+    std::string buffer;
+    char chunk[64 * 1024];
+    while (running) {
+        ssize_t received = recv(clientFd, chunk, sizeof(chunk), 0);
+        if (received <= 0) break;
+        buffer.append(chunk, received);
+        // every complete line that arrived together is one batch: all of it goes to the pool at once
+        // and the answers are written back with a single send, in request order
+        std::vector<std::future<std::string>> batch;
+        size_t lineStart = 0, lineEnd;
+        while ((lineEnd = buffer.find('\n', lineStart)) != std::string::npos) {
+            std::string request = timeUtil::trim(buffer.substr(lineStart, lineEnd - lineStart));
+            if (!request.empty()) {
+                batch.push_back(dispatch(request));
+            }
+            lineStart = lineEnd + 1;
+        }
+        buffer.erase(0, lineStart);
+        if (batch.empty()) continue;
+        stats.batches++;
+        if (queryLog) {
+            queryLog->flush(); // the server is usually stopped by a signal, dont lose the buffered queries
+        }
+        std::string responses;
+        for (std::future<std::string>& response : batch) {
+            responses += response.get();
+            responses += '\n';
+        }
+        size_t sent = 0;
+        while (sent < responses.size()) {
+            ssize_t n = send(clientFd, responses.data() + sent, responses.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        if (sent < responses.size()) break;
+    }
+    close(clientFd);
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    clientFds.erase(clientFd);
+    clientsClosed.notify_all();
+}
+
+bool QueryServer::listenUnix(const std::string& socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socketPath.c_str()); // a leftover socket file from a previous run
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 128) < 0) {
+        std::cerr << "Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void QueryServer::serve() {
+    running = true;
+    startedAt = std::chrono::steady_clock::now();
+    while (running) {
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            if (!running) break;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clientFds.insert(clientFd);
+        }
+        // one thread per connection only reads and writes, the searches run on the pool
+        std::thread(&QueryServer::handleConnection, this, clientFd).detach();
+    }
+    std::unique_lock<std::mutex> lock(clientsMutex);
+    clientsClosed.wait(lock, [this] { return clientFds.empty(); });
+}
+
+void QueryServer::stop() {
+    running = false;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (int clientFd : clientFds) {
+            shutdown(clientFd, SHUT_RDWR); // wakes the connection threads blocked in recv
+        }
+    }
+    if (listenFd >= 0) {
+        shutdown(listenFd, SHUT_RDWR);
+        close(listenFd);
+        listenFd = -1;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <istream>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "preprocess.h"
+#include "queryLog.h"
+#include "routingAlgorithm.h"
+#include "timetableStore.h"
+
+// a long running query server: the timetable is preprocessed once and then served over a unix
+// domain socket, so the latency of a request is only the search.
+// protocol: one request per line, one json response per line, responses come back in request order
+// so a client can pipeline as many requests as it wants:
+//   ROUTE <startLat> <startLon> <endLat> <endLon> <HH:MM:SS> <dayInWeek 1-7> <yyyymmdd> [SAFEST] [DEADLINE <ms>]
+//   HEALTH
+//   STATS
+//   RELOAD   (rebuild the timetable from the feed in the background, queries keep being served)
+//   DELAY <trip_id> <stop_sequence> <delay_seconds> [<stop_sequence> <delay_seconds> ...]   (real time delays of one trip)
+//   BOARD <stop_id> <HH:MM:SS> <dayInWeek 1-7> <yyyymmdd> [count]   (the next departures from a gtfs stop, default 10)
+// with a deadline (--deadline-ms) a ROUTE that isnt done that long after it arrived answers with the journeys found so
+// far and "partial":true, the time it waited for a worker counts too. DEADLINE gives one ROUTE a shorter budget (the
+// shard coordinator passes what is left of its own), never a longer one than --deadline-ms.
+// with a journey cache (--journey-cache) a ROUTE close to a recent one can be answered from its journeys, see
+// journeyCache.h, and STATS reports its hit rate under "journey_cache"
+#define SERVER_LATENCY_BUCKETS 32 // log2 micro second buckets for the latency percentiles
+
+void appendJsonString(std::string& out, const std::string& str); // str as a json string, with the quotes
+// the optional words after the date of a ROUTE: the mode and the deadline, the shorter of DEADLINE and serverDeadline
+// from now (0 = none). other words are skipped, like before there was more than SAFEST
+void readRouteOptions(std::istream& in, std::chrono::milliseconds serverDeadline, QueryOptions& options);
+
+class WorkerPool {
+public:
+    // a fixed number of threads, every job runs on the timetable version that is live when it starts
+    WorkerPool(TimetableStore& store, int numOfWorkers, JourneyCache* journeyCache = nullptr);
+    ~WorkerPool();
+    std::future<std::string> submit(std::function<std::string(RAPTOR&)> job);
+    size_t queueDepth();
+    int size() const { return static_cast<int>(workers.size()); }
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<std::string(RAPTOR&)>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    bool stopping = false;
+};
+
+struct ServerStats {
+    std::atomic<long long> requests{0};
+    std::atomic<long long> errors{0};
+    std::atomic<long long> batches{0};
+    std::atomic<long long> partials{0}; // searches cut short by the deadline
+    std::atomic<long long> boards{0}; // departure boards, answered without the pool
+    std::atomic<long long> totalSearchMicros{0};
+    std::atomic<long long> maxSearchMicros{0};
+    std::array<std::atomic<long long>, SERVER_LATENCY_BUCKETS> searchMicrosBuckets{};
+
+    void recordSearch(long long micros);
+    long long searchPercentileMicros(double p) const; // upper bound of the bucket that holds the percentile
+};
+
+class QueryServer {
+public:
+    QueryServer(TimetableStore& store_, int numOfWorkers, QueryLogWriter* queryLog = nullptr, int deadlineMillis = 0,
+                JourneyCache* journeyCache_ = nullptr)
+        : store(store_), queryLog(queryLog), deadline(deadlineMillis), journeyCache(journeyCache_),
+          pool(store_, numOfWorkers, journeyCache_) {}
+    bool listenUnix(const std::string& socketPath);
+    void serve(); // the accept loop, returns after stop()
+    void stop();
+
+    static std::string journeysToJson(const JourneysToDest& journeys);
+private:
+    void handleConnection(int clientFd);
+    std::future<std::string> dispatch(const std::string& request);
+    std::string statsJson();
+    std::string boardJson(int gtfsStopId, int dayInWeek, int date, int time, int count);
+
+    TimetableStore& store;
+    QueryLogWriter* queryLog;
+    std::chrono::milliseconds deadline; // 0 = none
+    JourneyCache* journeyCache; // null = off
+    ServerStats stats;
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::set<int> clientFds; // open connections, shut down by stop()
+    std::mutex clientsMutex;
+    std::condition_variable clientsClosed;
+    std::chrono::steady_clock::time_point startedAt;
+    // last, so it is destroyed first: ~WorkerPool runs the jobs still queued and they use the members above (stats)
+    WorkerPool pool;
+};
+
+#endif //QUERYSERVER_H
@@ -0,0 +1,50 @@
+#include "queryStats.h"
+#include <sstream>
+
+static const char* phaseNames[NUM_OF_QUERY_PHASES] = {
+    "access", "route_collection", "scanning", "transfers", "reconstruction"
+};
+
+RoundStats QueryStats::totals() const {
+    RoundStats sum;
+    for (const RoundStats& round : rounds) {
+        sum.markedStops += round.markedStops;
+        sum.routesInQ += round.routesInQ;
+        sum.stopEventsScanned += round.stopEventsScanned;
+        sum.earliestTripCalls += round.earliestTripCalls;
+        sum.linearScanSteps += round.linearScanSteps;
+        sum.labelsImproved += round.labelsImproved;
+        sum.prunedByTarget += round.prunedByTarget;
+        sum.footpathsRelaxed += round.footpathsRelaxed;
+    }
+    return sum;
+}
+
+std::string QueryStats::toJson() const {
+    // one line so the service can append it as is to the slow query log
+    std::ostringstream oss;
+    oss << "{\"total_ns\":" << totalNanos
+        << ",\"rounds_run\":" << roundsRun
+        << ",\"next_day_searches\":" << nextDaySearches
+        << ",\"transfer_patterns\":" << (transferPatterns ? "true" : "false")
+        << ",\"journey_cache\":" << (journeyCache ? "true" : "false")
+        << ",\"phases_ns\":{";
+    for (int phase = 0; phase < NUM_OF_QUERY_PHASES; phase++) {
+        oss << (phase ? "," : "") << "\"" << phaseNames[phase] << "\":" << phaseNanos[phase];
+    }
+    oss << "},\"rounds\":[";
+    for (int round = 0; round <= roundsRun && round < static_cast<int>(rounds.size()); round++) {
+        const RoundStats& r = rounds[round];
+        oss << (round ? "," : "")
+            << "{\"marked_stops\":" << r.markedStops
+            << ",\"routes_in_q\":" << r.routesInQ
+            << ",\"stop_events_scanned\":" << r.stopEventsScanned
+            << ",\"earliest_trip_calls\":" << r.earliestTripCalls
+            << ",\"linear_scan_steps\":" << r.linearScanSteps
+            << ",\"labels_improved\":" << r.labelsImproved
+            << ",\"pruned_by_target\":" << r.prunedByTarget
+            << ",\"footpaths_relaxed\":" << r.footpathsRelaxed << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
@@ -0,0 +1,62 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// compile with -DDISABLE_QUERY_STATS to remove every counter from the search loop,
+// otherwise a counter costs one null check when the caller didnt ask for stats
+#ifdef DISABLE_QUERY_STATS
+#define QUERY_STAT(stats, stmt) do {} while (0)
+#else
+#define QUERY_STAT(stats, stmt) do { if (stats) { stmt; } } while (0)
+#endif
+
+enum QueryPhase {
+    PHASE_ACCESS = 0,         // footpaths from the start/dest location and the round 0 labels
+    PHASE_ROUTE_COLLECTION,   // building Q from the marked stops
+    PHASE_SCANNING,           // traversing the routes in Q
+    PHASE_TRANSFERS,          // egress to the dest and footpaths from the marked stops
+    PHASE_RECONSTRUCTION,     // turning the pareto set into user journeys
+    NUM_OF_QUERY_PHASES
+};
+
+struct RoundStats {
+    long long markedStops = 0;      // marked stops at the start of the round
+    long long routesInQ = 0;
+    long long stopEventsScanned = 0;  // (route, stop) pairs visited while traversing Q
+    long long earliestTripCalls = 0;
+    long long linearScanSteps = 0;    // trips skipped after the binary search in earliestTrip
+    long long labelsImproved = 0;
+    long long prunedByTarget = 0;     // labels that beat the stop but not the dest
+    long long footpathsRelaxed = 0;
+};
+
+struct QueryStats {
+    std::vector<RoundStats> rounds; // index = round number, round 0 is the access walk
+    std::array<long long, NUM_OF_QUERY_PHASES> phaseNanos = {};
+    int roundsRun = 0;
+    int nextDaySearches = 0; // how many times run restarted on the next day
+    bool transferPatterns = false; // answered from the transfer patterns, no rounds were run
+    bool journeyCache = false; // answered from the journey cache, no rounds were run
+    long long totalNanos = 0;
+
+    RoundStats totals() const;
+    std::string toJson() const;
+};
+
+// timing helpers that do nothing (and dont read the clock) when stats are off
+inline std::chrono::steady_clock::time_point startPhase(const QueryStats* stats) {
+#ifdef DISABLE_QUERY_STATS
+    return {};
+#else
+    return stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+#endif
+}
+inline void endPhase(QueryStats* stats, QueryPhase phase, std::chrono::steady_clock::time_point start) {
+    QUERY_STAT(stats, stats->phaseNanos[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+#endif //QUERYSTATS_H
@@ -0,0 +1,66 @@
+#ifndef READERSLOTS_H
+#define READERSLOTS_H
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// the reader side of the hazard pointer style rcu the timetable versions (timetableStore.h) and the delay snapshots
+// (delayOverlay.h) are published with: a reader publishes the object it is about to use in a free slot and re checks
+// that it is still current, a writer frees a replaced object only once no slot holds it. the readers take no lock and
+// share no reference count, only when every slot is taken a reader waits for one to be given back
+template <typename T, int N>
+class ReaderSlots {
+public:
+    // pins the object current points to and returns the slot, unpin(slot) gives it back
+    int pin(const std::atomic<const T*>& current, const T*& pinned) {
+        const T* candidate = current.load();
+        int slot = claim(candidate);
+        if (slot == -1) {
+            // more readers than slots: wait for one to leave instead of spinning
+            std::unique_lock<std::mutex> lock(waitMutex);
+            waiters++;
+            slotFreed.wait(lock, [&] { return (slot = claim(candidate)) != -1; });
+            waiters--;
+        }
+        // if a swap happened between the load and the publish the writer may not have seen our slot,
+        // so only trust the object if it is still current after it is published
+        const T* now;
+        while ((now = current.load()) != candidate) {
+            candidate = now;
+            slots[slot].store(candidate);
+        }
+        pinned = candidate;
+        return slot;
+    }
+    // after this the object can be freed at any moment, read what is needed of it before
+    void unpin(int slot) {
+        slots[slot].store(nullptr);
+        if (waiters.load() > 0) {
+            // a waiter counts itself before it looks at the slots, so it either sees this one free or gets woken
+            std::lock_guard<std::mutex> lock(waitMutex);
+            slotFreed.notify_all();
+        }
+    }
+    bool held(const T* object) const {
+        for (const auto& slot : slots) {
+            if (slot.load() == object) return true;
+        }
+        return false;
+    }
+private:
+    int claim(const T* candidate) {
+        for (int i = 0; i < N; i++) {
+            const T* empty = nullptr;
+            if (slots[i].compare_exchange_strong(empty, candidate)) return i;
+        }
+        return -1;
+    }
+
+    std::array<std::atomic<const T*>, N> slots{};
+    std::mutex waitMutex;
+    std::condition_variable slotFreed;
+    std::atomic<int> waiters{0};
+};
+
+#endif //READERSLOTS_H
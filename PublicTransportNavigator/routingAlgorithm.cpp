@@ -34,64 +34,123 @@ int RoutingAlgorithm::findStopSeq(int const routeId,int const stopId) {
 
 // the arr(t,p) function from the algorithm pseoudo code
 int RoutingAlgorithm::arrTimeToStopViaTrip(const int tripId,const int stopSeqIndex) {
-
-    return trips[tripId][stopSeqIndex].arrTime;
+    const RouteDelays* routeDelays = delays ? delays->route(delays->routeOfTrip(tripId)) : nullptr;
+    if (routeDelays) {
+        return routeDelays->stop(tripProfiles, tripId, stopSeqIndex).arrTime;
+    }
+    return tripProfiles.arrTime(tripId, stopSeqIndex);
+}
+int RoutingAlgorithm::depTimeFromStopViaTrip(const int tripId,const int stopSeqIndex) {
+    const RouteDelays* routeDelays = delays ? delays->route(delays->routeOfTrip(tripId)) : nullptr;
+    if (routeDelays) {
+        return routeDelays->stop(tripProfiles, tripId, stopSeqIndex).depTime;
+    }
+    return tripProfiles.depTime(tripId, stopSeqIndex);
 }
 // the et(r,p) function from the algorithm pseoudo code
 int RoutingAlgorithm::earliestTrip(const int routeId,int stopSeqIndex, const int bestArrivalTimeToStopInPrevRound,const Time& curTime) {
+    const RouteDelays* routeDelays = delays ? delays->route(routeId) : nullptr;
+    if (routeDelays) {
+        return earliestDelayedTrip(*routeDelays, stopSeqIndex, bestArrivalTimeToStopInPrevRound, curTime);
+    }
     const std::vector<ATrip>& avaiableTrips = Aroutes[routeId].third[curTime.dayInWeek-1];
-    // Using std::upper_bound with a lambda comparator - do a binray search
-    auto it = std::upper_bound(avaiableTrips.begin(), avaiableTrips.end(), bestArrivalTimeToStopInPrevRound,
-                               [stopSeqIndex, this](int bestArrTime, const ATrip& trip) {
-                                   return bestArrTime < trips[trip.tripId][stopSeqIndex].depTime;
+    QUERY_STAT(roundStats, roundStats->earliestTripCalls++);
+    // the trips of a route are sorted by their dep time at every stop (preprocess splits the trips that overtake
+    // each other into different routes), so one binary search finds the first trip that leaves after the transfer.
+    // a departure is the start of the trip plus the offset of the stop in its time profile
+    const int readyTime = bestArrivalTimeToStopInPrevRound+MIN_TRANSFER_TIME*60;
+    auto it = std::lower_bound(avaiableTrips.begin(), avaiableTrips.end(), readyTime,
+                               [stopSeqIndex, this](const ATrip& trip, int time) {
+                                   return tripProfiles.depTime(trip.tripId, stopSeqIndex) < time;
                                });
-
-    if (it != avaiableTrips.end()) {
-        int tripIndex = std::distance(avaiableTrips.begin(), it);
-        int numOfTrips = avaiableTrips.size();
-        // find a valid trip
-        while (tripIndex<numOfTrips) {
-            bool is_trip_activate = (avaiableTrips[tripIndex].endDate >= curTime.date &&curTime.date>=avaiableTrips[tripIndex].startDate);
-            bool is_trip_safe = bestArrivalTimeToStopInPrevRound+MIN_TRANSFER_TIME*60 <= trips[avaiableTrips[tripIndex].tripId][stopSeqIndex].depTime;
-            if (is_trip_activate&&is_trip_safe) {
-                return avaiableTrips[tripIndex].tripId;
-                break;
+    // only trips that dont run on this date are skipped
+    for (; it != avaiableTrips.end(); ++it) {
+        if (it->endDate >= curTime.date && curTime.date >= it->startDate) {
+            return it->tripId;
+        }
+        QUERY_STAT(roundStats, roundStats->linearScanSteps++);
+    }
+    return -1;
+}
+// et(r,p) on a route with delayed trips: the same search over the snapshot of the route
+int RoutingAlgorithm::earliestDelayedTrip(const RouteDelays& routeDelays, int stopSeqIndex, int bestArrivalTimeToStopInPrevRound, const Time& curTime) {
+    const std::vector<ATrip>& avaiableTrips = routeDelays.tripsByDay[curTime.dayInWeek-1];
+    QUERY_STAT(roundStats, roundStats->earliestTripCalls++);
+    auto depTime = [this, &routeDelays, stopSeqIndex](const ATrip& trip) {
+        return routeDelays.stop(tripProfiles, trip.tripId, stopSeqIndex).depTime;
+    };
+    auto isValid = [&](const ATrip& trip) {
+        return trip.endDate >= curTime.date && curTime.date >= trip.startDate &&
+               bestArrivalTimeToStopInPrevRound+MIN_TRANSFER_TIME*60 <= depTime(trip);
+    };
+    if (!routeDelays.fifo) {
+        // a trip overtook another one, the order at the first stop says nothing about this stop - scan all of them
+        int bestTripId = -1, bestDepTime = std::numeric_limits<int>::max();
+        for (const ATrip& trip : avaiableTrips) {
+            QUERY_STAT(roundStats, roundStats->linearScanSteps++);
+            if (isValid(trip) && depTime(trip) < bestDepTime) {
+                bestDepTime = depTime(trip);
+                bestTripId = trip.tripId;
             }
-            tripIndex++;
         }
-
-        return -1;
-
+        return bestTripId;
+    }
+    auto it = std::lower_bound(avaiableTrips.begin(), avaiableTrips.end(), bestArrivalTimeToStopInPrevRound+MIN_TRANSFER_TIME*60,
+        [&depTime](const ATrip& trip, int time) { return depTime(trip) < time; });
+    for (; it != avaiableTrips.end(); ++it) {
+        if (isValid(*it)) {
+            return it->tripId;
+        }
+        QUERY_STAT(roundStats, roundStats->linearScanSteps++);
     }
-
     return -1;
-
-
 }
 std::vector<Footpath> RAPTOR::getFootpathsFromStop(StopLocation stop) {
     std::vector<Footpath> footpaths;
     std::unordered_set<int> processedStops;  // Track which stops we've already added
 
+    // over the streets to the stops snapped to them, the other stops (and every stop when the location isnt near the
+    // streets or none is in reach over them) in a straight line
+    bool onStreets = false;
+    if (streets && !streets->empty()) {
+        PedestrianSearch* search = streetSearch && &streetSearch->graph == streets->graph.get() ? streetSearch : nullptr;
+        if (!search) {
+            if (!ownStreetSearch || &ownStreetSearch->graph != streets->graph.get()) ownStreetSearch = std::make_unique<PedestrianSearch>(*streets->graph);
+            search = ownStreetSearch.get();
+        }
+        std::vector<std::pair<int,double>> walks;
+        onStreets = streets->walkableStops(*search, stop.lat, stop.lon, footpathGraph.maxWalkDistance, walks);
+        for (const auto& [stopId, meters] : walks) {
+            footpaths.push_back({stopId, calculateWalkTime(meters)});
+            processedStops.insert(stopId);
+        }
+    }
+
     int i = 0;
     int maxIterations = 2;  // Limit iterations to prevent infinite loop
 
     while ((i == 0 || footpaths.empty()) && i < maxIterations) {
-        std::vector<std::string> geohashBoxs = Geohash::getGeohashNeighbors(
-            Geohash::encodeGeohash(stop.lat, stop.lon, GEO_HASH_PRESITION));
-
-        for (const std::string& geohashBox : geohashBoxs) {
-            for (const int& stopId : geohashStops[geohashBox]) {
+        std::vector<uint32_t> geohashBoxs = Geohash::getCellNeighbors(
+            Geohash::encodeCell(stop.lat, stop.lon, GEO_HASH_PRESITION), GEO_HASH_PRESITION);
+
+        for (uint32_t geohashBox : geohashBoxs) {
+            // find and not operator[] - several queries can run on the same timetable at once
+            auto box = stopCoords.cellStops.find(geohashBox);
+            if (box == stopCoords.cellStops.end()) continue;
+            for (const int& stopId : box->second) {
                 // Skip if we've already processed this stop
                 if (processedStops.contains(stopId))
                     continue;
+                if (i == 0 && onStreets && streets->snapped(stopId))
+                    continue; // out of reach over the streets, even if it is close in a straight line
 
                 processedStops.insert(stopId);
 
                 double distance = haversineDistance(
                     stop.lat, stop.lon,
-                    stopsData.at(stopId).lat, stopsData.at(stopId).lon);
+                    stopCoords.lat(stopId), stopCoords.lon(stopId));
 
-                if (distance < MAX_WALK_DISTANCE * (i + 1)) {
+                if (distance < footpathGraph.maxWalkDistance * (i + 1)) {
                     int walkTime = calculateWalkTime(distance);
                     footpaths.push_back({stopId, walkTime});
                 }
@@ -138,7 +197,8 @@ UserStopState RAPTOR::convert_algo_state_to_user_state(const RAPTORStopState& al
         by_foot_str : tripsData[algo_state.tripId].lineName;
 
     return {depStopName, arrStopName, tripName,
-            algo_state.aboardedTime, algo_state.arrTime};
+            algo_state.aboardedTime, algo_state.arrTime, 0,
+            algo_state.depStopId, algo_state.arrStopId, algo_state.tripId};
 }
 std::vector<UserStopState> RAPTOR::reconstructJourney(
     const RoundBasedParetoSet& round_pareto_set,
@@ -163,7 +223,8 @@ std::vector<UserStopState> RAPTOR::reconstructJourney(
             if ( path.top().tripName == "by foot") {
                 UserStopState last_state_footpath = path.top();
                 path.pop();
-                UserStopState new_footpath_state = {current_user_state.depStopName,last_state_footpath.arrStopName,last_state_footpath.tripName,current_user_state.aboardedTime,last_state_footpath.arrTime};
+                UserStopState new_footpath_state = {current_user_state.depStopName,last_state_footpath.arrStopName,last_state_footpath.tripName,current_user_state.aboardedTime,last_state_footpath.arrTime,0,
+                                                     current_user_state.depStopId,last_state_footpath.arrStopId,FOOTPATH_TRIP_ID};
                 path.push(new_footpath_state);
 
             }
@@ -214,8 +275,10 @@ bool RAPTOR::updateStopWithPruning(
                 arrTime
             };
             if (cur_stop_id!=DEST_STOP_ID) {markedStopIds.insert(cur_stop_id);}
+            QUERY_STAT(roundStats, roundStats->labelsImproved++);
             return true;
         }
+        QUERY_STAT(roundStats, if (arrTime < bestArrTimeToCurStop) roundStats->prunedByTarget++);
     } else {
         // Target pruning only for newly discovered stops
         if (arrTime < best_arr_time_map[DEST_STOP_ID]) {
@@ -228,18 +291,244 @@ bool RAPTOR::updateStopWithPruning(
                 arrTime
             };
             if (cur_stop_id!=DEST_STOP_ID) {markedStopIds.insert(cur_stop_id);}
-
+            QUERY_STAT(roundStats, roundStats->labelsImproved++);
             return true;
         }
+        QUERY_STAT(roundStats, roundStats->prunedByTarget++);
     }
     return false;
 }
-// now left to deal with the edge case of close stops and recunstruct the solution for the user.!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endStop, Time curTime) {
+    return query(startStop, endStop, curTime).journeys;
+}
+QueryResult RAPTOR::query(const StopLocation startStop, const StopLocation endStop, Time curTime, const QueryOptions& options) {
+    QueryResult result;
+    if (!beginQuery(startStop, endStop, curTime, options, result)) {
+        result.journeys = search(startStop, endStop, curTime);
+    }
+    finishQuery(result);
+    return result;
+}
+bool RAPTOR::beginQuery(const StopLocation startStop, const StopLocation endStop, Time curTime, const QueryOptions& options, QueryResult& result) {
+    if (options.collectStats) {
+        result.stats.rounds.resize(MAX_NUM_OF_TRANSFERS+1);
+        queryStats = &result.stats;
+    }
+    mode = options.mode;
+    deadline = options.deadline;
+    deadlinePassed = false;
+    queryStart = startPhase(queryStats);
+    storeInCache = false;
+    if (journeyCache) {
+        journeyCacheKey = JourneyCache::keyOf(startStop.lat, startStop.lon, endStop.lat, endStop.lon, curTime.curHourInSeconds,
+                                              curTime.date, mode);
+        if (searchJourneyCache(startStop, endStop, curTime, result.journeys)) {
+            QUERY_STAT(queryStats, queryStats->journeyCache = true);
+            return true;
+        }
+        storeInCache = true; // the patterns or the search
+        cacheSearchTime = curTime.curHourInSeconds;
+    }
+    // the patterns only know the earliest arrival, the other modes always search
+    if (mode == BEST_ARRIVAL_TIME && searchTransferPatterns(startStop, endStop, curTime, result.journeys)) {
+        QUERY_STAT(queryStats, queryStats->transferPatterns = true);
+        return true;
+    }
+    return false;
+}
+void RAPTOR::finishQuery(QueryResult& result) {
+    QUERY_STAT(queryStats, queryStats->totalNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - queryStart).count());
+    result.partial = deadlinePassed;
+    if (storeInCache && !deadlinePassed) storeInJourneyCache(result.journeys, cacheSearchTime); // a partial answer isnt the answer
+    storeInCache = false;
+    queryStats = nullptr;
+    roundStats = nullptr;
+    mode = BEST_ARRIVAL_TIME;
+    deadline = std::chrono::steady_clock::time_point::max();
+}
+bool RAPTOR::pastDeadline() {
+    if (!deadlinePassed && deadline != std::chrono::steady_clock::time_point::max()) {
+        deadlinePassed = std::chrono::steady_clock::now() >= deadline;
+    }
+    return deadlinePassed;
+}
+// the earliest time a trip can be boarded at stopId after reaching it in round: its arrival time, plus in SAFEST_JOURNEY
+// the predicted delay of the trip that brought us there (through a footpath too, then it is the trip before the walk)
+int RAPTOR::transferReadyTime(RoundBasedParetoSet& round_pareto_set, int round, int stopId, const Time& curTime) {
+    const RAPTORStopState& state = round_pareto_set[round][stopId];
+    // at a station the next trip can leave from its farthest platform, MIN_TRANSFER_TIME already covers part of that walk
+    const int stationWalk = std::max(0, Astops[stopId].transferTime - MIN_TRANSFER_TIME*60);
+    if (mode != SAFEST_JOURNEY || !delayTable) {
+        return state.arrTime + stationWalk;
+    }
+    int feederTripId = state.tripId;
+    if (feederTripId == FOOTPATH_TRIP_ID && state.depStopId != START_STOP_ID) {
+        auto walkedFrom = round_pareto_set[round].find(state.depStopId);
+        feederTripId = walkedFrom == round_pareto_set[round].end() ? FOOTPATH_TRIP_ID : walkedFrom->second.tripId;
+    }
+    return state.arrTime + stationWalk + delayTable->delaySeconds(feederTripId, curTime.dayInWeek, state.arrTime);
+}
+// the walk to stopId among the walks from a query location (getFootpathsFromStop), -1 when it is out of reach
+static int walkTimeTo(const std::vector<Footpath>& walks, int stopId) {
+    auto walk = std::find_if(walks.begin(), walks.end(), [stopId](const Footpath& footpath) { return footpath.otherStopId == stopId; });
+    return walk == walks.end() ? -1 : walk->walkTime;
+}
+// the journeys between two covered hubs from their transfer patterns: the tree is evaluated top down on the timetable,
+// a trip node takes the earliest trip over the routes from the stop of its parent, like one round of the search does.
+// false when a location isnt at a hub, the pair wasnt precomputed or no pattern reaches the destination today,
+// the caller then runs the search
+bool RAPTOR::searchTransferPatterns(StopLocation startStop, StopLocation endStop, const Time& curTime, JourneysToDest& journeys) {
+    if (!transferPatterns ||
+        haversineDistance(startStop.lat,startStop.lon,endStop.lat,endStop.lon)<MIN_DISTANCE_FOR_PUBLIC_TRANSPORT) {
+        return false;
+    }
+    int sourceHub = transferPatterns->hubAt(startStop.lat, startStop.lon);
+    int targetHub = sourceHub == -1 ? -1 : transferPatterns->hubAt(endStop.lat, endStop.lon);
+    const PatternTree* tree = targetHub == -1 ? nullptr : transferPatterns->tree(sourceHub, targetHub);
+    if (!tree) return false;
+    // the same walks from and to the actual locations as the search
+    const std::vector<Footpath> accessWalks = getFootpathsFromStop(startStop), egressWalks = getFootpathsFromStop(endStop);
+
+    const int unreached = std::numeric_limits<int>::max();
+    std::vector<RAPTORStopState> reached(tree->numOfNodes); // how every node was reached today, arrTime unreached = not
+    std::vector<int> numOfTrips(tree->numOfNodes, 0);
+    std::array<int, MAX_NUM_OF_TRANSFERS+1> bestArrTime, bestNode;
+    bestArrTime.fill(unreached);
+    bestNode.fill(-1);
+    for (int index = 0; index < static_cast<int>(tree->numOfNodes); index++) {
+        const PatternNode& node = transferPatterns->node(*tree, index);
+        RAPTORStopState& state = reached[index];
+        state = {START_STOP_ID, node.stopId, FOOTPATH_TRIP_ID, curTime.curHourInSeconds, unreached};
+        if (node.parent == -1) {
+            const int accessTime = walkTimeTo(accessWalks, node.stopId);
+            if (accessTime != -1) state.arrTime = curTime.curHourInSeconds + accessTime;
+        } else {
+            const RAPTORStopState& parent = reached[node.parent];
+            numOfTrips[index] = numOfTrips[node.parent] + ((node.flags & PATTERN_NODE_WALK) ? 0 : 1);
+            if (parent.arrTime == unreached || numOfTrips[index] > MAX_NUM_OF_TRANSFERS) continue;
+            state.depStopId = parent.arrStopId;
+            if (node.flags & PATTERN_NODE_WALK) {
+                state.aboardedTime = parent.arrTime;
+                state.arrTime = parent.arrTime + node.walkTime;
+            } else {
+                // the same ready time as transferReadyTime in BEST_ARRIVAL_TIME
+                const int readyTime = parent.arrTime + std::max(0, Astops[parent.arrStopId].transferTime - MIN_TRANSFER_TIME*60);
+                for (const PatternConnection* connection = transferPatterns->connectionsBegin(node);
+                     connection != transferPatterns->connectionsEnd(node); connection++) {
+                    int tripId = earliestTrip(connection->routeId, connection->fromSeq, readyTime, curTime);
+                    if (tripId == -1) continue;
+                    int arrTime = arrTimeToStopViaTrip(tripId, connection->toSeq);
+                    if (arrTime < state.arrTime) {
+                        state.tripId = tripId;
+                        state.aboardedTime = depTimeFromStopViaTrip(tripId, connection->fromSeq);
+                        state.arrTime = arrTime;
+                    }
+                }
+            }
+        }
+        const int egressTime = (node.flags & PATTERN_NODE_EGRESS) ? walkTimeTo(egressWalks, node.stopId) : -1;
+        if (egressTime != -1 && state.arrTime != unreached && numOfTrips[index] > 0) {
+            int arrTime = state.arrTime + egressTime;
+            if (arrTime < bestArrTime[numOfTrips[index]]) {
+                bestArrTime[numOfTrips[index]] = arrTime;
+                bestNode[numOfTrips[index]] = index;
+            }
+        }
+    }
+
+    // a journey with more trips is only kept when it arrives earlier, the same as the rounds of the search
+    bool found = false;
+    int bestSoFar = unreached;
+    for (int round = 1; round <= MAX_NUM_OF_TRANSFERS; round++) {
+        if (bestArrTime[round] >= bestSoFar) continue;
+        bestSoFar = bestArrTime[round];
+        found = true;
+        const RAPTORStopState& last = reached[bestNode[round]];
+        std::vector<int> path; // the nodes from the egress node up to the access stop
+        for (int index = bestNode[round]; index != -1; index = transferPatterns->node(*tree, index).parent) {
+            path.push_back(index);
+        }
+        for (auto index = path.rbegin(); index != path.rend(); ++index) {
+            journeys[round].push_back(convert_algo_state_to_user_state(reached[*index]));
+        }
+        journeys[round].push_back(convert_algo_state_to_user_state({last.arrStopId, DEST_STOP_ID, FOOTPATH_TRIP_ID, last.arrTime, bestArrTime[round]}));
+    }
+    return found;
+}
+// the journeys of a cached query from the same cells at about the same time, with the walks at both ends redone from
+// and to the actual locations. every journey has to catch its first trip walking from the actual start at the actual
+// time, otherwise the entry is stale and the search runs (and replaces it)
+bool RAPTOR::searchJourneyCache(StopLocation startStop, StopLocation endStop, const Time& curTime, JourneysToDest& journeys) {
+    CachedJourneys cached;
+    if (!journeyCache->lookup(journeyCacheKey, journeyCacheGeneration, curTime.curHourInSeconds, cached)) return false;
+    // the same walks the search would take, over the streets when there are any
+    const std::vector<Footpath> accessWalks = getFootpathsFromStop(startStop), egressWalks = getFootpathsFromStop(endStop);
+    for (std::vector<CachedLeg>& legs : cached) {
+        if (legs.empty()) continue;
+        CachedLeg& access = legs.front();
+        CachedLeg& egress = legs.back();
+        // walk, trip, ..., walk. a journey that walks on from its access stop isnt reused, the walk time to that stop
+        // would be all that decides if it is still the best
+        bool catchable = legs.size() >= 3 && access.depStopId == START_STOP_ID && legs[1].tripId != FOOTPATH_TRIP_ID &&
+                         egress.arrStopId == DEST_STOP_ID;
+        const int accessTime = catchable ? walkTimeTo(accessWalks, access.arrStopId) : -1;
+        const int egressTime = catchable ? walkTimeTo(egressWalks, egress.depStopId) : -1;
+        if (accessTime != -1 && egressTime != -1) {
+            access.depTime = curTime.curHourInSeconds;
+            access.arrTime = curTime.curHourInSeconds + accessTime;
+            egress.depTime = legs[legs.size() - 2].arrTime;
+            egress.arrTime = egress.depTime + egressTime;
+            // boarding after the access walk like the search does, at a station from its farthest platform
+            const int readyTime = access.arrTime + std::max(0, Astops[access.arrStopId].transferTime - MIN_TRANSFER_TIME*60)
+                                  + MIN_TRANSFER_TIME*60;
+            catchable = readyTime <= legs[1].depTime;
+        } else {
+            catchable = false; // the stops are out of walking distance of the actual locations
+        }
+        if (!catchable) {
+            journeyCache->stats.stale++;
+            journeyCache->stats.misses++;
+            return false;
+        }
+    }
+    journeyCache->stats.hits++;
+    for (size_t round = 0; round < cached.size() && round <= MAX_NUM_OF_TRANSFERS; round++) {
+        for (const CachedLeg& leg : cached[round]) {
+            journeys[round].push_back(convert_algo_state_to_user_state({leg.depStopId, leg.arrStopId, leg.tripId, leg.depTime, leg.arrTime}));
+        }
+    }
+    return true;
+}
+void RAPTOR::storeInJourneyCache(const JourneysToDest& journeys, int searchTime) {
+    CachedJourneys cached(MAX_NUM_OF_TRANSFERS+1);
+    bool found = false;
+    int validUntil = std::numeric_limits<int>::max(); // past the first trip of a journey searchJourneyCache never reuses it
+    for (int round = 0; round <= MAX_NUM_OF_TRANSFERS; round++) {
+        for (const UserStopState& leg : journeys[round]) {
+            cached[round].push_back({leg.depStopId, leg.arrStopId, leg.tripId, leg.aboardedTime, leg.arrTime});
+            found = true;
+        }
+        if (cached[round].size() >= 2) validUntil = std::min(validUntil, cached[round][1].depTime);
+    }
+    // nothing found is left to the search every time, it is mostly a query that walks or goes on the next day
+    if (found) journeyCache->insert(journeyCacheKey, journeyCacheGeneration, searchTime, validUntil, std::move(cached));
+}
+// now left to deal with the edge case of close stops and recunstruct the solution for the user.!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+JourneysToDest RAPTOR::search(const StopLocation startStop, const StopLocation endStop, Time curTime) {
+    SearchTask task = searchSteps(startStop, endStop, curTime);
+    while (task.resume()) {} // only stops when interleaved
+    return std::move(task.journeys());
+}
+SearchTask RAPTOR::searchSteps(const StopLocation startStop, const StopLocation endStop, Time curTime, bool nextDay) {
     if (haversineDistance(startStop.lat,startStop.lon,endStop.lat,endStop.lon)<MIN_DISTANCE_FOR_PUBLIC_TRANSPORT) {
-        std::cout << "You can walk by foot to your dest" << std::endl;
-        return {};
+        if (verbose) std::cout << "You can walk by foot to your dest" << std::endl;
+        co_return JourneysToDest{};
     }
+    auto phaseStart = startPhase(queryStats);
+    // a restart on the next day overwrites the counters of the previous day search
+    QUERY_STAT(queryStats, std::fill(queryStats->rounds.begin(), queryStats->rounds.end(), RoundStats{}));
+    QUERY_STAT(queryStats, roundStats = &queryStats->rounds[0]);
     std::unordered_set<int> markedStopIds;
     std::vector<Footpath> footpathsFromStart = getFootpathsFromStop(startStop);
     std::vector<Footpath> footpathsFromDest  = getFootpathsFromStop(endStop);
@@ -255,12 +544,29 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
         best_arr_time_map[footpath.otherStopId]=arrTime ;
         round_pareto_set[NoTranfers][footpath.otherStopId]=start_state;
         markedStopIds.insert(footpath.otherStopId);
+        QUERY_STAT(roundStats, roundStats->labelsImproved++);
     }
     // init arr time to destenation
     best_arr_time_map[DEST_STOP_ID]=std::numeric_limits<int>::max(); ;
+    endPhase(queryStats, PHASE_ACCESS, phaseStart);
 
     for (int cur_round = 1; cur_round<=MAX_NUM_OF_TRANSFERS ; cur_round++) {
+        if (pastDeadline()) {
+            // the rounds before this one are complete, their journeys are returned as they are
+            if (verbose) std::cout<<"deadline passed, stoping the algorithm before round: "<<cur_round<<std::endl;
+            break;
+        }
+        QUERY_STAT(queryStats, roundStats = &queryStats->rounds[cur_round]; queryStats->roundsRun = cur_round);
+        QUERY_STAT(roundStats, roundStats->markedStops = markedStopIds.size());
+        phaseStart = startPhase(queryStats);
         std::unordered_map<int,int>Q; // route to the earliest marked stop_id in the route
+        if (interleaved) {
+            // the routes of the marked stops, one stop after the other they would be a cache miss each
+            for (int markedStopId : markedStopIds) PREFETCH(&Astops[markedStopId]);
+            co_await std::suspend_always{};
+            for (int markedStopId : markedStopIds) PREFETCH(Astops[markedStopId].routes.data());
+            co_await std::suspend_always{};
+        }
         // find routes that serve marked stops
 
         for (auto it = markedStopIds.begin(); it != markedStopIds.end(); ) {
@@ -277,9 +583,26 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
             // Erase the element and update the iterator
             it = markedStopIds.erase(it);  // erase returns the next iterator
         }
+        QUERY_STAT(roundStats, roundStats->routesInQ = Q.size());
+        endPhase(queryStats, PHASE_ROUTE_COLLECTION, phaseStart);
 
+        phaseStart = startPhase(queryStats);
+        int routesScanned = 0;
         for (const auto& [route_id, stop_id] : Q) {
+            // a half scanned round has no egress to the dest yet, so it adds no journey and is dropped as a whole
+            if (++routesScanned % DEADLINE_CHECK_ROUTES == 0 && pastDeadline()) break;
             const auto& cur_route = Aroutes[route_id];
+            if (interleaved) {
+                // the route, then its stops and the middle of its trips of the day (where the binary search starts)
+                PREFETCH(&cur_route);
+                PREFETCH(&cur_route.third[curTime.dayInWeek-1]);
+                co_await std::suspend_always{};
+                const std::vector<ATrip>& tripsOfDay = cur_route.third[curTime.dayInWeek-1];
+                PREFETCH(cur_route.first.data() + cur_route.first.size() / 2);
+                PREFETCH(cur_route.second.data());
+                if (!tripsOfDay.empty()) PREFETCH(tripsOfDay.data() + tripsOfDay.size() / 2);
+                co_await std::suspend_always{};
+            }
             const size_t num_of_stops = cur_route.first.size();
             int boarding_stop_seq_index = findStopSeq(route_id, stop_id)-1;
             // For each marked stop on this route
@@ -291,13 +614,14 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
 
                 int arrTime = std::numeric_limits<int>::max();
                 int cur_stop_id = cur_route.second[cur_stop_seq_index].id;
+                QUERY_STAT(roundStats, roundStats->stopEventsScanned++);
                 if (cur_aborded_trip_id!=-1) {
 
                     arrTime = arrTimeToStopViaTrip(cur_aborded_trip_id,cur_stop_seq_index);
                     // local and target purning:
                     // 1. target purning: if the arrival time is later than the dest it isn't relevant because we already reach the dest
                     // 2. update the arr time to that stop only if it is the best arrival time to that stop that has been found so far
-                    updateStopWithPruning( best_arr_time_map, round_pareto_set,markedStopIds,cur_stop_id,trips[cur_aborded_trip_id][boarding_stop_seq_index].depTime,arrTime,boarding_stop_id,cur_aborded_trip_id,cur_round);
+                    updateStopWithPruning( best_arr_time_map, round_pareto_set,markedStopIds,cur_stop_id,depTimeFromStopViaTrip(cur_aborded_trip_id,boarding_stop_seq_index),arrTime,boarding_stop_id,cur_aborded_trip_id,cur_round);
                 }
                 // if this trip doesnt improve the arrival time to a stop maybe there is an earlier trip that does
                 // dont change the bestArrTimeByRounds to bestArrTime instead because here we are trying the aboard on a one extra trip only from a given stop
@@ -308,7 +632,7 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
                 if (round_pareto_set[cur_round-1].contains(cur_stop_id)&& round_pareto_set[cur_round-1][cur_stop_id].arrTime<arrTime) {
                     // if we havent reach this stop yet in prev round this isnt relevant. we only do this because thier might exsit a an earlier trip for that stop with in prev round we reach it eearlier with another route
                     int prevTripId=cur_aborded_trip_id;
-                    cur_aborded_trip_id = earliestTrip(route_id,cur_stop_seq_index,round_pareto_set[cur_round-1][cur_stop_id].arrTime,curTime);
+                    cur_aborded_trip_id = earliestTrip(route_id,cur_stop_seq_index,transferReadyTime(round_pareto_set,cur_round-1,cur_stop_id,curTime),curTime);
                     if (prevTripId!=cur_aborded_trip_id) {
                         boarding_stop_id = cur_stop_id;
                         boarding_stop_seq_index = cur_stop_seq_index;
@@ -322,8 +646,14 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
 
 
 
+        }
+        endPhase(queryStats, PHASE_SCANNING, phaseStart);
+        if (deadlinePassed) {
+            if (verbose) std::cout<<"deadline passed, stoping the algorithm in round: "<<cur_round<<std::endl;
+            break;
         }
 
+        phaseStart = startPhase(queryStats);
         for (const auto&[boarding_stop_id, walkTime] : footpathsFromDest ) {
             if (round_pareto_set[cur_round].contains(boarding_stop_id) && markedStopIds.contains(boarding_stop_id)) {
                 const RAPTORStopState& state = round_pareto_set[cur_round][boarding_stop_id];
@@ -337,23 +667,43 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
         }
 
         std::unordered_set<int> markedStopIdsForFootpath ;
+        if (interleaved) {
+            for (int markedStopId : markedStopIds) PREFETCH(&footpathGraph.offsets[markedStopId]);
+            co_await std::suspend_always{};
+            for (int markedStopId : markedStopIds) {
+                PREFETCH(footpathGraph.otherStopIds.data() + footpathGraph.begin(markedStopId));
+                PREFETCH(footpathGraph.walkTimes.data() + footpathGraph.begin(markedStopId));
+            }
+            co_await std::suspend_always{};
+        }
         // go over footpath in marked stop
+        int stopsRelaxed = 0;
         for (int boarding_stop_id: markedStopIds) {
-            for ( const auto&[arr_stop_id, walkTime]: Astops[boarding_stop_id].footpaths) {
+            // the egress of this round is done, only the next rounds lose the walks that arent relaxed
+            if (++stopsRelaxed % DEADLINE_CHECK_ROUTES == 0 && pastDeadline()) break;
+            for (uint32_t edge = footpathGraph.begin(boarding_stop_id); edge < footpathGraph.end(boarding_stop_id); edge++) {
+                int arr_stop_id = footpathGraph.otherStopIds[edge];
                 const RAPTORStopState& state = round_pareto_set[cur_round][boarding_stop_id];
                 int dep_time = state.arrTime;
-                int arrTime = state.arrTime+walkTime;
+                int arrTime = state.arrTime+footpathGraph.walkTimes[edge];
                 updateStopWithPruning( best_arr_time_map, round_pareto_set,markedStopIdsForFootpath,arr_stop_id, dep_time, arrTime,boarding_stop_id,FOOTPATH_TRIP_ID,cur_round);
+                QUERY_STAT(roundStats, roundStats->footpathsRelaxed++);
             }
 
         }
         for (int stopId:  markedStopIdsForFootpath) {
             markedStopIds.insert(stopId);
         }
+        endPhase(queryStats, PHASE_TRANSFERS, phaseStart);
+        if (deadlinePassed) {
+            if (verbose) std::cout<<"deadline passed, stoping the algorithm after: "<<cur_round<<std::endl;
+            break;
+        }
         if (markedStopIds.empty()) {
             // stoping critera becasue if now by taking an extra trip no stop has improve then also by nither 2 switches there fore we can exit the loop
 
-            if (cur_round == 1) {
+            // only one day ahead: from stops no trip leaves at all (the last stop of every trip there) it would never end
+            if (cur_round == 1 && !nextDay) {
                 // Prepare time for the next day (00:05:00)
                 Time nextDayTime = {
                      5*3600 ,  // Set to 00:05:00
@@ -361,20 +711,29 @@ JourneysToDest RAPTOR::run(const StopLocation startStop, const StopLocation endS
                     incrementDate(curTime.date)  // Increment the date
                 };
 
-                std::cout << "No routes found today. Searching for routes starting at "
-                          << "00:00:01 on the next day..." << std::endl;
-
-                return run(startStop, endStop, nextDayTime);
+                if (verbose) {
+                    std::cout << "No routes found today. Searching for routes starting at "
+                              << "00:00:01 on the next day..." << std::endl;
+                }
+                QUERY_STAT(queryStats, queryStats->nextDaySearches++);
+                SearchTask nextDaySearch = searchSteps(startStop, endStop, nextDayTime, true);
+                while (nextDaySearch.resume()) {
+                    co_await std::suspend_always{}; // it stopped at a prefetch point, so does this one
+                }
+                co_return std::move(nextDaySearch.journeys());
             }
             else {
-                std::cout<<"stoping the algorithm after: "<<cur_round<<std::endl;
-                return convert_to_journeys_output(round_pareto_set);
+                if (verbose) std::cout<<"stoping the algorithm after: "<<cur_round<<std::endl;
+                break;
 
             }
 
         }
     }
-    return convert_to_journeys_output(round_pareto_set);
+    phaseStart = startPhase(queryStats);
+    JourneysToDest journeys_to_dest = convert_to_journeys_output(round_pareto_set);
+    endPhase(queryStats, PHASE_RECONSTRUCTION, phaseStart);
+    co_return journeys_to_dest;
 }
 int RAPTOR::incrementDate(int date) {
     // Extract year, month, day
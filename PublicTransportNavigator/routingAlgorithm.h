@@ -1,9 +1,17 @@
 //
 // Created by DVIR on 3/22/2025.
 //
+#include <coroutine>
+#include <memory>
 #include <unordered_set>
+#include <utility>
 #ifndef ROUTINGALGORITHM_H
 #include"preprocess.h"
+#include "queryStats.h"
+#include "delayOverlay.h"
+#include "delayTable.h"
+#include "transferPatterns.h"
+#include "journeyCache.h"
 #define ROUTINGALGORITHM_H
 #define MIN_DISTANCE_FOR_PUBLIC_TRANSPORT 200 // 200 meters
 #define MIN_TRANSFER_TIME 2 // 2 mintutes are the minum time that is allowed bweet switching trips
@@ -15,6 +23,7 @@
 #define SAFEST_JOURNEY 2
 #define LEAST_WALKING 3
 #define SAFE_LEVEL 0
+#define DEADLINE_CHECK_ROUTES 32 // routes (or stops in the transfers) between two looks at the clock when the query has a deadline
 struct StopLocation
 {
      double lat;
@@ -52,6 +61,10 @@ struct UserStopState {
     int aboardedTime;
     int arrTime;
     int walkingTime;
+    // the ids behind the names, FOOTPATH_TRIP_ID for a walk and START_STOP_ID/DEST_STOP_ID at the ends
+    int depStopId = -1;
+    int arrStopId = -1;
+    int tripId = -1;
     // Equality operator for RAPTORStopState
     bool operator==(const UserStopState& other) const {
         return aboardedTime == other.aboardedTime &&
@@ -64,24 +77,88 @@ typedef std::unordered_map<int, int> ArrivalTimeMap;
 // the set of stops state by each round
 typedef  std::array<std::unordered_map<int,RAPTORStopState>,MAX_NUM_OF_TRANSFERS+1> RoundBasedParetoSet;
 typedef  std::array<std::vector<UserStopState>,MAX_NUM_OF_TRANSFERS+1> JourneysToDest;// the journys to dest by each round with each critirea optimization
+
+// a hint to bring memory the search reads soon into the cache
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) do {} while (0)
+#endif
+
+// the search of one query as a coroutine: when it runs interleaved with other queries (see InterleavedRunner) it
+// stops after every prefetch, resume() runs it to the next one and returns false once the journeys are ready
+class SearchTask {
+public:
+    struct promise_type {
+        JourneysToDest journeys;
+        SearchTask get_return_object() { return SearchTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(JourneysToDest value) { journeys = std::move(value); }
+        void unhandled_exception() { throw; }
+    };
+    explicit SearchTask(std::coroutine_handle<promise_type> handle_) : handle(handle_) {}
+    SearchTask(SearchTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    SearchTask(const SearchTask&) = delete;
+    SearchTask& operator=(const SearchTask&) = delete;
+    ~SearchTask() { if (handle) handle.destroy(); }
+    bool resume() {
+        handle.resume();
+        return !handle.done();
+    }
+    JourneysToDest& journeys() { return handle.promise().journeys; }
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct QueryOptions {
+    bool collectStats = false; // fill QueryResult::stats, off by default so the search pays only a null check
+    // SAFEST_JOURNEY: a transfer must leave room for the predicted delay of the trip it comes from (needs a delay table)
+    int mode = BEST_ARRIVAL_TIME;
+    // past it the search stops (between rounds and every DEADLINE_CHECK_ROUTES routes) and returns the journeys of
+    // the rounds it finished, the ones with the fewest transfers. max = no deadline, the clock is never read
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+};
+struct QueryResult {
+    JourneysToDest journeys;
+    QueryStats stats; // empty unless QueryOptions::collectStats was set
+    bool partial = false; // the deadline passed, journeys with more transfers (or on the next day) may be missing
+};
 class RoutingAlgorithm {
     public:
-    std::array<std::vector<TripStop>, NUM_OF_REAL_TRIPS>& trips;
+    TripProfiles& tripProfiles;
     std::array<Triple<std::vector<ARouteStop>, std::vector<ARouteStop>, std::array<std::vector<ATrip>, NUM_OF_DAYS>>, NUM_OF_ALGO_ROUTES>& Aroutes;
     std::array<AStop, NUM_OF_STOPS>& Astops;
+    FootpathGraph& footpathGraph;
     std::array<StopData, NUM_OF_STOPS>& stopsData;
-    std::unordered_map<std::string, std::vector<int>>& geohashStops;
+    StopCoords& stopCoords;
     std::array< MyTrip,NUM_OF_REAL_TRIPS>& tripsData;
+    // stats of the query that is currently running, null when the caller didnt ask for them
+    QueryStats* queryStats = nullptr;
+    RoundStats* roundStats = nullptr;
+    bool verbose = true; // progress prints of the search, load tools turn them off
+    const DelaySnapshot* delays = nullptr; // real time delays of the timetable, pinned for the query (DelayPin), null = the schedule as is
+    const DelayTable* delayTable = nullptr; // predicted delays for SAFEST_JOURNEY
+    const TransferPatterns* transferPatterns = nullptr; // precomputed hub to hub journeys, null = always search
+    JourneyCache* journeyCache = nullptr; // the journeys of recent queries, shared with other searches, null = always search
+    const StreetNetwork* streets = nullptr; // the walks from and to the query locations go over its streets, null = straight line
+    // the search over the streets, one per thread and kept by the caller across its queries (a RAPTOR per query
+    // would allocate the arrays of the whole graph every time), null = this RAPTOR makes its own
+    PedestrianSearch* streetSearch = nullptr;
+    uint64_t journeyCacheGeneration = 0; // the timetable version and delays this search reads, see TimetableGuard::generation
     RoutingAlgorithm(
-         std::array<std::vector<TripStop>, NUM_OF_REAL_TRIPS>& trips_,
+         TripProfiles& tripProfiles_,
          std::array<Triple<std::vector<ARouteStop>, std::vector<ARouteStop>, std::array<std::vector<ATrip>, NUM_OF_DAYS>>, NUM_OF_ALGO_ROUTES>& Aroutes_,
          std::array<AStop, NUM_OF_STOPS>& Astops_,
+         FootpathGraph& footpathGraph_,
          std::array<StopData, NUM_OF_STOPS>& stopsData_,
-         std::unordered_map<std::string, std::vector<int>>& geohashStops_,
+         StopCoords& stopCoords_,
          std::array< MyTrip,NUM_OF_REAL_TRIPS>& tripsData_
-    ) : trips(trips_), Aroutes(Aroutes_), Astops(Astops_), stopsData(stopsData_), geohashStops(geohashStops_) ,tripsData(tripsData_) {}
+    ) : tripProfiles(tripProfiles_), Aroutes(Aroutes_), Astops(Astops_), footpathGraph(footpathGraph_), stopsData(stopsData_), stopCoords(stopCoords_) ,tripsData(tripsData_) {}
     int arrTimeToStopViaTrip(int tripId,int stopSeqIndex);
+    int depTimeFromStopViaTrip(int tripId,int stopSeqIndex);
     int earliestTrip(int routeId,int stopSeqIndex,int bestArrivalTimeToStopInPrevRound,const Time& curTime);
+    int earliestDelayedTrip(const RouteDelays& routeDelays,int stopSeqIndex,int bestArrivalTimeToStopInPrevRound,const Time& curTime);
 
     virtual JourneysToDest run(StopLocation startStop,StopLocation endStop,Time curTime) = 0; // Pure virtual function
     int findStopSeq(int routeId,int stopId) ;
@@ -91,13 +168,14 @@ class RoutingAlgorithm {
 class RAPTOR : public RoutingAlgorithm {
 public:
     RAPTOR(
-        std::array<std::vector<TripStop>, NUM_OF_REAL_TRIPS>& trips_,
+        TripProfiles& tripProfiles_,
         std::array<Triple<std::vector<ARouteStop>, std::vector<ARouteStop>, std::array<std::vector<ATrip>, NUM_OF_DAYS>>, NUM_OF_ALGO_ROUTES>& Aroutes_,
         std::array<AStop, NUM_OF_STOPS>& Astops_,
+        FootpathGraph& footpathGraph_,
         std::array<StopData, NUM_OF_STOPS>& stopsData_,
-        std::unordered_map<std::string, std::vector<int>>& geohashStops_,
+        StopCoords& stopCoords_,
         std::array< MyTrip,NUM_OF_REAL_TRIPS>& tripsData_
-    ) : RoutingAlgorithm(trips_, Aroutes_, Astops_, stopsData_, geohashStops_,tripsData_) {}
+    ) : RoutingAlgorithm(tripProfiles_, Aroutes_, Astops_, footpathGraph_, stopsData_, stopCoords_,tripsData_) {}
     // check if current trip is better than other in the
     ~RAPTOR() override = default; // Virtual destructor
     JourneysToDest convert_to_journeys_output(RoundBasedParetoSet& round_pareto_set);
@@ -110,6 +188,8 @@ public:
 
 
     JourneysToDest run(StopLocation startStop, StopLocation endStop, Time curTime) override;
+    // same as run but can also return the per round search statistics next to the journeys
+    QueryResult query(StopLocation startStop, StopLocation endStop, Time curTime, const QueryOptions& options = {});
     bool updateStopWithPruning(
         ArrivalTimeMap& best_arr_time_map,
         RoundBasedParetoSet& round_pareto_set,
@@ -121,8 +201,29 @@ public:
         int boarding_stop_seq_index,
         int cur_round);
     std::vector<Footpath> getFootpathsFromStop(StopLocation stop);
+
+    // query() in three steps for InterleavedRunner: beginQuery sets up the options and returns true when the transfer
+    // patterns already answered, searchSteps is the search and finishQuery fills in the stats and the partial flag
+    bool beginQuery(StopLocation startStop, StopLocation endStop, Time curTime, const QueryOptions& options, QueryResult& result);
+    SearchTask searchSteps(StopLocation startStop, StopLocation endStop, Time curTime, bool nextDay = false);
+    void finishQuery(QueryResult& result);
+    bool interleaved = false; // searchSteps stops at its prefetch points to let the other queries of the thread run
 private:
 
+    JourneysToDest search(StopLocation startStop, StopLocation endStop, Time curTime);
+    bool searchTransferPatterns(StopLocation startStop, StopLocation endStop, const Time& curTime, JourneysToDest& journeys);
+    bool searchJourneyCache(StopLocation startStop, StopLocation endStop, const Time& curTime, JourneysToDest& journeys);
+    void storeInJourneyCache(const JourneysToDest& journeys, int searchTime);
+    JourneyCacheKey journeyCacheKey{}; // of the running query
+    int cacheSearchTime = 0; // its departure time, the start of the validity of the entry it stores
+    bool storeInCache = false; // the running query missed the cache, what it finds goes in
+    std::unique_ptr<PedestrianSearch> ownStreetSearch; // without streetSearch, made by the first query that walks the streets
+    int transferReadyTime(RoundBasedParetoSet& round_pareto_set, int round, int stopId, const Time& curTime);
+    int mode = BEST_ARRIVAL_TIME; // of the query that is currently running
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // of the running query
+    bool deadlinePassed = false;
+    bool pastDeadline();
+    std::chrono::steady_clock::time_point queryStart; // for the total time in the stats
     int findMinStopId(int routeId, int markedStopId1, int Q_stopId);
     void initFootpathStoTDirect(StopLocation s, StopLocation t, ArrivalTimeMap &best_pareto_set, RoundBasedParetoSet &round_pareto_set, Time curTime);
 
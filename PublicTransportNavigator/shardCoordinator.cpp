@@ -0,0 +1,752 @@
+#include "shardCoordinator.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "geoUtil.h"
+#include "queryServer.h"
+#include "timeUtil.h"
+
+// ------------------------------ shard connections ------------------------------
+
+ShardClient::~ShardClient() {
+    if (fd >= 0) close(fd);
+}
+
+bool ShardClient::connectTo(const std::string& socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "Could not connect to shard " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    buffer.clear();
+    return true;
+}
+
+bool ShardClient::request(const std::string& socketPath, const std::vector<std::string>& lines, std::vector<std::string>& responses) {
+    responses.clear();
+    if (lines.empty()) return true;
+    std::string requests;
+    for (const std::string& line : lines) {
+        requests += line;
+        requests += '\n';
+    }
+    // a shard that was restarted closed the old connection, that is found out on the first request after it
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (fd < 0 && !connectTo(socketPath)) return false;
+        size_t sent = 0;
+        while (sent < requests.size()) {
+            ssize_t n = send(fd, requests.data() + sent, requests.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        char chunk[64 * 1024];
+        while (sent == requests.size() && responses.size() < lines.size()) {
+            size_t lineEnd = buffer.find('\n');
+            if (lineEnd != std::string::npos) {
+                responses.push_back(buffer.substr(0, lineEnd));
+                buffer.erase(0, lineEnd + 1);
+                continue;
+            }
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) break;
+            buffer.append(chunk, received);
+        }
+        if (responses.size() == lines.size()) return true;
+        // a half answered batch cant be matched to its requests anymore, the next one starts on a new connection
+        bool answeredNone = responses.empty();
+        responses.clear();
+        buffer.clear();
+        close(fd);
+        fd = -1;
+        if (!answeredNone) return false;
+    }
+    return false;
+}
+
+// ------------------------------ shard responses ------------------------------
+
+// the journeys QueryServer::journeysToJson writes, the reader knows that json and nothing more general
+static bool readJsonString(const std::string& json, size_t& pos, std::string& out) {
+    out.clear();
+    if (pos >= json.size() || json[pos] != '"') return false;
+    for (pos++; pos < json.size() && json[pos] != '"'; pos++) {
+        if (json[pos] == '\\' && pos + 1 < json.size()) pos++;
+        out += json[pos];
+    }
+    pos++;
+    return pos <= json.size();
+}
+
+static bool readLeg(const std::string& json, size_t& pos, ShardLeg& leg) {
+    if (pos >= json.size() || json[pos] != '{') return false;
+    pos++;
+    std::string key;
+    while (pos < json.size() && json[pos] != '}') {
+        if (json[pos] == ',') pos++;
+        if (!readJsonString(json, pos, key) || pos >= json.size() || json[pos] != ':') return false;
+        pos++;
+        if (key == "from" || key == "to" || key == "trip") {
+            if (!readJsonString(json, pos, key == "from" ? leg.from : key == "to" ? leg.to : leg.trip)) return false;
+        } else {
+            int value = 0;
+            auto [end, error] = std::from_chars(json.data() + pos, json.data() + json.size(), value);
+            if (error != std::errc()) return false;
+            pos = end - json.data();
+            if (key == "dep") leg.dep = value;
+            else if (key == "arr") leg.arr = value;
+        }
+    }
+    pos++;
+    return true;
+}
+
+// the journey of the response that arrives first, empty if there is none or the shard only found one on the next
+// day (its search starts over the next morning and the times start from midnight again)
+static ShardJourney bestJourney(const std::string& response, int startTime) {
+    ShardJourney best;
+    size_t pos = 0;
+    while ((pos = response.find("\"legs\":[", pos)) != std::string::npos) {
+        pos += 8;
+        ShardJourney journey;
+        ShardLeg leg;
+        while (readLeg(response, pos, leg)) {
+            journey.legs.push_back(leg);
+            if (pos < response.size() && response[pos] == ',') pos++;
+        }
+        if (!journey.legs.empty() && journey.legs.front().dep >= startTime && journey.arrTime() < best.arrTime()) {
+            best = std::move(journey);
+        }
+    }
+    return best;
+}
+
+// the legs of a segment after the ones before it: the ends of the segment were the coordinates of a border stop,
+// they get its name, and the walk from the border stop to itself is left out
+static void appendSegment(ShardJourney& journey, const ShardJourney& segment, const std::string& startName, const std::string& endName) {
+    for (ShardLeg leg : segment.legs) {
+        if (!startName.empty() && leg.from == "start stop") leg.from = startName;
+        if (!endName.empty() && leg.to == "destination stop") leg.to = endName;
+        if (leg.trip == "by foot" && (leg.from == leg.to || leg.dep == leg.arr)) continue;
+        if (!journey.legs.empty() && leg.trip != "by foot" && journey.legs.back().trip == leg.trip &&
+            journey.legs.back().to == leg.from && journey.legs.back().arr <= leg.dep && leg.dep < journey.legs.back().arr + MIN_TRANSFER_TIME * 60) {
+            // the rider stayed on the trip over the border, its two parts are one leg
+            journey.legs.back().to = leg.to;
+            journey.legs.back().arr = leg.arr;
+            continue;
+        }
+        journey.legs.push_back(std::move(leg));
+    }
+}
+
+static std::string locationArgs(StopLocation location) {
+    std::ostringstream oss;
+    oss << std::setprecision(9) << location.lat << " " << location.lon;
+    return oss.str();
+}
+
+// ------------------------------ shards and border stops ------------------------------
+
+static bool loadShardStops(Shard& shard) {
+    std::string filename = shard.dataDir + "stops.txt";
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    //  header: stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon,location_type,parent_station
+    std::string line, stopIdStr, stopCode, stopName, stopDesc, stopLatStr, stopLonStr, locationTypeStr;
+    std::getline(file, line); // Skip the header line
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        std::istringstream iss(line);
+        std::getline(iss, stopIdStr, ',');
+        std::getline(iss, stopCode, ',');
+        std::getline(iss, stopName, ',');
+        std::getline(iss, stopDesc, ',');
+        std::getline(iss, stopLatStr, ',');
+        std::getline(iss, stopLonStr, ',');
+        locationTypeStr.clear();
+        std::getline(iss, locationTypeStr, ',');
+        if (timeUtil::trim(locationTypeStr) == "1") continue; // a station, the trips stop at its platforms
+        double lat = 0, lon = 0;
+        std::from_chars(stopLatStr.data(), stopLatStr.data() + stopLatStr.size(), lat);
+        std::from_chars(stopLonStr.data(), stopLonStr.data() + stopLonStr.size(), lon);
+        int stop = static_cast<int>(shard.stops.size());
+        shard.stops.push_back({lat, lon, stopName});
+        shard.cellStops[Geohash::encodeCell(lat, lon, GEO_HASH_PRESITION)].push_back(stop);
+    }
+    return true;
+}
+
+bool ShardCoordinator::load(const std::string& configFile) {
+    std::ifstream file(configFile);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << configFile << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        line = timeUtil::trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream iss(line);
+        Shard shard;
+        if (!(iss >> shard.name >> shard.socketPath >> shard.dataDir)) {
+            std::cerr << "Bad shard line: " << line << std::endl;
+            return false;
+        }
+        if (shard.dataDir.back() != '/') shard.dataDir += '/';
+        if (!loadShardStops(shard)) return false;
+        shards.push_back(std::move(shard));
+    }
+    if (shards.empty()) {
+        std::cerr << "No shards in " << configFile << std::endl;
+        return false;
+    }
+    findBorderStops();
+    for (const Shard& shard : shards) {
+        std::cout << "shard " << shard.name << ": " << shard.stops.size() << " stops, " << shard.borderStops.size() << " border stops" << std::endl;
+    }
+    return true;
+}
+
+void ShardCoordinator::findBorderStops() {
+    // the stops of every pair of shards that are within BORDER_STOP_RADIUS, each stop with the closest one only.
+    // several stops of a can have the same closest stop in b, b keeps the nearest of them so it lists every stop once
+    for (int first = 0; first < numOfShards(); first++) {
+        for (int second = first + 1; second < numOfShards(); second++) {
+            Shard& a = shards[first];
+            Shard& b = shards[second];
+            std::unordered_map<int, std::pair<double, int>> closestInA; // stop of b -> distance, stop of a
+            for (int stop = 0; stop < static_cast<int>(a.stops.size()); stop++) {
+                int closest = -1;
+                double closestDistance = BORDER_STOP_RADIUS;
+                uint32_t cell = Geohash::encodeCell(a.stops[stop].lat, a.stops[stop].lon, GEO_HASH_PRESITION);
+                for (uint32_t neighbor : Geohash::getCellNeighbors(cell, GEO_HASH_PRESITION)) {
+                    auto box = b.cellStops.find(neighbor);
+                    if (box == b.cellStops.end()) continue;
+                    for (int other : box->second) {
+                        double distance = haversineDistance(a.stops[stop].lat, a.stops[stop].lon, b.stops[other].lat, b.stops[other].lon);
+                        if (distance <= closestDistance) {
+                            closest = other;
+                            closestDistance = distance;
+                        }
+                    }
+                }
+                if (closest == -1) continue;
+                a.borderStops.push_back({stop, second, closest});
+                auto known = closestInA.find(closest);
+                if (known == closestInA.end() || closestDistance < known->second.first) closestInA[closest] = {closestDistance, stop};
+            }
+            std::vector<BorderStop> bSide;
+            for (const auto& [stop, closest] : closestInA) bSide.push_back({stop, first, closest.second});
+            std::sort(bSide.begin(), bSide.end(), [](const BorderStop& x, const BorderStop& y) { return x.stop < y.stop; });
+            b.borderStops.insert(b.borderStops.end(), bSide.begin(), bSide.end());
+        }
+    }
+}
+
+int ShardCoordinator::numOfBorderStops() const {
+    // the border stops of all the shards, a place on a border counts once in each shard it is in
+    int borderStops = 0;
+    for (const Shard& shard : shards) borderStops += static_cast<int>(shard.borderStops.size());
+    return borderStops;
+}
+
+std::vector<int> ShardCoordinator::shardsAround(StopLocation location) const {
+    // a place near a border is in both regions: the walk to the stops of either shard is short
+    std::vector<std::pair<double, int>> closest; // distance to the closest stop, shard
+    uint32_t cell = Geohash::encodeCell(location.lat, location.lon, GEO_HASH_PRESITION);
+    std::vector<uint32_t> neighbors = Geohash::getCellNeighbors(cell, GEO_HASH_PRESITION);
+    for (int shard = 0; shard < numOfShards(); shard++) {
+        double closestDistance = MAX_WALK_DISTANCE;
+        for (uint32_t neighbor : neighbors) {
+            auto box = shards[shard].cellStops.find(neighbor);
+            if (box == shards[shard].cellStops.end()) continue;
+            for (int stop : box->second) {
+                closestDistance = std::min(closestDistance, haversineDistance(location.lat, location.lon, shards[shard].stops[stop].lat, shards[shard].stops[stop].lon));
+            }
+        }
+        if (closestDistance < MAX_WALK_DISTANCE) closest.push_back({closestDistance, shard});
+    }
+    std::sort(closest.begin(), closest.end());
+    std::vector<int> around;
+    for (const auto& [distance, shard] : closest) around.push_back(shard);
+    return around;
+}
+
+// ------------------------------ stitching ------------------------------
+
+// a ROUTE request to a shard with the mode and what is left of the deadline of the query, empty when nothing is left
+static std::string routeLine(StopLocation start, StopLocation end, int startTime, const Time& time, const QueryOptions& options) {
+    std::string line = "ROUTE " + locationArgs(start) + " " + locationArgs(end) + " " + timeUtil::convertSecondsToTime(startTime) + " " +
+                       std::to_string(time.dayInWeek) + " " + std::to_string(time.date);
+    if (options.mode == SAFEST_JOURNEY) line += " SAFEST";
+    if (options.deadline != std::chrono::steady_clock::time_point::max()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(options.deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) return "";
+        line += " DEADLINE " + std::to_string(left);
+    }
+    return line;
+}
+
+std::vector<ShardJourney> ShardCoordinator::searchShard(int shard, const std::vector<StopLocation>& starts, const std::vector<StopLocation>& ends,
+                                                        const std::vector<int>& startTimes, const Time& time, StitchedQuery& query, ShardClients& clients) {
+    std::vector<ShardJourney> journeys(starts.size());
+    std::vector<std::string> lines, responses;
+    for (size_t i = 0; i < starts.size(); i++) {
+        lines.push_back(routeLine(starts[i], ends[i], startTimes[i], time, query.options));
+        if (lines.back().empty()) {
+            // the deadline passed, the searches that are left are not sent at all
+            query.partial = true;
+            for (ShardJourney& journey : journeys) journey.partial = true;
+            return journeys;
+        }
+    }
+    stats.shardQueries += lines.size();
+    if (!clients[shard].request(shards[shard].socketPath, lines, responses)) return journeys;
+    for (size_t i = 0; i < responses.size(); i++) {
+        journeys[i] = bestJourney(responses[i], startTimes[i]);
+        journeys[i].partial = responses[i].find("\"partial\":true") != std::string::npos;
+        query.partial |= journeys[i].partial;
+    }
+    return journeys;
+}
+
+int ShardCoordinator::profileSlot(int time) {
+    // the first sample at or after the time: waiting for it at the entry never arrives earlier than leaving right away
+    return (time + SHARD_PROFILE_INTERVAL * 60 - 1) / (SHARD_PROFILE_INTERVAL * 60);
+}
+
+uint64_t ShardCoordinator::profileKey(int shard, int entryStop, int exitStop, int slot, int mode) {
+    // a SAFEST profile leaves room for the delays at its transfers, it is kept apart from the best arrival one
+    return (static_cast<uint64_t>(shard) << 56) | (static_cast<uint64_t>(entryStop) << 34) | (static_cast<uint64_t>(exitStop) << 12) |
+           (static_cast<uint64_t>(mode == SAFEST_JOURNEY) << 11) | static_cast<uint64_t>(slot);
+}
+
+void ShardCoordinator::fillProfiles(int shard, const std::vector<std::pair<int, int>>& pairs, const std::vector<int>& slots, const Time& day,
+                                    StitchedQuery& query, ShardClients& clients) {
+    // the missing samples of all the pairs go to the shard as one batch
+    std::vector<StopLocation> starts, ends;
+    std::vector<int> startTimes;
+    std::vector<uint64_t> keys;
+    {
+        std::lock_guard<std::mutex> lock(profilesMutex);
+        if (profilesDate != day.date || profiles.size() > SHARD_PROFILE_CACHE_MAX) {
+            profiles.clear();
+            profilesDate = day.date;
+        }
+        for (size_t i = 0; i < pairs.size(); i++) {
+            uint64_t key = profileKey(shard, pairs[i].first, pairs[i].second, slots[i], query.options.mode);
+            if (profiles.contains(key) || std::find(keys.begin(), keys.end(), key) != keys.end()) continue;
+            const ShardStop& entry = shards[shard].stops[pairs[i].first];
+            const ShardStop& exit = shards[shard].stops[pairs[i].second];
+            starts.push_back({entry.lat, entry.lon});
+            ends.push_back({exit.lat, exit.lon});
+            startTimes.push_back(slots[i] * SHARD_PROFILE_INTERVAL * 60);
+            keys.push_back(key);
+        }
+    }
+    if (keys.empty()) return;
+    stats.profileSearches += keys.size();
+    std::vector<ShardJourney> journeys = searchShard(shard, starts, ends, startTimes, day, query, clients);
+    std::lock_guard<std::mutex> lock(profilesMutex);
+    if (profilesDate != day.date) return; // another date took over the cache meanwhile
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (journeys[i].partial) continue; // cut short, the next query searches the sample again
+        profiles[keys[i]] = journeys[i].arrTime();
+    }
+}
+
+int ShardCoordinator::profileArrival(int shard, int entryStop, int exitStop, int time, const Time& day, StitchedQuery& query, ShardClients& clients) {
+    int slot = profileSlot(time);
+    uint64_t key = profileKey(shard, entryStop, exitStop, slot, query.options.mode);
+    {
+        std::lock_guard<std::mutex> lock(profilesMutex);
+        if (profilesDate == day.date) {
+            auto profile = profiles.find(key);
+            if (profile != profiles.end()) return profile->second;
+        }
+    }
+    fillProfiles(shard, {{entryStop, exitStop}}, {slot}, day, query, clients);
+    std::lock_guard<std::mutex> lock(profilesMutex);
+    auto profile = profiles.find(key);
+    return profile == profiles.end() ? std::numeric_limits<int>::max() : profile->second;
+}
+
+std::vector<ShardJourney> ShardCoordinator::continueSegments(int shard, const std::vector<StopLocation>& starts, const std::vector<StopLocation>& ends,
+                                                             const std::vector<int>& arrivals, const std::vector<const ShardJourney*>& before,
+                                                             const Time& time, StitchedQuery& query, ShardClients& clients) {
+    // the search is MIN_TRANSFER_TIME early so it can board the trip it arrived with, the part of the same trip in this
+    // shard leaves the border stop when the other part arrives there (after its dwell). a journey that boards another trip
+    // is kept when it still has the transfer time after the arrival and the walk to its first trip (the walk legs move to the
+    // arrival), the ones that dont are searched again from the arrival
+    const int shift = MIN_TRANSFER_TIME * 60;
+    std::vector<int> early(arrivals.size());
+    for (size_t i = 0; i < arrivals.size(); i++) early[i] = arrivals[i] - shift;
+    std::vector<ShardJourney> journeys = searchShard(shard, starts, ends, early, time, query, clients);
+    std::vector<size_t> again;
+    for (size_t i = 0; i < journeys.size(); i++) {
+        std::vector<ShardLeg>& legs = journeys[i].legs;
+        if (legs.empty()) continue;
+        auto firstTrip = std::find_if(legs.begin(), legs.end(), [](const ShardLeg& leg) { return leg.trip != "by foot"; });
+        auto lastTrip = std::find_if(before[i]->legs.rbegin(), before[i]->legs.rend(), [](const ShardLeg& leg) { return leg.trip != "by foot"; });
+        bool seated = firstTrip == legs.begin() + 1 && legs.front().dep == legs.front().arr && lastTrip != before[i]->legs.rend() &&
+                      lastTrip->trip == firstTrip->trip && lastTrip->arr <= firstTrip->dep;
+        if (seated) {
+            legs.front().dep = legs.front().arr = arrivals[i];
+            continue;
+        }
+        int walk = 0;
+        for (auto leg = legs.begin(); leg != firstTrip; leg++) walk += leg->arr - leg->dep;
+        if (firstTrip != legs.end() && firstTrip->dep < arrivals[i] + shift + walk) {
+            again.push_back(i);
+            continue;
+        }
+        // walking only or the transfer fits: the walk legs start at the arrival
+        int at = arrivals[i];
+        for (auto leg = legs.begin(); leg != firstTrip; leg++) {
+            leg->arr = at + leg->arr - leg->dep;
+            leg->dep = at;
+            at = leg->arr;
+        }
+    }
+    if (again.empty()) return journeys;
+    std::vector<StopLocation> againStarts, againEnds;
+    std::vector<int> againTimes;
+    for (size_t i : again) {
+        againStarts.push_back(starts[i]);
+        againEnds.push_back(ends[i]);
+        againTimes.push_back(arrivals[i]);
+    }
+    std::vector<ShardJourney> retried = searchShard(shard, againStarts, againEnds, againTimes, time, query, clients);
+    for (size_t i = 0; i < again.size(); i++) journeys[again[i]] = std::move(retried[i]);
+    return journeys;
+}
+
+ShardJourney ShardCoordinator::stitch(int from, int to, StopLocation start, StopLocation end, const Time& time, StitchedQuery& query,
+                                      ShardClients& clients, std::vector<std::string>& chain) {
+    auto bordersTo = [&](int shard, int other) {
+        std::vector<BorderStop> borderStops;
+        for (const BorderStop& borderStop : shards[shard].borderStops) {
+            if (borderStop.otherShard == other) borderStops.push_back(borderStop);
+        }
+        return borderStops;
+    };
+    auto locationOf = [&](int shard, int stop) { return StopLocation{shards[shard].stops[stop].lat, shards[shard].stops[stop].lon}; };
+    // the border stops of the first shard it reaches, the earliest first, are the candidates to cross at
+    auto firstSegment = [&](const std::vector<BorderStop>& exits, std::vector<ShardJourney>& journeys) {
+        std::vector<StopLocation> starts(exits.size(), start), ends;
+        for (const BorderStop& exit : exits) ends.push_back(locationOf(from, exit.stop));
+        journeys = searchShard(from, starts, ends, std::vector<int>(exits.size(), time.curHourInSeconds), time, query, clients);
+        std::vector<int> candidates(exits.size());
+        std::iota(candidates.begin(), candidates.end(), 0);
+        std::erase_if(candidates, [&](int i) { return journeys[i].legs.empty(); });
+        std::sort(candidates.begin(), candidates.end(), [&](int a, int b) { return journeys[a].arrTime() < journeys[b].arrTime(); });
+        return candidates;
+    };
+
+    ShardJourney best;
+    std::vector<BorderStop> direct = bordersTo(from, to);
+    if (!direct.empty()) {
+        std::vector<ShardJourney> firsts;
+        std::vector<int> candidates = firstSegment(direct, firsts);
+        for (size_t next = 0; next < candidates.size() && firsts[candidates[next]].arrTime() < best.arrTime(); next += SHARD_BORDER_CANDIDATES) {
+            std::vector<int> batch(candidates.begin() + next, candidates.begin() + std::min(candidates.size(), next + SHARD_BORDER_CANDIDATES));
+            std::erase_if(batch, [&](int i) { return firsts[i].arrTime() >= best.arrTime(); });
+            std::vector<StopLocation> starts, ends(batch.size(), end);
+            std::vector<int> arrivals;
+            std::vector<const ShardJourney*> before;
+            for (int i : batch) {
+                starts.push_back(locationOf(to, direct[i].otherStop));
+                arrivals.push_back(firsts[i].arrTime());
+                before.push_back(&firsts[i]);
+            }
+            std::vector<ShardJourney> lasts = continueSegments(to, starts, ends, arrivals, before, time, query, clients);
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (lasts[i].arrTime() >= best.arrTime()) continue;
+                const std::string& borderName = shards[from].stops[direct[batch[i]].stop].name;
+                best = {};
+                appendSegment(best, firsts[batch[i]], "", borderName);
+                appendSegment(best, lasts[i], borderName, "");
+                chain = {shards[from].name, shards[to].name};
+            }
+        }
+    }
+    for (int middle = 0; SHARD_MAX_CHAIN >= 3 && middle < numOfShards(); middle++) {
+        if (middle == from || middle == to) continue;
+        std::vector<BorderStop> entries = bordersTo(from, middle);
+        std::vector<BorderStop> exits = bordersTo(middle, to);
+        if (entries.empty() || exits.empty()) continue;
+        std::vector<ShardJourney> firsts;
+        std::vector<int> candidates = firstSegment(entries, firsts);
+        std::erase_if(candidates, [&](int i) { return firsts[i].arrTime() >= best.arrTime(); });
+        if (candidates.size() > SHARD_BORDER_CANDIDATES) candidates.resize(SHARD_BORDER_CANDIDATES);
+        if (candidates.empty()) continue;
+        // every exit of the middle shard from the best of the entries, all the missing profile samples in one batch
+        std::vector<std::pair<int, int>> pairs;
+        std::vector<int> slots;
+        for (const BorderStop& exit : exits) {
+            for (int i : candidates) {
+                pairs.push_back({entries[i].otherStop, exit.stop});
+                slots.push_back(profileSlot(firsts[i].arrTime()));
+            }
+        }
+        fillProfiles(middle, pairs, slots, time, query, clients);
+        std::vector<int> exitArrivals(exits.size(), std::numeric_limits<int>::max()), exitEntries(exits.size(), -1);
+        for (size_t exit = 0; exit < exits.size(); exit++) {
+            for (int i : candidates) {
+                int arrival = profileArrival(middle, entries[i].otherStop, exits[exit].stop, firsts[i].arrTime(), time, query, clients);
+                if (arrival < exitArrivals[exit]) {
+                    exitArrivals[exit] = arrival;
+                    exitEntries[exit] = i;
+                }
+            }
+        }
+        std::vector<int> exitCandidates(exits.size());
+        std::iota(exitCandidates.begin(), exitCandidates.end(), 0);
+        std::erase_if(exitCandidates, [&](int exit) { return exitEntries[exit] == -1; });
+        std::sort(exitCandidates.begin(), exitCandidates.end(), [&](int a, int b) { return exitArrivals[a] < exitArrivals[b]; });
+        for (size_t next = 0; next < exitCandidates.size() && exitArrivals[exitCandidates[next]] < best.arrTime(); next += SHARD_BORDER_CANDIDATES) {
+            std::vector<int> batch(exitCandidates.begin() + next, exitCandidates.begin() + std::min(exitCandidates.size(), next + SHARD_BORDER_CANDIDATES));
+            std::erase_if(batch, [&](int exit) { return exitArrivals[exit] >= best.arrTime(); });
+            // the profile arrival already has the transfer in it, the last segment leaves the exit from there
+            std::vector<StopLocation> starts, ends(batch.size(), end);
+            std::vector<int> departures;
+            for (int exit : batch) {
+                starts.push_back(locationOf(to, exits[exit].otherStop));
+                departures.push_back(exitArrivals[exit]);
+            }
+            std::vector<ShardJourney> lasts = searchShard(to, starts, ends, departures, time, query, clients);
+            int bestExit = -1;
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (lasts[i].arrTime() < best.arrTime() && (bestExit == -1 || lasts[i].arrTime() < lasts[bestExit].arrTime())) bestExit = static_cast<int>(i);
+            }
+            if (bestExit == -1) continue;
+            // the middle legs are searched again for the one pair that won, the profile only had its arrival
+            int entry = exitEntries[batch[bestExit]];
+            const BorderStop& exit = exits[batch[bestExit]];
+            std::vector<ShardJourney> middles = continueSegments(middle, {locationOf(middle, entries[entry].otherStop)}, {locationOf(middle, exit.stop)},
+                                                                 {firsts[entry].arrTime()}, {&firsts[entry]}, time, query, clients);
+            if (middles[0].legs.empty() || middles[0].arrTime() > departures[bestExit]) continue;
+            const std::string& entryName = shards[middle].stops[entries[entry].otherStop].name;
+            const std::string& exitName = shards[middle].stops[exit.stop].name;
+            best = {};
+            appendSegment(best, firsts[entry], "", entryName);
+            appendSegment(best, middles[0], entryName, exitName);
+            appendSegment(best, lasts[bestExit], exitName, "");
+            chain = {shards[from].name, shards[middle].name, shards[to].name};
+        }
+    }
+    return best;
+}
+
+std::string ShardCoordinator::route(StopLocation start, StopLocation end, const Time& time, StitchedQuery& query, ShardClients& clients) {
+    auto searchStart = std::chrono::steady_clock::now();
+    std::vector<int> startShards = shardsAround(start);
+    std::vector<int> endShards = shardsAround(end);
+    if (startShards.empty() || endShards.empty()) {
+        stats.errors++;
+        return "{\"error\":\"no shard around the start or the end\"}";
+    }
+    // every pair of a shard around the start and one around the end: inside one shard the request goes to it as is
+    // and its response is the answer if it arrives first, across shards the searches are stitched
+    ShardJourney best;
+    std::string bestResponse;
+    std::vector<std::string> bestChain;
+    for (int from : startShards) {
+        for (int to : endShards) {
+            if (from == to) {
+                std::string request = routeLine(start, end, time.curHourInSeconds, time, query.options);
+                std::vector<std::string> responses;
+                if (request.empty()) {
+                    query.partial = true;
+                    continue;
+                }
+                if (!clients[from].request(shards[from].socketPath, {request}, responses)) continue;
+                ShardJourney journey = bestJourney(responses[0], time.curHourInSeconds);
+                if ((bestResponse.empty() && best.legs.empty()) || journey.arrTime() < best.arrTime()) {
+                    best = std::move(journey);
+                    bestResponse = std::move(responses[0]);
+                }
+                continue;
+            }
+            std::vector<std::string> chain;
+            ShardJourney journey = stitch(from, to, start, end, time, query, clients, chain);
+            if (journey.arrTime() < best.arrTime()) {
+                best = std::move(journey);
+                bestResponse.clear();
+                bestChain = std::move(chain);
+            }
+        }
+    }
+    if (!bestResponse.empty()) {
+        stats.forwarded++;
+        if (query.partial && bestResponse.find("\"partial\":true") == std::string::npos) {
+            bestResponse.insert(1, "\"partial\":true,"); // a stitched search that could have arrived earlier was cut short
+        }
+        return bestResponse;
+    }
+    stats.stitched++;
+
+    long long searchMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - searchStart).count();
+    std::string out = "{\"search_us\":" + std::to_string(searchMicros) + (query.partial ? ",\"partial\":true" : "") + ",\"shards\":[";
+    for (size_t i = 0; i < bestChain.size(); i++) {
+        if (i) out += ",";
+        appendJsonString(out, bestChain[i]);
+    }
+    out += "],\"journeys\":[";
+    if (!best.legs.empty()) {
+        int trips = static_cast<int>(std::count_if(best.legs.begin(), best.legs.end(), [](const ShardLeg& leg) { return leg.trip != "by foot"; }));
+        out += "{\"transfers\":" + std::to_string(std::max(0, trips - 1)) + ",\"legs\":[";
+        for (size_t i = 0; i < best.legs.size(); i++) {
+            const ShardLeg& leg = best.legs[i];
+            out += i ? ",{\"from\":" : "{\"from\":";
+            appendJsonString(out, leg.from);
+            out += ",\"to\":";
+            appendJsonString(out, leg.to);
+            out += ",\"trip\":";
+            appendJsonString(out, leg.trip);
+            out += ",\"dep\":" + std::to_string(leg.dep) + ",\"arr\":" + std::to_string(leg.arr) + "}";
+        }
+        out += "]}";
+    }
+    out += "]}";
+    return out;
+}
+
+// ------------------------------ server ------------------------------
+
+std::string ShardCoordinator::statsJson() {
+    std::ostringstream oss;
+    oss << "{\"shards\":" << numOfShards()
+        << ",\"border_stops\":" << numOfBorderStops()
+        << ",\"requests\":" << stats.requests.load()
+        << ",\"errors\":" << stats.errors.load()
+        << ",\"forwarded\":" << stats.forwarded.load()
+        << ",\"stitched\":" << stats.stitched.load()
+        << ",\"shard_queries\":" << stats.shardQueries.load()
+        << ",\"profile_searches\":" << stats.profileSearches.load();
+    {
+        std::lock_guard<std::mutex> lock(profilesMutex);
+        oss << ",\"profile_entries\":" << profiles.size() << "}";
+    }
+    return oss.str();
+}
+
+std::string ShardCoordinator::dispatch(const std::string& request, ShardClients& clients) {
+    std::istringstream iss(request);
+    std::string command;
+    iss >> command;
+    stats.requests++;
+    if (command == "STATS") {
+        return statsJson();
+    }
+    if (command == "HEALTH" || command == "RELOAD") {
+        std::string out = "{\"shards\":[";
+        for (int shard = 0; shard < numOfShards(); shard++) {
+            std::vector<std::string> responses;
+            out += shard ? ",{\"name\":" : "{\"name\":";
+            appendJsonString(out, shards[shard].name);
+            out += ",\"response\":";
+            out += clients[shard].request(shards[shard].socketPath, {request}, responses) ? responses[0] : "{\"error\":\"shard is down\"}";
+            out += "}";
+        }
+        return out + "]}";
+    }
+    StopLocation startStop{}, endStop{};
+    std::string timeStr;
+    Time time{};
+    if (command != "ROUTE" || !(iss >> startStop.lat >> startStop.lon >> endStop.lat >> endStop.lon >> timeStr >> time.dayInWeek >> time.date) ||
+        !timeUtil::parseTime(timeStr, time.curHourInSeconds) || time.dayInWeek < 1 || time.dayInWeek > NUM_OF_DAYS) {
+        // BOARD and DELAY too: the stop ids and stop sequences are the ones of each shard, they go to the shard directly
+        stats.errors++;
+        return "{\"error\":\"bad request\"}";
+    }
+    StitchedQuery query;
+    readRouteOptions(iss, deadline, query.options);
+    return route(startStop, endStop, time, query, clients);
+}
+
+void ShardCoordinator::handleConnection(int clientFd) {
+    ShardClients clients(shards.size());
+    std::string buffer;
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t received = recv(clientFd, chunk, sizeof(chunk), 0);
+        if (received <= 0) break;
+        buffer.append(chunk, received);
+        // a stitched query already sends its searches to the shards in batches, the requests of a line batch run one by one
+        std::string responses;
+        size_t lineStart = 0, lineEnd;
+        while ((lineEnd = buffer.find('\n', lineStart)) != std::string::npos) {
+            std::string request = timeUtil::trim(buffer.substr(lineStart, lineEnd - lineStart));
+            if (!request.empty()) {
+                responses += dispatch(request, clients);
+                responses += '\n';
+            }
+            lineStart = lineEnd + 1;
+        }
+        buffer.erase(0, lineStart);
+        size_t sent = 0;
+        while (sent < responses.size()) {
+            ssize_t n = send(clientFd, responses.data() + sent, responses.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        if (sent < responses.size()) break;
+    }
+    close(clientFd);
+}
+
+bool ShardCoordinator::listenUnix(const std::string& socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socketPath.c_str()); // a leftover socket file from a previous run
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 128) < 0) {
+        std::cerr << "Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void ShardCoordinator::serve() {
+    while (true) {
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) continue;
+        std::thread(&ShardCoordinator::handleConnection, this, clientFd).detach();
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "routingAlgorithm.h"
+
+// the timetable split into regional shards (see tools/feedSplitter): every shard is a "main --serve" process with
+// the timetable of its own region only, and the coordinator is a server in front of them that speaks the same
+// protocol (ROUTE, HEALTH, STATS). a ROUTE that starts and ends in one region goes to that shard as is, a
+// ROUTE across regions is a search per shard stitched at the border stops - the stops that are in the feeds of
+// two shards at the same place. every pair of shards near the start and the end is tried (a route near the border
+// can be faster through the neighbour region), and a rider can stay on a trip whose two parts meet at a border stop.
+// a chain of shards is at most SHARD_MAX_CHAIN long, the middle shard of a chain of 3 is crossed with its border
+// to border profiles: the earliest arrival at every exit border stop when leaving an entry border stop at every
+// SHARD_PROFILE_INTERVAL of the day, searched by the shard on first use and kept for the date.
+// the border stops are searched on in the order they are reached, SHARD_BORDER_CANDIDATES at a time, until the best
+// journey arrives before the next one is reached: nothing over a border stop arrives before the rider gets there. only
+// the entries of a middle shard stay at the SHARD_BORDER_CANDIDATES reached first, every one of them costs a profile per exit.
+// every shard search of a ROUTE has its mode (SAFEST) and what is left of its deadline (--deadline-ms of the
+// coordinator or DEADLINE of the request), a ROUTE that ran out answers with what it stitched so far and "partial":true.
+// config file, one shard per line: <name> <unix socket of the shard> <feed dir of the shard>
+#define BORDER_STOP_RADIUS 30 // meters, stops of two shards that close to each other are the same border stop
+#define SHARD_MAX_CHAIN 3
+#define SHARD_BORDER_CANDIDATES 8 // border stops searched on in one batch to the shard, the earliest reached first
+#define SHARD_PROFILE_INTERVAL 15 // minutes
+#define SHARD_PROFILE_CACHE_MAX (1 << 20) // profile entries, the cache starts over past it
+
+struct ShardLeg {
+    std::string from, to, trip;
+    int dep, arr;
+};
+struct ShardJourney {
+    std::vector<ShardLeg> legs; // empty = no journey
+    bool partial = false; // the shard search was cut short by the deadline
+    int arrTime() const { return legs.empty() ? std::numeric_limits<int>::max() : legs.back().arr; }
+};
+
+struct ShardStop {
+    double lat, lon;
+    std::string name;
+};
+struct BorderStop {
+    int stop; // in the stops of this shard
+    int otherShard;
+    int otherStop; // the same place in the stops of otherShard
+};
+struct Shard {
+    std::string name, socketPath, dataDir;
+    std::vector<ShardStop> stops;
+    std::unordered_map<uint32_t, std::vector<int>> cellStops; // geohash box -> stops, like StopCoords::cellStops
+    std::vector<BorderStop> borderStops;
+};
+
+// one connection to a shard, the requests of a batch are pipelined and the responses come back in order
+class ShardClient {
+public:
+    ShardClient() = default;
+    ShardClient(const ShardClient&) = delete;
+    ShardClient& operator=(const ShardClient&) = delete;
+    ~ShardClient();
+    bool request(const std::string& socketPath, const std::vector<std::string>& lines, std::vector<std::string>& responses);
+private:
+    bool connectTo(const std::string& socketPath);
+    int fd = -1;
+    std::string buffer;
+};
+
+struct CoordinatorStats {
+    std::atomic<long long> requests{0};
+    std::atomic<long long> errors{0};
+    std::atomic<long long> forwarded{0}; // inside one shard
+    std::atomic<long long> stitched{0}; // across shards
+    std::atomic<long long> shardQueries{0}; // searches the shards ran for the stitched ones
+    std::atomic<long long> profileSearches{0};
+};
+
+// one ROUTE through the coordinator, the options go to every shard search of it
+struct StitchedQuery {
+    QueryOptions options;
+    bool partial = false; // a shard search was cut short or not sent at all because of the deadline
+};
+
+class ShardCoordinator {
+public:
+    explicit ShardCoordinator(int deadlineMillis = 0) : deadline(deadlineMillis) {}
+    bool load(const std::string& configFile); // the shards and their border stops
+    bool listenUnix(const std::string& socketPath);
+    void serve(); // the accept loop, one thread per connection
+    int numOfShards() const { return static_cast<int>(shards.size()); }
+    int numOfBorderStops() const;
+private:
+    // the connections of one client connection, one per shard
+    typedef std::vector<ShardClient> ShardClients;
+    void handleConnection(int clientFd);
+    std::string dispatch(const std::string& request, ShardClients& clients);
+    std::string route(StopLocation start, StopLocation end, const Time& time, StitchedQuery& query, ShardClients& clients);
+    std::string statsJson();
+    std::vector<int> shardsAround(StopLocation location) const; // the shards with a stop in walking distance, closest first
+    // the earliest journey from start to end that crosses from the region of one shard to the other, its shards in chain
+    ShardJourney stitch(int from, int to, StopLocation start, StopLocation end, const Time& time, StitchedQuery& query, ShardClients& clients,
+                        std::vector<std::string>& chain);
+    void findBorderStops();
+    // one search per target, the best arrival journey of each (empty when the shard found none that day)
+    std::vector<ShardJourney> searchShard(int shard, const std::vector<StopLocation>& starts, const std::vector<StopLocation>& ends,
+                                          const std::vector<int>& startTimes, const Time& time, StitchedQuery& query, ShardClients& clients);
+    // the next segment of each journey in before, from the border stops it arrived at
+    std::vector<ShardJourney> continueSegments(int shard, const std::vector<StopLocation>& starts, const std::vector<StopLocation>& ends,
+                                               const std::vector<int>& arrivals, const std::vector<const ShardJourney*>& before,
+                                               const Time& time, StitchedQuery& query, ShardClients& clients);
+    // earliest arrival at the exit border stop of the middle shard, from the profile
+    int profileArrival(int shard, int entryStop, int exitStop, int time, const Time& day, StitchedQuery& query, ShardClients& clients);
+    void fillProfiles(int shard, const std::vector<std::pair<int, int>>& pairs, const std::vector<int>& slots, const Time& day,
+                      StitchedQuery& query, ShardClients& clients);
+    static int profileSlot(int time);
+    static uint64_t profileKey(int shard, int entryStop, int exitStop, int slot, int mode);
+
+    std::vector<Shard> shards;
+    std::mutex profilesMutex;
+    int profilesDate = 0;
+    std::unordered_map<uint64_t, int> profiles; // arrival, max = the exit cant be reached
+    CoordinatorStats stats;
+    std::chrono::milliseconds deadline; // 0 = none
+    int listenFd = -1;
+};
+
+#endif //SHARDCOORDINATOR_H
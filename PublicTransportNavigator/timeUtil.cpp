@@ -43,6 +43,24 @@ int timeUtil::calcTimeInSeconds(std::string time) {
     int total_seconds = hours * 3600 + minutes * 60 + seconds;
     return total_seconds;
 }
+bool timeUtil::parseTime(std::string_view time, int& seconds) {
+    while (!time.empty() && (time.front() == ' ' || time.front() == '\t')) time.remove_prefix(1);
+    while (!time.empty() && (time.back() == ' ' || time.back() == '\t' || time.back() == '\r')) time.remove_suffix(1);
+    size_t pos1 = time.find(':'), pos2 = time.rfind(':');
+    if (pos1 == std::string_view::npos || pos1 == pos2) return false;
+    // every part a whole number and nothing else
+    auto parsePart = [](std::string_view part, int& value) {
+        return !part.empty() && std::from_chars(part.data(), part.data() + part.size(), value).ptr == part.data() + part.size();
+    };
+    int hours, minutes, secs;
+    if (!parsePart(time.substr(0, pos1), hours) || !parsePart(time.substr(pos1 + 1, pos2 - pos1 - 1), minutes) ||
+        !parsePart(time.substr(pos2 + 1), secs)) {
+        return false;
+    }
+    if (hours < 0 || minutes < 0 || minutes >= 60 || secs < 0 || secs >= 60) return false;
+    seconds = hours * 3600 + minutes * 60 + secs;
+    return true;
+}
 std::string timeUtil::trim(const std::string& str) {
     size_t start = str.find_first_not_of(" \t\n\r");
     if (start == std::string::npos)
@@ -7,12 +7,16 @@
 #include <charconv>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 
 
 class timeUtil {
 public:
     static std::string trim(const std::string& str);
     static int calcTimeInSeconds(std::string time);
+    // HH:MM:SS from input that can be wrong (requests, query files): false instead of a made up time,
+    // the hours can go past 24 like in gtfs
+    static bool parseTime(std::string_view time, int& seconds);
     static std::string convertSecondsToTime(int total_seconds) ;
 };
 
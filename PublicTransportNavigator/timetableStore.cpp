@@ -0,0 +1,198 @@
+#include "timetableStore.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// ------------------------------ readers ------------------------------
+
+TimetableGuard::TimetableGuard(TimetableStore& store_) : store(store_), version(nullptr) {
+    slot = store.readers.pin(store.current, version);
+    delayPin.emplace(*version->delays);
+}
+
+TimetableGuard::~TimetableGuard() {
+    delayPin.reset();
+    // once the slot is empty a reclaim can free the version, so nothing of it is read after that
+    const bool retired = version->retired.load();
+    store.readers.unpin(slot);
+    // we might have been the last reader of a replaced version. a swap between the two lines above had its reclaim
+    // see our slot still taken, current has moved on then (only the pointers are compared)
+    if (retired || store.current.load() != version) {
+        store.reclaim();
+    }
+}
+
+// ------------------------------ writers ------------------------------
+
+TimetableStore::~TimetableStore() {
+    {
+        std::lock_guard<std::mutex> lock(reloadMutex);
+        stopping = true;
+    }
+    reloadWakeup.notify_all();
+    if (reloader.joinable()) {
+        reloader.join();
+    }
+    if (delayFeeder.joinable()) {
+        delayFeeder.join();
+    }
+}
+
+std::filesystem::file_time_type TimetableStore::newestFeedTime() const {
+    std::filesystem::file_time_type newest = std::filesystem::file_time_type::min(); // not {}, the file clock epoch can be in the future
+    for (const char* file : {"stop_times.txt", "trips.txt", "routes.txt", "stops.txt", "calendar.txt", "frequencies.txt"}) {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(options.dataDir + file, error);
+        if (!error && modified > newest) newest = modified;
+    }
+    return newest;
+}
+
+std::unique_ptr<TimetableVersion> TimetableStore::build() {
+    auto next = std::make_unique<TimetableVersion>();
+    next->feedTime = newestFeedTime();
+    // the previous version is only replaced by publish(), which runs after the build on this same thread
+    const Preprocess* previous = owned ? dynamic_cast<const Preprocess*>(owned->timetable.get()) : nullptr;
+    if (options.incrementalUpdates && !options.localityOrder && previous) { // renumbered ids cant be patched
+        auto patched = std::make_unique<Preprocess>(options);
+        if (patched->processIncremental(*previous)) {
+            next->timetable = std::move(patched);
+        } else {
+            std::cout << "incremental update not possible, rebuilding the timetable from scratch" << std::endl;
+        }
+    }
+    if (!next->timetable) {
+        next->timetable = std::make_unique<Preprocess>(options);
+        next->timetable->process();
+    }
+    // the overlay and the delay table are per version, both map the trips of this timetable
+    next->delays = std::make_unique<DelayOverlay>(*next->timetable);
+    if (!options.delayTableFile.empty()) {
+        next->delayTable = std::make_unique<DelayTable>();
+        if (!next->delayTable->load(options.delayTableFile, *next->timetable)) {
+            next->delayTable.reset(); // SAFEST_JOURNEY queries then get the best arrival time
+        }
+    }
+    // the patterns are kept by gtfs stop id, every version resolves them against its own stops and routes
+    if (!options.transferPatternsFile.empty()) {
+        next->transferPatterns = std::make_unique<TransferPatterns>();
+        if (!next->transferPatterns->load(options.transferPatternsFile, *next->timetable)) {
+            next->transferPatterns.reset();
+        }
+    }
+    return next;
+}
+
+void TimetableStore::publish(std::unique_ptr<TimetableVersion> next) {
+    std::lock_guard<std::mutex> lock(publishMutex);
+    std::lock_guard<std::mutex> delaysLock(delaysMutex);
+    // the new version starts with the delays that are live now
+    next->delays->apply(toTripUpdates(liveDelays, *next->timetable));
+    next->version = nextVersion++;
+    TimetableVersion* previous = owned.release();
+    owned = std::move(next);
+    current.store(owned.get()); // the swap, from now on new queries see the new version
+    if (previous) {
+        previous->retired.store(true);
+        retired.emplace_back(previous);
+    }
+    std::cout << "timetable version " << owned->version << " is live" << std::endl;
+}
+
+void TimetableStore::reclaim() {
+    std::lock_guard<std::mutex> lock(publishMutex);
+    for (auto it = retired.begin(); it != retired.end();) {
+        if (readers.held(it->get())) {
+            ++it;
+        } else {
+            std::cout << "freeing timetable version " << (*it)->version << std::endl;
+            it = retired.erase(it);
+        }
+    }
+}
+
+void TimetableStore::load() {
+    publish(build());
+}
+
+int TimetableStore::currentVersion() const {
+    const TimetableVersion* version = current.load();
+    return version ? version->version : 0;
+}
+
+int TimetableStore::applyDelays(const std::vector<GtfsDelay>& delays) {
+    std::unordered_map<std::string,std::vector<std::pair<int,int>>> batch;
+    for (const GtfsDelay& delay : delays) {
+        batch[delay.gtfsTripId].emplace_back(delay.stopSeq, delay.delaySeconds);
+    }
+    std::lock_guard<std::mutex> lock(delaysMutex);
+    for (const auto& [gtfsTripId, stopDelays] : batch) {
+        bool onTime = std::all_of(stopDelays.begin(), stopDelays.end(), [](const auto& stopDelay) { return stopDelay.second == 0; });
+        if (onTime) {
+            liveDelays.erase(gtfsTripId);
+        } else {
+            liveDelays[gtfsTripId] = stopDelays;
+        }
+    }
+    // current cant be swapped while we hold delaysMutex
+    const TimetableVersion* live = current.load();
+    return live ? live->delays->apply(toTripUpdates(batch, *live->timetable)) : 0;
+}
+
+int TimetableStore::delayedRoutes() const {
+    const TimetableVersion* live = current.load();
+    return live ? live->delays->delayedRoutes() : 0;
+}
+
+void TimetableStore::startDelayFeed(const std::string& delayFile, std::chrono::seconds interval) {
+    delayFeeder = std::thread([this, delayFile, interval] {
+        auto lastRead = std::filesystem::file_time_type::min();
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(reloadMutex);
+                if (reloadWakeup.wait_for(lock, interval, [this] { return stopping; })) return;
+            }
+            std::error_code error;
+            auto modified = std::filesystem::last_write_time(delayFile, error);
+            if (error || modified <= lastRead) continue;
+            lastRead = modified;
+            std::ifstream file(delayFile);
+            if (!file.is_open()) {
+                std::cerr << "Could not open file: " << delayFile << std::endl;
+                continue;
+            }
+            std::vector<GtfsDelay> delays = readDelayFeed(file);
+            int patchedRoutes = applyDelays(delays);
+            std::cout << "applied " << delays.size() << " delays, " << patchedRoutes << " routes patched" << std::endl;
+        }
+    });
+}
+
+void TimetableStore::requestReload() {
+    {
+        std::lock_guard<std::mutex> lock(reloadMutex);
+        reloadRequested = true;
+    }
+    reloadWakeup.notify_all();
+}
+
+void TimetableStore::startReloader(std::chrono::seconds interval) {
+    reloader = std::thread([this, interval] {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(reloadMutex);
+                reloadWakeup.wait_for(lock, interval, [this] { return stopping || reloadRequested; });
+                if (stopping) return;
+                bool requested = reloadRequested;
+                reloadRequested = false;
+                const TimetableVersion* live = current.load();
+                if (!requested && live && newestFeedTime() <= live->feedTime) {
+                    continue; // the feed didnt change
+                }
+            }
+            // queries keep running on the live version for the whole build
+            publish(build());
+            reclaim();
+        }
+    });
+}
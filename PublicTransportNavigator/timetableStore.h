@@ -0,0 +1,103 @@
+#ifndef TIMETABLESTORE_H
+#define TIMETABLESTORE_H
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "preprocess.h"
+#include "readerSlots.h"
+#include "delayOverlay.h"
+#include "delayTable.h"
+#include "transferPatterns.h"
+
+// hot swappable timetable: every built timetable is an immutable, versioned object. queries pin the
+// version that is current when they start and keep using it until they finish, while a background
+// thread builds the next version and swaps it in with one atomic store.
+// the pinning is hazard pointer style RCU (see readerSlots.h): a reader publishes the version it uses in a
+// free slot and re checks that it is still current, so the query path has no locks and no shared reference
+// count. a replaced version is freed when no slot holds it anymore - by the last reader that leaves it or
+// by the swap, whichever comes last.
+#define MAX_TIMETABLE_READERS 256 // concurrent queries, one slot each, more wait for a slot
+
+struct TimetableVersion {
+    std::unique_ptr<Preprocessor> timetable;
+    std::unique_ptr<DelayOverlay> delays; // the real time delays on top of timetable
+    std::unique_ptr<DelayTable> delayTable; // the predicted delays, null without PreprocessOptions::delayTableFile
+    std::unique_ptr<TransferPatterns> transferPatterns; // null without PreprocessOptions::transferPatternsFile
+    int version;
+    std::filesystem::file_time_type feedTime; // newest modification time of the feed files it was built from
+    std::atomic<bool> retired{false};
+};
+
+class TimetableStore;
+// pins a timetable version and the real time delays on it for the lifetime of the object, one per query
+class TimetableGuard {
+public:
+    TimetableGuard(TimetableStore& store);
+    ~TimetableGuard();
+    TimetableGuard(const TimetableGuard&) = delete;
+    TimetableGuard& operator=(const TimetableGuard&) = delete;
+    Preprocessor& timetable() const { return *version->timetable; }
+    const DelaySnapshot* delays() const { return &delayPin->snapshot(); }
+    const DelayTable* delayTable() const { return version->delayTable.get(); }
+    const TransferPatterns* transferPatterns() const { return version->transferPatterns.get(); }
+    int versionNumber() const { return version->version; }
+    // changes with every timetable version and every batch of delays on it, for what is cached across queries
+    uint64_t generation() const {
+        return (static_cast<uint64_t>(version->version) << 32) | static_cast<uint32_t>(delayPin->snapshot().batch);
+    }
+private:
+    TimetableStore& store;
+    int slot;
+    const TimetableVersion* version;
+    std::optional<DelayPin> delayPin; // of version, let go before the version is
+};
+
+class TimetableStore {
+public:
+    explicit TimetableStore(PreprocessOptions options_) : options(std::move(options_)) {}
+    ~TimetableStore();
+    // builds the first version in the calling thread
+    void load();
+    // polls the feed files every interval and rebuilds when one of them changed
+    void startReloader(std::chrono::seconds interval);
+    void requestReload(); // rebuild now, e.g. after the feed was republished
+    int currentVersion() const;
+    // a batch of real time delays, each trip in it replaces its earlier delays. the delays are kept by gtfs trip id
+    // and carried over to the next timetable version. returns the number of routes that were patched
+    int applyDelays(const std::vector<GtfsDelay>& delays);
+    // reads the delay feed file (see delayOverlay.h) whenever it changes, checked every interval
+    void startDelayFeed(const std::string& delayFile, std::chrono::seconds interval);
+    int delayedRoutes() const;
+
+private:
+    friend class TimetableGuard;
+    std::unique_ptr<TimetableVersion> build();
+    void publish(std::unique_ptr<TimetableVersion> next);
+    void reclaim(); // frees retired versions that no reader holds
+    std::filesystem::file_time_type newestFeedTime() const;
+
+    PreprocessOptions options;
+    std::atomic<const TimetableVersion*> current{nullptr};
+    ReaderSlots<TimetableVersion, MAX_TIMETABLE_READERS> readers;
+    std::vector<std::unique_ptr<TimetableVersion>> retired;
+    std::unique_ptr<TimetableVersion> owned; // the current version, owned here while it is published
+    std::mutex publishMutex; // only writers and the reclaim of retired versions take it
+    int nextVersion = 1;
+
+    std::thread reloader;
+    std::mutex reloadMutex;
+    std::condition_variable reloadWakeup;
+    bool reloadRequested = false;
+    bool stopping = false;
+
+    std::thread delayFeeder;
+    std::mutex delaysMutex; // orders the delay batches with the swaps, so no batch is lost between two versions
+    std::unordered_map<std::string,std::vector<std::pair<int,int>>> liveDelays; // gtfs trip id -> (stop_sequence, delay)
+};
+
+#endif //TIMETABLESTORE_H
@@ -0,0 +1,249 @@
+// Synthetic GTFS feed generator for scaling benchmarks.
+// writes stops.txt, routes.txt, trips.txt, stop_times.txt, calendar.txt (and agency.txt) in the
+// same column layout as the israeli feed that Preprocess reads, fully reproducible from --seed.
+//
+// usage: feedGenerator --out data_synth/ --stops 10000 --routes 800 --trips-per-route 60
+//                      --density 40 --min-route-stops 10 --max-route-stops 40
+//                      --min-headway 5 --max-headway 30 --services 4 --seed 1
+// --density is stops per square km, --min/max-headway are in minutes, --services is the number of
+// calendar patterns (1 = every day, 2 = +weekdays only, 3 = +friday, 4 = +saturday, ...)
+// at the end it prints the -D flags the navigator has to be compiled with for this feed.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <array>
+#include <unordered_set>
+#include <vector>
+
+struct GeneratorParams {
+    std::string outDir = "data_synth/";
+    int numOfStops = 10000;
+    int numOfRoutes = 800;
+    int tripsPerRoute = 60;
+    double stopsPerKm2 = 40;
+    int minRouteStops = 10;
+    int maxRouteStops = 40;
+    int minHeadwayMinutes = 5;
+    int maxHeadwayMinutes = 30;
+    int numOfServices = 4;
+    uint64_t seed = 1;
+};
+
+// splitmix64 - the std distributions are implementation defined so the same seed
+// wouldnt give the same feed on every standard library
+class FeedRandom {
+public:
+    explicit FeedRandom(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); } // [0,1)
+    int range(int lo, int hi) { return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1)); } // [lo,hi]
+private:
+    uint64_t state;
+};
+
+static const double CENTER_LAT = 32.08;
+static const double CENTER_LON = 34.78;
+static const double METERS_PER_DEG_LAT = 111320.0;
+
+struct GenStop {
+    double x, y; // meters from the south west corner
+};
+
+std::string formatTime(int seconds) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", seconds / 3600, (seconds % 3600) / 60, seconds % 60);
+    return buffer;
+}
+
+bool parseArgs(int argc, char* argv[], GeneratorParams& params) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--out") params.outDir = value.back() == '/' ? value : value + "/";
+        else if (key == "--stops") params.numOfStops = std::stoi(value);
+        else if (key == "--routes") params.numOfRoutes = std::stoi(value);
+        else if (key == "--trips-per-route") params.tripsPerRoute = std::stoi(value);
+        else if (key == "--density") params.stopsPerKm2 = std::stod(value);
+        else if (key == "--min-route-stops") params.minRouteStops = std::stoi(value);
+        else if (key == "--max-route-stops") params.maxRouteStops = std::stoi(value);
+        else if (key == "--min-headway") params.minHeadwayMinutes = std::stoi(value);
+        else if (key == "--max-headway") params.maxHeadwayMinutes = std::stoi(value);
+        else if (key == "--services") params.numOfServices = std::stoi(value);
+        else if (key == "--seed") params.seed = std::stoull(value);
+        else {
+            std::cerr << "Unknown argument: " << key << std::endl;
+            return false;
+        }
+    }
+    if (params.numOfStops < 2 || params.numOfRoutes < 1 || params.tripsPerRoute < 1 || params.stopsPerKm2 <= 0 ||
+        params.minRouteStops < 2 || params.maxRouteStops < params.minRouteStops ||
+        params.minHeadwayMinutes < 1 || params.maxHeadwayMinutes < params.minHeadwayMinutes ||
+        params.numOfServices < 1 || params.numOfServices > 7) {
+        std::cerr << "Invalid generator parameters" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// the week arrays of the service patterns, sunday first like the israeli calendar.txt
+std::vector<std::array<int, 7>> buildServicePatterns(int numOfServices) {
+    std::vector<std::array<int, 7>> patterns = {
+        {1, 1, 1, 1, 1, 1, 1}, // every day
+        {1, 1, 1, 1, 1, 0, 0}, // sunday - thursday
+        {0, 0, 0, 0, 0, 1, 0}, // friday
+        {0, 0, 0, 0, 0, 0, 1}, // saturday
+        {1, 0, 1, 0, 1, 0, 0},
+        {0, 1, 0, 1, 0, 0, 0},
+        {1, 1, 1, 1, 1, 1, 0},
+    };
+    patterns.resize(numOfServices);
+    return patterns;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorParams params;
+    if (!parseArgs(argc, argv, params)) {
+        return 1;
+    }
+    FeedRandom random(params.seed);
+    std::filesystem::create_directories(params.outDir);
+
+    // --- stops: uniform in a square whose size gives the requested density ---
+    double sideMeters = std::sqrt(params.numOfStops / params.stopsPerKm2) * 1000.0;
+    double metersPerDegLon = METERS_PER_DEG_LAT * std::cos(CENTER_LAT * M_PI / 180.0);
+    double originLat = CENTER_LAT - sideMeters / 2 / METERS_PER_DEG_LAT;
+    double originLon = CENTER_LON - sideMeters / 2 / metersPerDegLon;
+
+    std::vector<GenStop> stops(params.numOfStops);
+    // grid index with ~4 stops per cell for the route walks
+    double cellSize = std::max(1.0, std::sqrt(4.0 / params.stopsPerKm2) * 1000.0);
+    int gridSize = std::max(1, static_cast<int>(std::ceil(sideMeters / cellSize)));
+    std::vector<std::vector<int>> grid(static_cast<size_t>(gridSize) * gridSize);
+    auto cellOf = [&](double x, double y) {
+        int cx = std::min(gridSize - 1, std::max(0, static_cast<int>(x / cellSize)));
+        int cy = std::min(gridSize - 1, std::max(0, static_cast<int>(y / cellSize)));
+        return cy * gridSize + cx;
+    };
+    for (int i = 0; i < params.numOfStops; i++) {
+        stops[i] = {random.uniform() * sideMeters, random.uniform() * sideMeters};
+        grid[cellOf(stops[i].x, stops[i].y)].push_back(i);
+    }
+
+    std::ofstream stopsFile(params.outDir + "stops.txt");
+    stopsFile << "stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon,location_type,parent_station,zone_id\n";
+    stopsFile.precision(8);
+    for (int i = 0; i < params.numOfStops; i++) {
+        double lat = originLat + stops[i].y / METERS_PER_DEG_LAT;
+        double lon = originLon + stops[i].x / metersPerDegLon;
+        stopsFile << i + 1 << "," << 10000 + i << ",Synthetic stop " << i + 1 << ",," << lat << "," << lon << ",0,,1\n";
+    }
+
+    // --- routes: a walk that keeps a heading and each time takes the closest unvisited stop ahead ---
+    std::ofstream routesFile(params.outDir + "routes.txt");
+    routesFile << "route_id,agency_id,route_short_name,route_long_name,route_desc,route_type,route_color\n";
+    std::ofstream tripsFile(params.outDir + "trips.txt");
+    tripsFile << "route_id,service_id,trip_id,trip_headsign,direction_id,shape_id\n";
+    std::ofstream stopTimesFile(params.outDir + "stop_times.txt");
+    stopTimesFile << "trip_id,arrival_time,departure_time,stop_id,stop_sequence,pickup_type,drop_off_type,shape_dist_traveled\n";
+
+    long long numOfTrips = 0;
+    int numOfWrittenRoutes = 0; // a walk that found fewer than 2 stops is no route
+    for (int routeId = 1; routeId <= params.numOfRoutes; routeId++) {
+        int numOfRouteStops = random.range(params.minRouteStops, params.maxRouteStops);
+        std::vector<int> routeStops = {random.range(0, params.numOfStops - 1)};
+        double heading = random.uniform() * 2 * M_PI;
+        std::unordered_set<int> visited = {routeStops[0]};
+        int attempts = 0;
+        while (static_cast<int>(routeStops.size()) < numOfRouteStops && attempts++ < 8 * numOfRouteStops) {
+            const GenStop& cur = stops[routeStops.back()];
+            heading += (random.uniform() - 0.5) * 0.6; // slight turns
+            double aheadX = cur.x + std::cos(heading) * cellSize;
+            double aheadY = cur.y + std::sin(heading) * cellSize;
+            if (aheadX < 0 || aheadY < 0 || aheadX > sideMeters || aheadY > sideMeters) {
+                heading += M_PI; // bounce on the border of the area
+                continue;
+            }
+            int best = -1;
+            double bestDist = 0;
+            int cx = static_cast<int>(aheadX / cellSize), cy = static_cast<int>(aheadY / cellSize);
+            for (int radius = 1; best == -1 && radius <= gridSize; radius++) {
+                for (int gy = std::max(0, cy - radius); gy <= std::min(gridSize - 1, cy + radius); gy++) {
+                    for (int gx = std::max(0, cx - radius); gx <= std::min(gridSize - 1, cx + radius); gx++) {
+                        for (int candidate : grid[gy * gridSize + gx]) {
+                            if (visited.contains(candidate)) continue;
+                            double dist = std::hypot(stops[candidate].x - aheadX, stops[candidate].y - aheadY);
+                            if (best == -1 || dist < bestDist) {
+                                best = candidate;
+                                bestDist = dist;
+                            }
+                        }
+                    }
+                }
+            }
+            if (best == -1) break; // every stop is already on this route
+            visited.insert(best);
+            routeStops.push_back(best);
+        }
+        if (routeStops.size() < 2) continue;
+        numOfWrittenRoutes++;
+
+        // running times from the distances: 25 km/h with 20 seconds dwell
+        std::vector<int> arrOffsets = {0}, depOffsets = {0};
+        for (size_t i = 1; i < routeStops.size(); i++) {
+            double meters = std::hypot(stops[routeStops[i]].x - stops[routeStops[i - 1]].x,
+                                       stops[routeStops[i]].y - stops[routeStops[i - 1]].y);
+            int arrival = depOffsets.back() + std::max(30, static_cast<int>(meters / (25.0 / 3.6)));
+            arrOffsets.push_back(arrival);
+            depOffsets.push_back(i + 1 < routeStops.size() ? arrival + 20 : arrival);
+        }
+
+        routesFile << routeId << ",1," << routeId << ",Synthetic line " << routeId << ",," << 3 << ",\n";
+        int serviceId = random.range(1, params.numOfServices);
+        int headway = random.range(params.minHeadwayMinutes, params.maxHeadwayMinutes) * 60;
+        int firstDeparture = 5 * 3600 + random.range(0, headway);
+        for (int trip = 0; trip < params.tripsPerRoute; trip++) {
+            std::string tripId = std::to_string(routeId) + "_" + std::to_string(trip);
+            tripsFile << routeId << "," << serviceId << "," << tripId << ",Synthetic stop " << routeStops.back() + 1
+                      << ",0," << routeId << "\n";
+            int start = firstDeparture + trip * headway;
+            for (size_t i = 0; i < routeStops.size(); i++) {
+                stopTimesFile << tripId << "," << formatTime(start + arrOffsets[i]) << "," << formatTime(start + depOffsets[i])
+                              << "," << routeStops[i] + 1 << "," << i + 1 << ",0,0,\n";
+            }
+            numOfTrips++;
+        }
+    }
+
+    std::ofstream calendarFile(params.outDir + "calendar.txt");
+    calendarFile << "service_id,sunday,monday,tuesday,wednesday,thursday,friday,saturday,start_date,end_date\n";
+    std::vector<std::array<int, 7>> patterns = buildServicePatterns(params.numOfServices);
+    for (int serviceId = 1; serviceId <= params.numOfServices; serviceId++) {
+        calendarFile << serviceId;
+        for (int day : patterns[serviceId - 1]) {
+            calendarFile << "," << day;
+        }
+        calendarFile << ",20250101,20261231\n";
+    }
+    std::ofstream agencyFile(params.outDir + "agency.txt");
+    agencyFile << "agency_id,agency_name,agency_url,agency_timezone,agency_lang,agency_phone,agency_fare_url\n";
+    agencyFile << "1,Synthetic,http://example.com,Asia/Jerusalem,he,,\n";
+
+    std::cout << "wrote " << params.numOfStops << " stops, " << numOfWrittenRoutes << " routes, " << numOfTrips
+              << " trips to " << params.outDir << std::endl;
+    // one extra algo route for the empty stop sequence of the unused trip slots
+    std::cout << "compile the navigator with: -DNUM_OF_STOPS=" << params.numOfStops
+              << " -DNUM_OF_ALGO_ROUTES=" << numOfWrittenRoutes + 1
+              << " -DNUM_OF_REAL_TRIPS=" << numOfTrips << std::endl;
+    return 0;
+}
@@ -0,0 +1,319 @@
+// GTFS feed splitter for the sharded server.
+// cuts a feed into regional feeds at lines of longitude, every region is a feed of its own that a
+// "main --serve" process preprocesses and serves on its own, in front of them runs "main --shards".
+// a trip that crosses a cut becomes one trip per region it passes, each one keeps the first stop past the
+// cut (and the region after it the last stop before it), so the stops on both sides of the cut are in both
+// feeds with the same coordinates - those are the border stops the coordinator stitches the journeys at.
+// the stop ids of every region are renumbered from 1 so its timetable only needs the arrays of its own stops.
+//
+// usage: feedSplitter --data data/ --out shards/ --cut-lon 34.80[,34.90,...]
+// writes shards/region0/ (west of the first cut), shards/region1/, ... and shards/shards.conf for the
+// coordinator, and prints the -D flags every region has to be compiled with. the stop_sequence of every part starts
+// from 1 again, the real time delays of a part (DELAY) go to its shard with the sequence of the part.
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SplitterParams {
+    std::string dataDir = "data/";
+    std::string outDir = "shards/";
+    std::vector<double> cutLons; // sorted, n cuts give n + 1 regions
+};
+
+struct StopTimeRow {
+    int stopSeq;
+    int depTime;
+    std::vector<std::string> fields;
+};
+
+struct TripPart {
+    int region;
+    std::string tripId; // the gtfs trip id in that region
+    int startOffset; // departure of the first stop of the part minus the one of the whole trip, for frequencies.txt
+};
+
+static void splitCsvLine(const std::string& line, std::vector<std::string>& fields) {
+    fields.clear();
+    size_t fieldStart = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"') quoted = !quoted;
+        else if (line[i] == ',' && !quoted) {
+            fields.push_back(line.substr(fieldStart, i - fieldStart));
+            fieldStart = i + 1;
+        }
+    }
+    fields.push_back(line.substr(fieldStart, line.size() - fieldStart - (line.back() == '\r' ? 1 : 0)));
+}
+
+static std::string joinCsvLine(const std::vector<std::string>& fields) {
+    std::string line;
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i) line += ',';
+        line += fields[i];
+    }
+    return line;
+}
+
+static int parseSeconds(const std::string& time) {
+    int parts[3] = {0, 0, 0};
+    size_t start = 0;
+    for (int& part : parts) {
+        size_t end = time.find(':', start);
+        std::from_chars(time.data() + start, time.data() + (end == std::string::npos ? time.size() : end), part);
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return parts[0] * 3600 + parts[1] * 60 + parts[2];
+}
+
+static std::string formatTime(int seconds) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", seconds / 3600, (seconds % 3600) / 60, seconds % 60);
+    return buffer;
+}
+
+bool parseArgs(int argc, char* argv[], SplitterParams& params) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--data") params.dataDir = value.back() == '/' ? value : value + "/";
+        else if (key == "--out") params.outDir = value.back() == '/' ? value : value + "/";
+        else if (key == "--cut-lon") {
+            std::istringstream iss(value);
+            std::string lon;
+            while (std::getline(iss, lon, ',')) params.cutLons.push_back(std::stod(lon));
+        }
+        else {
+            std::cerr << "Unknown argument: " << key << std::endl;
+            return false;
+        }
+    }
+    if (params.cutLons.empty()) {
+        std::cerr << "Nothing to split: give at least one --cut-lon" << std::endl;
+        return false;
+    }
+    std::sort(params.cutLons.begin(), params.cutLons.end());
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SplitterParams params;
+    if (!parseArgs(argc, argv, params)) {
+        return 1;
+    }
+    const int numOfRegions = static_cast<int>(params.cutLons.size()) + 1;
+    auto regionOf = [&](double lon) {
+        return static_cast<int>(std::upper_bound(params.cutLons.begin(), params.cutLons.end(), lon) - params.cutLons.begin());
+    };
+    std::vector<std::string> fields;
+    std::string line;
+
+    // --- stops: the region of every stop, the stations are written with the platforms under them ---
+    std::ifstream stopsFile(params.dataDir + "stops.txt");
+    if (!stopsFile.is_open()) {
+        std::cerr << "Could not open file: " << params.dataDir << "stops.txt" << std::endl;
+        return 1;
+    }
+    std::string stopsHeader;
+    std::getline(stopsFile, stopsHeader);
+    std::vector<std::vector<std::string>> stopRows;
+    std::unordered_map<std::string, int> stopRowOf;
+    std::vector<int> stopRegions;
+    while (std::getline(stopsFile, line)) {
+        if (line.empty() || line == "\r") continue;
+        splitCsvLine(line, fields);
+        if (fields.size() < 6) continue;
+        stopRowOf[fields[0]] = static_cast<int>(stopRows.size());
+        stopRegions.push_back(regionOf(std::stod(fields[5])));
+        stopRows.push_back(fields);
+    }
+
+    // --- stop_times: the stops of every trip in order, the rows of one trip are together like in every feed ---
+    std::ifstream stopTimesFile(params.dataDir + "stop_times.txt");
+    if (!stopTimesFile.is_open()) {
+        std::cerr << "Could not open file: " << params.dataDir << "stop_times.txt" << std::endl;
+        return 1;
+    }
+    std::string stopTimesHeader;
+    std::getline(stopTimesFile, stopTimesHeader);
+    std::vector<std::vector<bool>> usedStops(numOfRegions, std::vector<bool>(stopRows.size(), false));
+    std::vector<std::vector<std::string>> partStopTimes(numOfRegions); // rows with the old stop ids for now
+    std::unordered_map<std::string, std::vector<TripPart>> tripParts;
+    std::vector<std::set<std::vector<int>>> stopSequences(numOfRegions); // to estimate the algo routes
+
+    std::string curTripId;
+    std::vector<StopTimeRow> tripRows;
+    auto splitTrip = [&]() {
+        if (tripRows.empty()) return;
+        std::sort(tripRows.begin(), tripRows.end(), [](const StopTimeRow& a, const StopTimeRow& b) { return a.stopSeq < b.stopSeq; });
+        std::vector<int> rows(tripRows.size()), regions(tripRows.size());
+        for (size_t i = 0; i < tripRows.size(); i++) {
+            auto stop = stopRowOf.find(tripRows[i].fields[3]);
+            rows[i] = stop == stopRowOf.end() ? -1 : stop->second;
+            regions[i] = rows[i] == -1 ? -1 : stopRegions[rows[i]];
+        }
+        std::vector<int> partsInRegion(numOfRegions, 0);
+        std::vector<TripPart>& parts = tripParts[curTripId];
+        size_t runStart = 0;
+        while (runStart < tripRows.size()) {
+            size_t runEnd = runStart;
+            while (runEnd + 1 < tripRows.size() && regions[runEnd + 1] == regions[runStart]) runEnd++;
+            int region = regions[runStart];
+            if (region != -1) {
+                // one stop of overlap on each side of the run
+                size_t first = runStart > 0 && rows[runStart - 1] != -1 ? runStart - 1 : runStart;
+                size_t last = runEnd + 1 < tripRows.size() && rows[runEnd + 1] != -1 ? runEnd + 1 : runEnd;
+                if (last > first) {
+                    std::string partId = partsInRegion[region]++ == 0 ? curTripId : curTripId + "/" + std::to_string(partsInRegion[region]);
+                    parts.push_back({region, partId, tripRows[first].depTime - tripRows.front().depTime});
+                    std::vector<int> sequence;
+                    for (size_t i = first; i <= last; i++) {
+                        std::vector<std::string> row = tripRows[i].fields;
+                        row[0] = partId;
+                        row[4] = std::to_string(i - first + 1); // Preprocess reads stop_sequence as the place in the trip
+                        partStopTimes[region].push_back(joinCsvLine(row));
+                        usedStops[region][rows[i]] = true;
+                        sequence.push_back(rows[i]);
+                    }
+                    stopSequences[region].insert(std::move(sequence));
+                }
+            }
+            runStart = runEnd + 1;
+        }
+        tripRows.clear();
+    };
+    while (std::getline(stopTimesFile, line)) {
+        if (line.empty() || line == "\r") continue;
+        splitCsvLine(line, fields);
+        if (fields.size() < 5) continue;
+        if (fields[0] != curTripId) {
+            splitTrip();
+            curTripId = fields[0];
+        }
+        int stopSeq = 0;
+        std::from_chars(fields[4].data(), fields[4].data() + fields[4].size(), stopSeq);
+        tripRows.push_back({stopSeq, parseSeconds(fields[2]), fields});
+    }
+    splitTrip();
+
+    // --- trips and frequencies: a line per part of the trip ---
+    std::vector<std::string> tripsLines, frequenciesLines;
+    std::string tripsHeader, frequenciesHeader;
+    std::ifstream tripsFile(params.dataDir + "trips.txt");
+    if (!tripsFile.is_open()) {
+        std::cerr << "Could not open file: " << params.dataDir << "trips.txt" << std::endl;
+        return 1;
+    }
+    std::getline(tripsFile, tripsHeader);
+    while (std::getline(tripsFile, line)) {
+        if (!line.empty() && line != "\r") tripsLines.push_back(line);
+    }
+    std::ifstream frequenciesFile(params.dataDir + "frequencies.txt"); // optional
+    if (frequenciesFile.is_open()) {
+        std::getline(frequenciesFile, frequenciesHeader);
+        while (std::getline(frequenciesFile, line)) {
+            if (!line.empty() && line != "\r") frequenciesLines.push_back(line);
+        }
+    }
+
+    std::filesystem::create_directories(params.outDir);
+    std::ofstream confFile(params.outDir + "shards.conf");
+    confFile << "# name socket feed, one shard per line - start every shard with main --data <feed> --serve <socket>\n";
+    for (int region = 0; region < numOfRegions; region++) {
+        std::string regionName = "region" + std::to_string(region);
+        std::string regionDir = params.outDir + regionName + "/";
+        std::filesystem::create_directories(regionDir);
+        confFile << regionName << " " << params.outDir << regionName << ".sock " << regionDir << "\n";
+
+        // the stops of the region, the overlap stops of its trips and the stations above them, numbered from 1
+        std::vector<bool> keep(stopRows.size(), false);
+        for (size_t row = 0; row < stopRows.size(); row++) {
+            keep[row] = stopRegions[row] == region || usedStops[region][row];
+        }
+        for (size_t row = 0; row < stopRows.size(); row++) {
+            if (!keep[row] || stopRows[row].size() < 8 || stopRows[row][7].empty()) continue;
+            auto parent = stopRowOf.find(stopRows[row][7]);
+            if (parent != stopRowOf.end()) keep[parent->second] = true;
+        }
+        std::unordered_map<std::string, std::string> newStopIds;
+        int numOfStops = 0;
+        for (size_t row = 0; row < stopRows.size(); row++) {
+            if (keep[row]) newStopIds[stopRows[row][0]] = std::to_string(++numOfStops);
+        }
+        std::ofstream regionStops(regionDir + "stops.txt");
+        regionStops << stopsHeader << "\n";
+        for (size_t row = 0; row < stopRows.size(); row++) {
+            if (!keep[row]) continue;
+            std::vector<std::string> stop = stopRows[row];
+            stop[0] = newStopIds[stop[0]];
+            if (stop.size() >= 8 && !stop[7].empty()) {
+                auto parent = newStopIds.find(stop[7]);
+                stop[7] = parent == newStopIds.end() ? "" : parent->second;
+            }
+            regionStops << joinCsvLine(stop) << "\n";
+        }
+
+        std::ofstream regionStopTimes(regionDir + "stop_times.txt");
+        regionStopTimes << stopTimesHeader << "\n";
+        for (const std::string& row : partStopTimes[region]) {
+            splitCsvLine(row, fields);
+            fields[3] = newStopIds[fields[3]];
+            regionStopTimes << joinCsvLine(fields) << "\n";
+        }
+
+        int numOfTrips = 0;
+        std::ofstream regionTrips(regionDir + "trips.txt");
+        regionTrips << tripsHeader << "\n";
+        for (const std::string& tripLine : tripsLines) {
+            splitCsvLine(tripLine, fields);
+            if (fields.size() < 3) continue;
+            auto parts = tripParts.find(fields[2]);
+            if (parts == tripParts.end()) continue;
+            for (const TripPart& part : parts->second) {
+                if (part.region != region) continue;
+                fields[2] = part.tripId;
+                regionTrips << joinCsvLine(fields) << "\n";
+                numOfTrips++;
+            }
+        }
+        if (!frequenciesHeader.empty()) {
+            // the runs of a part start when the whole trip reaches its first stop
+            std::ofstream regionFrequencies(regionDir + "frequencies.txt");
+            regionFrequencies << frequenciesHeader << "\n";
+            for (const std::string& frequencyLine : frequenciesLines) {
+                splitCsvLine(frequencyLine, fields);
+                if (fields.size() < 4) continue;
+                auto parts = tripParts.find(fields[0]);
+                if (parts == tripParts.end()) continue;
+                std::vector<std::string> partFields = fields;
+                for (const TripPart& part : parts->second) {
+                    if (part.region != region) continue;
+                    partFields[0] = part.tripId;
+                    partFields[1] = formatTime(parseSeconds(fields[1]) + part.startOffset);
+                    partFields[2] = formatTime(parseSeconds(fields[2]) + part.startOffset);
+                    regionFrequencies << joinCsvLine(partFields) << "\n";
+                }
+            }
+        }
+        for (const char* file : {"routes.txt", "calendar.txt", "agency.txt"}) {
+            std::filesystem::copy_file(params.dataDir + file, regionDir + file, std::filesystem::copy_options::overwrite_existing);
+        }
+
+        std::cout << regionName << ": " << numOfStops << " stops, " << numOfTrips << " trips in " << regionDir << std::endl;
+        // one extra algo route for the empty stop sequence of the unused trip slots, trips that overtake each other
+        // split a stop sequence into more routes and then Preprocess says how many are missing
+        std::cout << "  compile its navigator with: -DNUM_OF_STOPS=" << numOfStops
+                  << " -DNUM_OF_ALGO_ROUTES=" << stopSequences[region].size() + 1
+                  << " -DNUM_OF_REAL_TRIPS=" << numOfTrips << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Layout benchmark: the same queries on the feed in gtfs id order and in locality order (PreprocessOptions::localityOrder).
+// both timetables are built in the same process and queried one after the other on one thread, a few times each
+// alternating between them, and for every layout the latency percentiles and the cache misses per query are printed
+// (the cache misses come from the linux perf counters, n/a where perf_event_open isnt allowed).
+//
+// usage: localityBench --data data/ [--queries 2000] [--repeats 3] [--seed 1]
+// the journeys of both layouts are compared too: the search reads the routes of a stop in id order, so a few
+// answers can differ between the layouts the same way they differ between two equally good routes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../preprocess.h"
+#include "../routingAlgorithm.h"
+
+struct BenchQuery {
+    StopLocation startStop;
+    StopLocation endStop;
+    Time time;
+};
+
+// one hardware counter of this thread, counts only between start() and stop()
+class PerfCounter {
+public:
+    PerfCounter(unsigned int type, unsigned long long config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() {
+        if (fd != -1) close(fd);
+    }
+    bool available() const { return fd != -1; }
+    void start() {
+        if (fd == -1) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    long long stop() {
+        if (fd == -1) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = -1;
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+        return count;
+    }
+private:
+    int fd = -1;
+};
+
+struct LayoutRun {
+    std::vector<long long> micros;
+    long long cacheMisses = 0;
+    long long l1dMisses = 0;
+    std::vector<std::string> signatures;
+};
+
+static long long percentile(std::vector<long long> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[index];
+}
+
+static std::string journeysSignature(const JourneysToDest& journeys) {
+    std::string signature;
+    for (int round = 0; round <= MAX_NUM_OF_TRANSFERS; round++) {
+        if (!journeys[round].empty()) {
+            signature += std::to_string(round) + ":" + std::to_string(journeys[round].back().arrTime) + ";";
+        }
+    }
+    return signature;
+}
+
+static void runQueries(Preprocessor& timetable, const std::vector<BenchQuery>& queries, LayoutRun& run) {
+    RAPTOR raptor(timetable.tripProfiles, timetable.Aroutes, timetable.Astops, timetable.footpathGraph, timetable.stopsData, timetable.stopCoords, timetable.tripsData);
+    raptor.verbose = false;
+    PerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1dMisses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    bool keepSignatures = run.signatures.empty();
+    cacheMisses.start();
+    l1dMisses.start();
+    for (const BenchQuery& query : queries) {
+        auto start = std::chrono::steady_clock::now();
+        JourneysToDest journeys = raptor.run(query.startStop, query.endStop, query.time);
+        run.micros.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        if (keepSignatures) run.signatures.push_back(journeysSignature(journeys));
+    }
+    long long misses = cacheMisses.stop(), l1d = l1dMisses.stop();
+    run.cacheMisses = misses == -1 || run.cacheMisses == -1 ? -1 : run.cacheMisses + misses;
+    run.l1dMisses = l1d == -1 || run.l1dMisses == -1 ? -1 : run.l1dMisses + l1d;
+}
+
+static void printRun(const std::string& name, const LayoutRun& run) {
+    long long total = 0;
+    for (long long micros : run.micros) total += micros;
+    size_t numOfQueries = std::max<size_t>(1, run.micros.size());
+    std::cout << name << ": mean " << total / static_cast<long long>(numOfQueries) << "us, p50 " << percentile(run.micros, 0.5)
+              << "us, p90 " << percentile(run.micros, 0.9) << "us, p99 " << percentile(run.micros, 0.99) << "us";
+    if (run.cacheMisses == -1) {
+        std::cout << ", cache misses n/a";
+    } else {
+        std::cout << ", cache misses/query " << run.cacheMisses / static_cast<long long>(numOfQueries);
+    }
+    if (run.l1dMisses != -1) {
+        std::cout << ", L1d misses/query " << run.l1dMisses / static_cast<long long>(numOfQueries);
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "data/";
+    int numOfQueries = 2000, numOfRepeats = 3;
+    unsigned long long seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--data") dataDir = argv[i + 1];
+        else if (arg == "--queries") numOfQueries = std::stoi(argv[i + 1]);
+        else if (arg == "--repeats") numOfRepeats = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--seed") seed = std::stoull(argv[i + 1]);
+    }
+    PreprocessOptions options;
+    options.dataDir = dataDir;
+    options.runChecker = false;
+    options.buildReportFile = "";
+    auto gtfsOrder = std::make_unique<Preprocess>(options);
+    gtfsOrder->process();
+    options.localityOrder = true;
+    auto localityOrder = std::make_unique<Preprocess>(options);
+    localityOrder->process();
+
+    // random stop to stop queries between 05:00 and 22:00 on a monday, by location so they mean the same in both layouts
+    std::vector<int> stopIds;
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        if (!gtfsOrder->stopsData[stopId].name.empty()) stopIds.push_back(stopId);
+    }
+    if (stopIds.empty()) {
+        std::cerr << "No stops in " << dataDir << std::endl;
+        return 1;
+    }
+    auto next = [&seed] { // splitmix64, same as the feed generator
+        unsigned long long z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    std::vector<BenchQuery> queries;
+    for (int i = 0; i < numOfQueries; i++) {
+        int from = stopIds[next() % stopIds.size()], to = stopIds[next() % stopIds.size()];
+        int depTime = 5 * 3600 + static_cast<int>(next() % (17 * 3600));
+        const StopCoords& coords = gtfsOrder->stopCoords;
+        queries.push_back({{coords.lat(from), coords.lon(from)}, {coords.lat(to), coords.lon(to)}, {depTime, 2, 20250505}});
+    }
+
+    LayoutRun gtfsRun, localityRun;
+    for (int repeat = 0; repeat < numOfRepeats; repeat++) {
+        runQueries(*gtfsOrder, queries, gtfsRun);
+        runQueries(*localityOrder, queries, localityRun);
+    }
+    std::cout << numOfQueries << " queries x " << numOfRepeats << " repeats" << std::endl;
+    printRun("gtfs order    ", gtfsRun);
+    printRun("locality order", localityRun);
+    int different = 0;
+    for (size_t i = 0; i < gtfsRun.signatures.size(); i++) {
+        if (gtfsRun.signatures[i] != localityRun.signatures[i]) different++;
+    }
+    std::cout << different << " of " << numOfQueries << " queries got different journeys" << std::endl;
+    return 0;
+}
@@ -0,0 +1,277 @@
+// Query log replay load generator.
+// drives RAPTOR with a recorded query stream (see queryLog.h) across N worker threads and reports
+// throughput, queueing delay and latency percentiles.
+//
+// usage:
+//   replay --data data/ --log queries.otql [--threads 8] [--rate 200 | --speedup 10] [--out results.csv] [--deadline-ms 50]
+//          [--interleave 8] [--osm extract.osm] [--delay-table delays.bin]
+//   replay --compare build_a.csv build_b.csv
+//   replay --data data/ --make-log synthetic.otql --queries 10000 [--seed 1]
+// --rate replays open loop at a fixed arrival rate (queries per second), --speedup replays the recorded
+// arrival times compressed by that factor, with neither the workers run closed loop (as fast as they can).
+// the latency of a query is measured from the time it was scheduled to arrive, so a slow build is
+// charged for the queue that builds up behind it. --out writes one line per query with its timings
+// and a signature of the results, --compare reads two such files (e.g. from two builds on the same log).
+// --deadline-ms gives every query that budget from its scheduled arrival, like the server does, and counts the
+// queries that were cut short (their signature is that of the journeys found until then).
+// --interleave runs that many queries at once on every thread (InterleavedRunner), closed loop only, the service
+// time of a query is then from when its thread took it until its answer was ready.
+// --osm walks from and to the query locations over the streets of the extract, like main --osm.
+// every query runs in the mode it was logged with, the SAFEST_JOURNEY ones need --delay-table (like main) or they
+// search like the others.
+// --make-log writes a log of random stop to stop queries over the feed, for feeds without recorded traffic.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "../interleavedRunner.h"
+#include "../preprocess.h"
+#include "../queryLog.h"
+#include "../routingAlgorithm.h"
+
+struct ReplayResult {
+    long long queueMicros;   // scheduled arrival -> a worker picked it up
+    long long serviceMicros; // the search itself
+    std::string signature;   // best arrival time per round, to compare the answers of two builds
+};
+
+static long long percentile(std::vector<long long> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[index];
+}
+static void printDistribution(const std::string& name, const std::vector<long long>& micros) {
+    std::cout << name << " (us): p50 " << percentile(micros, 0.5) << ", p90 " << percentile(micros, 0.9)
+              << ", p99 " << percentile(micros, 0.99) << ", p99.9 " << percentile(micros, 0.999)
+              << ", max " << percentile(micros, 1.0) << std::endl;
+}
+
+static std::string journeysSignature(const JourneysToDest& journeys) {
+    std::string signature;
+    for (int round = 0; round <= MAX_NUM_OF_TRANSFERS; round++) {
+        if (!journeys[round].empty()) {
+            signature += std::to_string(round) + ":" + std::to_string(journeys[round].back().arrTime) + ";";
+        }
+    }
+    return signature.empty() ? "-" : signature;
+}
+
+struct ResultsFile {
+    std::vector<long long> serviceMicros;
+    std::vector<long long> responseMicros;
+    std::vector<std::string> signatures;
+};
+static bool readResults(const std::string& filename, ResultsFile& results) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    std::getline(file, line); // Skip header
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string index, queue, service, signature;
+        std::getline(iss, index, ',');
+        std::getline(iss, queue, ',');
+        std::getline(iss, service, ',');
+        std::getline(iss, signature, ',');
+        results.serviceMicros.push_back(std::stoll(service));
+        results.responseMicros.push_back(std::stoll(queue) + std::stoll(service));
+        results.signatures.push_back(signature);
+    }
+    return true;
+}
+// random stop to stop queries between 05:00 and 22:00, spaced 1ms apart in the log
+static int makeLog(Preprocessor& timetable, const std::string& filename, int numOfQueries, unsigned long long seed) {
+    std::vector<int> stopIds;
+    for (const StopData& stop : timetable.stopsData) {
+        if (!stop.name.empty()) stopIds.push_back(stop.id);
+    }
+    if (stopIds.empty()) return 1;
+    QueryLogWriter writer;
+    if (!writer.open(filename)) return 1;
+    auto next = [&seed] { // splitmix64, same as the feed generator
+        unsigned long long z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    for (int i = 0; i < numOfQueries; i++) {
+        int from = stopIds[next() % stopIds.size()], to = stopIds[next() % stopIds.size()];
+        int depTime = 5 * 3600 + static_cast<int>(next() % (17 * 3600));
+        const StopCoords& coords = timetable.stopCoords;
+        writer.append({coords.lat(from), coords.lon(from)}, {coords.lat(to), coords.lon(to)}, {depTime, 2, 20250505}, // a monday
+                      static_cast<int64_t>(i) * 1000, BEST_ARRIVAL_TIME);
+    }
+    writer.flush();
+    std::cout << "wrote " << numOfQueries << " queries to " << filename << std::endl;
+    return 0;
+}
+
+static int compareResults(const std::string& fileA, const std::string& fileB) {
+    ResultsFile a, b;
+    if (!readResults(fileA, a) || !readResults(fileB, b)) return 1;
+    if (a.signatures.size() != b.signatures.size()) {
+        std::cerr << "The result files are from different logs" << std::endl;
+        return 1;
+    }
+    int different = 0;
+    for (size_t i = 0; i < a.signatures.size(); i++) {
+        if (a.signatures[i] != b.signatures[i]) different++;
+    }
+    std::cout << "A = " << fileA << ", B = " << fileB << std::endl;
+    printDistribution("A service", a.serviceMicros);
+    printDistribution("B service", b.serviceMicros);
+    printDistribution("A response", a.responseMicros);
+    printDistribution("B response", b.responseMicros);
+    std::cout << different << " of " << a.signatures.size() << " queries got different journeys" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "data/", logFile, outFile, makeLogFile, osmFile;
+    PreprocessOptions preprocessOptions;
+    int numOfQueries = 10000;
+    unsigned long long seed = 1;
+    int numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    double rate = 0, speedup = 0;
+    int deadlineMillis = 0;
+    int interleave = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--compare" && i + 2 < argc) return compareResults(argv[i + 1], argv[i + 2]);
+        if (i + 1 >= argc) break;
+        if (arg == "--data") dataDir = argv[++i];
+        else if (arg == "--log") logFile = argv[++i];
+        else if (arg == "--threads") numOfThreads = std::stoi(argv[++i]);
+        else if (arg == "--rate") rate = std::stod(argv[++i]);
+        else if (arg == "--speedup") speedup = std::stod(argv[++i]);
+        else if (arg == "--out") outFile = argv[++i];
+        else if (arg == "--make-log") makeLogFile = argv[++i];
+        else if (arg == "--queries") numOfQueries = std::stoi(argv[++i]);
+        else if (arg == "--seed") seed = std::stoull(argv[++i]);
+        else if (arg == "--deadline-ms") deadlineMillis = std::stoi(argv[++i]);
+        else if (arg == "--interleave") interleave = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--osm") osmFile = argv[++i];
+        else if (arg == "--delay-table") preprocessOptions.delayTableFile = argv[++i];
+    }
+    preprocessOptions.dataDir = dataDir;
+    preprocessOptions.runChecker = false;
+    preprocessOptions.osmFile = osmFile;
+    std::unique_ptr<Preprocessor> preprocessorPtr = std::make_unique<Preprocess>(preprocessOptions);
+    preprocessorPtr->process();
+    if (!makeLogFile.empty()) {
+        return makeLog(*preprocessorPtr, makeLogFile, numOfQueries, seed);
+    }
+
+    DelayTable delayTable;
+    bool safest = !preprocessOptions.delayTableFile.empty() && delayTable.load(preprocessOptions.delayTableFile, *preprocessorPtr);
+
+    std::vector<LoggedQuery> queries = QueryLogReader::readAll(logFile);
+    if (queries.empty()) {
+        std::cerr << "No queries to replay" << std::endl;
+        return 1;
+    }
+
+    // the schedule: when each query is supposed to arrive, relative to the start of the replay
+    std::vector<long long> scheduledMicros(queries.size(), 0);
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (rate > 0) {
+            scheduledMicros[i] = static_cast<long long>(i * 1e6 / rate);
+        } else if (speedup > 0) {
+            scheduledMicros[i] = static_cast<long long>((queries[i].recordedAtMicros - queries[0].recordedAtMicros) / speedup);
+        }
+    }
+    bool openLoop = rate > 0 || speedup > 0;
+    if (openLoop && interleave > 1) {
+        std::cerr << "--interleave only replays closed loop, ignoring it" << std::endl;
+        interleave = 1;
+    }
+
+    std::vector<ReplayResult> results(queries.size());
+    std::atomic<size_t> nextQuery{0};
+    std::atomic<size_t> numOfPartials{0};
+    auto replayStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&] {
+            if (interleave > 1) {
+                InterleavedRunner runner(*preprocessorPtr, interleave);
+                for (auto& lane : runner.lanes) lane->delayTable = safest ? &delayTable : nullptr;
+                runner.run([&](InterleavedQuery& query) {
+                    size_t i = nextQuery++;
+                    if (i >= queries.size()) return false;
+                    query = {i, queries[i].startStop, queries[i].endStop, queries[i].time, {}};
+                    query.options.mode = queries[i].mode;
+                    auto start = std::chrono::steady_clock::now();
+                    if (deadlineMillis > 0) query.options.deadline = start + std::chrono::milliseconds(deadlineMillis);
+                    // the start time of the query waits in the slot of its result until it is done
+                    results[i].serviceMicros = std::chrono::duration_cast<std::chrono::microseconds>(start.time_since_epoch()).count();
+                    return true;
+                }, [&](const InterleavedQuery& query, QueryResult& result) {
+                    long long end = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+                    if (result.partial) numOfPartials++;
+                    results[query.index] = {0, end - results[query.index].serviceMicros, journeysSignature(result.journeys)};
+                });
+                return;
+            }
+            // each worker has its own RAPTOR, they all share the same timetable
+            RAPTOR raptor(preprocessorPtr->tripProfiles, preprocessorPtr->Aroutes, preprocessorPtr->Astops, preprocessorPtr->footpathGraph,
+                          preprocessorPtr->stopsData, preprocessorPtr->stopCoords, preprocessorPtr->tripsData);
+            raptor.verbose = false;
+            raptor.streets = &preprocessorPtr->streets; // the same walks as the interleaved lanes
+            raptor.delayTable = safest ? &delayTable : nullptr;
+            for (size_t i = nextQuery++; i < queries.size(); i = nextQuery++) {
+                auto scheduled = replayStart + std::chrono::microseconds(scheduledMicros[i]);
+                if (openLoop) std::this_thread::sleep_until(scheduled);
+                auto start = std::chrono::steady_clock::now();
+                QueryOptions options;
+                options.mode = queries[i].mode;
+                if (deadlineMillis > 0) options.deadline = (openLoop ? scheduled : start) + std::chrono::milliseconds(deadlineMillis);
+                QueryResult result = raptor.query(queries[i].startStop, queries[i].endStop, queries[i].time, options);
+                auto end = std::chrono::steady_clock::now();
+                if (result.partial) numOfPartials++;
+                results[i] = {openLoop ? std::chrono::duration_cast<std::chrono::microseconds>(start - scheduled).count() : 0,
+                              std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(),
+                              journeysSignature(result.journeys)};
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+
+    std::vector<long long> queueMicros, serviceMicros, responseMicros;
+    for (const ReplayResult& result : results) {
+        queueMicros.push_back(result.queueMicros);
+        serviceMicros.push_back(result.serviceMicros);
+        responseMicros.push_back(result.queueMicros + result.serviceMicros);
+    }
+    std::cout << queries.size() << " queries on " << numOfThreads << " threads in " << elapsedSeconds << "s = "
+              << queries.size() / elapsedSeconds << " queries/s (" << (openLoop ? "open loop" : "closed loop") << ")" << std::endl;
+    printDistribution("queueing delay", queueMicros);
+    printDistribution("service time", serviceMicros);
+    printDistribution("response time", responseMicros);
+    if (deadlineMillis > 0) {
+        std::cout << numOfPartials << " of " << queries.size() << " queries passed the " << deadlineMillis
+                  << "ms deadline and got partial journeys" << std::endl;
+    }
+
+    if (!outFile.empty()) {
+        std::ofstream out(outFile);
+        out << "index,queue_us,service_us,signature\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            out << i << "," << results[i].queueMicros << "," << results[i].serviceMicros << "," << results[i].signature << "\n";
+        }
+    }
+    return 0;
+}
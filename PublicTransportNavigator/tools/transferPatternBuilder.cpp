@@ -0,0 +1,227 @@
+// Transfer pattern precomputation for hub stations (see transferPatterns.h).
+// picks the busiest stops of the feed as hubs (or takes a list of gtfs stop ids), runs the search between every two
+// hubs at every --interval minutes of every day of the week and keeps the stop sequences of all the journeys it gets,
+// the optimal one of each round. the union over the departure times stands in for a full profile search: a journey
+// that is only optimal between two samples is missed, the router then answers from the next best pattern.
+// the patterns of a pair are merged into a prefix tree and all the trees are written to one file, which the router
+// loads next to the timetable (--transfer-patterns).
+// the searches walk like main's: over the streets of --osm, in a straight line without it. the file has no walk times,
+// main measures them over its own footpaths, so build with the --osm main runs with.
+//
+// usage: transferPatternBuilder --data data/ [--out transfer_patterns.bin] [--hubs 50 | --hub-list hubs.txt]
+//                               [--interval 15] [--date 20250504] [--days 7] [--threads n] [--osm <extract, the same as main's>]
+// --hub-list is one gtfs stop_id per line, --date is the first day that is sampled, the next --days follow it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "../preprocess.h"
+#include "../routingAlgorithm.h"
+
+#define FIRST_SAMPLE_TIME (5 * 3600)
+#define LAST_SAMPLE_TIME (23 * 3600)
+
+struct FileNode {
+    int stopId;
+    int parent;
+    uint8_t flags;
+};
+
+// the prefix tree of the patterns of one hub pair, a node is its parent, its stop and how it was reached
+class PatternTrie {
+public:
+    // false when the legs dont chain up (every leg starts where the one before it ended), the journey is then left out
+    bool add(const std::vector<UserStopState>& journey) {
+        if (journey.empty() || journey.front().depStopId != START_STOP_ID || journey.back().arrStopId != DEST_STOP_ID) return false;
+        for (size_t i = 1; i < journey.size(); i++) {
+            if (journey[i].depStopId != journey[i - 1].arrStopId) return false;
+        }
+        int current = -1;
+        for (const UserStopState& leg : journey) {
+            if (leg.depStopId == START_STOP_ID) {
+                if (leg.arrStopId == DEST_STOP_ID) return false; // walked all the way
+                current = child(-1, leg.arrStopId, 0);
+            } else if (leg.arrStopId == DEST_STOP_ID) {
+                nodes[current].flags |= PATTERN_NODE_EGRESS;
+            } else {
+                current = child(current, leg.arrStopId, leg.tripId == FOOTPATH_TRIP_ID ? PATTERN_NODE_WALK : 0);
+            }
+        }
+        return true;
+    }
+    std::vector<FileNode> nodes;
+private:
+    int child(int parent, int stopId, uint8_t walk) {
+        auto [it, inserted] = children.try_emplace({parent, stopId, walk}, static_cast<int>(nodes.size()));
+        if (inserted) nodes.push_back({stopId, parent, walk});
+        return it->second;
+    }
+    std::map<std::tuple<int,int,uint8_t>,int> children;
+};
+
+static void putInt(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+// 1 = sunday, the same as Time.dayInWeek
+static int dayInWeekOf(int date) {
+    std::chrono::year_month_day day{std::chrono::year(date / 10000), std::chrono::month(date / 100 % 100),
+                                    std::chrono::day(date % 100)};
+    return static_cast<int>(std::chrono::weekday(std::chrono::sys_days(day)).c_encoding()) + 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "data/", outFile = "transfer_patterns.bin", hubListFile, osmFile;
+    int numOfHubs = 50, intervalMinutes = 15, firstDate = 20250504, numOfDays = NUM_OF_DAYS;
+    int numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--data") dataDir = argv[i + 1];
+        else if (arg == "--out") outFile = argv[i + 1];
+        else if (arg == "--hubs") numOfHubs = std::max(2, std::stoi(argv[i + 1]));
+        else if (arg == "--hub-list") hubListFile = argv[i + 1];
+        else if (arg == "--interval") intervalMinutes = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--date") firstDate = std::stoi(argv[i + 1]);
+        else if (arg == "--days") numOfDays = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--threads") numOfThreads = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--osm") osmFile = argv[i + 1];
+    }
+    auto start = std::chrono::steady_clock::now();
+    PreprocessOptions options;
+    options.dataDir = dataDir;
+    options.runChecker = false;
+    options.buildReportFile = "";
+    options.osmFile = osmFile;
+    auto timetable = std::make_unique<Preprocess>(options);
+    timetable->process();
+
+    std::vector<int> hubs;
+    if (!hubListFile.empty()) {
+        std::ifstream hubList(hubListFile);
+        if (!hubList.is_open()) {
+            std::cerr << "Could not open file: " << hubListFile << std::endl;
+            return 1;
+        }
+        int gtfsStopId;
+        while (hubList >> gtfsStopId) {
+            int stopId = timetable->stopIdOfGtfs(gtfsStopId);
+            if (stopId == -1) std::cerr << "Unknown hub stop: " << gtfsStopId << std::endl;
+            else if (std::find(hubs.begin(), hubs.end(), stopId) == hubs.end()) hubs.push_back(stopId);
+        }
+    } else {
+        // the busiest stops: the most trips of the week through them
+        std::vector<std::pair<long long,int>> tripsThroughStop;
+        for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+            long long numOfTrips = 0;
+            for (int routeId : timetable->Astops[stopId].routes) {
+                for (const std::vector<ATrip>& tripsOnDay : timetable->Aroutes[routeId].third) {
+                    numOfTrips += static_cast<long long>(tripsOnDay.size());
+                }
+            }
+            if (numOfTrips > 0) tripsThroughStop.emplace_back(-numOfTrips, stopId);
+        }
+        std::sort(tripsThroughStop.begin(), tripsThroughStop.end());
+        for (size_t i = 0; i < tripsThroughStop.size() && static_cast<int>(hubs.size()) < numOfHubs; i++) {
+            hubs.push_back(tripsThroughStop[i].second);
+        }
+    }
+    if (hubs.size() < 2) {
+        std::cerr << "Need at least two hubs" << std::endl;
+        return 1;
+    }
+
+    std::vector<Time> samples;
+    RAPTOR calendar(timetable->tripProfiles, timetable->Aroutes, timetable->Astops, timetable->footpathGraph,
+                    timetable->stopsData, timetable->stopCoords, timetable->tripsData); // for incrementDate
+    for (int day = 0, date = firstDate; day < numOfDays; day++, date = calendar.incrementDate(date)) {
+        for (int time = FIRST_SAMPLE_TIME; time <= LAST_SAMPLE_TIME; time += intervalMinutes * 60) {
+            samples.push_back({time, dayInWeekOf(date), date});
+        }
+    }
+
+    // every thread takes the next pair, the searches of a pair all go into its own tree
+    const size_t numOfPairs = hubs.size() * (hubs.size() - 1);
+    std::vector<PatternTrie> tries(numOfPairs);
+    std::atomic<size_t> nextPair{0};
+    std::atomic<long long> numOfJourneys{0}, numOfSkipped{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&] {
+            RAPTOR raptor(timetable->tripProfiles, timetable->Aroutes, timetable->Astops, timetable->footpathGraph,
+                          timetable->stopsData, timetable->stopCoords, timetable->tripsData);
+            raptor.verbose = false;
+            raptor.streets = &timetable->streets; // the walks from and to the hubs, a street search of this thread
+            for (size_t pair = nextPair++; pair < numOfPairs; pair = nextPair++) {
+                size_t source = pair / (hubs.size() - 1), target = pair % (hubs.size() - 1);
+                if (target >= source) target++;
+                const StopCoords& coords = timetable->stopCoords;
+                StopLocation from = {coords.lat(hubs[source]), coords.lon(hubs[source])};
+                StopLocation to = {coords.lat(hubs[target]), coords.lon(hubs[target])};
+                for (const Time& sample : samples) {
+                    JourneysToDest journeys = raptor.run(from, to, sample);
+                    for (const std::vector<UserStopState>& journey : journeys) {
+                        if (journey.empty()) continue;
+                        if (tries[pair].add(journey)) numOfJourneys++;
+                        else numOfSkipped++;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Could not open file: " << outFile << std::endl;
+        return 1;
+    }
+    uint32_t numOfStoredPairs = 0;
+    size_t numOfNodes = 0;
+    for (const PatternTrie& trie : tries) {
+        if (!trie.nodes.empty()) numOfStoredPairs++;
+        numOfNodes += trie.nodes.size();
+    }
+    unsigned char header[16];
+    std::memcpy(header, "OTTP", 4);
+    putInt(header + 4, TRANSFER_PATTERNS_VERSION, 4);
+    putInt(header + 8, hubs.size(), 4);
+    putInt(header + 12, numOfStoredPairs, 4);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    unsigned char field[12];
+    for (int hub : hubs) {
+        putInt(field, static_cast<uint32_t>(timetable->gtfsStopIdOf(hub)), 4);
+        out.write(reinterpret_cast<const char*>(field), 4);
+    }
+    for (size_t pair = 0; pair < numOfPairs; pair++) {
+        if (tries[pair].nodes.empty()) continue;
+        size_t source = pair / (hubs.size() - 1), target = pair % (hubs.size() - 1);
+        if (target >= source) target++;
+        putInt(field, source, 4);
+        putInt(field + 4, target, 4);
+        putInt(field + 8, tries[pair].nodes.size(), 4);
+        out.write(reinterpret_cast<const char*>(field), 12);
+        unsigned char record[9];
+        for (const FileNode& node : tries[pair].nodes) {
+            putInt(record, static_cast<uint32_t>(timetable->gtfsStopIdOf(node.stopId)), 4);
+            putInt(record + 4, static_cast<uint32_t>(node.parent), 4);
+            record[8] = node.flags;
+            out.write(reinterpret_cast<const char*>(record), sizeof(record));
+        }
+    }
+    std::cout << "wrote " << numOfStoredPairs << " of " << numOfPairs << " hub pairs, " << numOfNodes << " nodes from "
+              << numOfJourneys << " journeys (" << samples.size() << " departure times) to " << outFile << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    if (numOfSkipped > 0) std::cout << numOfSkipped << " journeys left out, their legs dont chain up" << std::endl;
+    return 0;
+}
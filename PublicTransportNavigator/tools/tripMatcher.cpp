@@ -0,0 +1,222 @@
+// GPS history to GTFS trip matcher.
+// the native version of the closest trip matching in LatencyPrediction add_trip_info: every history record gets the
+// scheduled trip of its route whose start time (its earliest departure) is closest to the recorded start time,
+// time of day only, ties go to the trip that comes first in trips.txt - the same answer as the pandas apply.
+// the feed is read with the Preprocess ingest, every route gets a sorted array of start times and each record is
+// one binary search, the records are split between all the cores.
+//
+// usage: tripMatcher --data data/ --history routes_history_merged.csv --out routes_history_matched.csv [--threads n]
+// the output is the history file as is with a gtfs_trip_id column appended (empty when there is no match),
+// which add_trip_info then uses instead of matching the rows itself.
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../preprocess.h"
+
+struct RouteStarts {
+    std::vector<int> startTimes; // sorted, one entry per distinct start time
+    std::vector<int> fileOrder;  // of the first trip in trips.txt that starts at that time
+};
+
+// the fields of one csv line, quoted fields may hold commas (the quotes stay in the view)
+static void splitCsvLine(std::string_view line, std::vector<std::string_view>& fields) {
+    fields.clear();
+    size_t fieldStart = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"') quoted = !quoted;
+        else if (line[i] == ',' && !quoted) {
+            fields.push_back(line.substr(fieldStart, i - fieldStart));
+            fieldStart = i + 1;
+        }
+    }
+    fields.push_back(line.substr(fieldStart));
+}
+
+static std::string_view unquote(std::string_view field) {
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"') return field.substr(1, field.size() - 2);
+    return field;
+}
+
+// seconds since midnight of a "yyyy-mm-dd hh:mm:ss" like date time, only the time of day matters for the matching.
+// a date without a time is midnight, -1 when there is nothing to parse (pandas gives NaT there)
+static int secondsSinceMidnight(std::string_view dateTime) {
+    dateTime = unquote(dateTime);
+    if (dateTime.empty()) return -1;
+    size_t colon = dateTime.find(':');
+    if (colon == std::string_view::npos) return 0;
+    size_t hourStart = colon;
+    while (hourStart > 0 && std::isdigit(static_cast<unsigned char>(dateTime[hourStart - 1]))) hourStart--;
+    int parts[3] = {0, 0, 0};
+    const char* pos = dateTime.data() + hourStart;
+    const char* end = dateTime.data() + dateTime.size();
+    for (int i = 0; i < 3 && pos < end; i++) {
+        auto [next, error] = std::from_chars(pos, end, parts[i]);
+        if (error != std::errc()) return i == 0 ? -1 : parts[0] * 3600 + parts[1] * 60;
+        pos = next;
+        if (pos < end && *pos == ':') pos++;
+        else break;
+    }
+    return parts[0] * 3600 + parts[1] * 60 + parts[2];
+}
+
+static bool parseRouteId(std::string_view field, int& routeId) {
+    field = unquote(field);
+    // pandas writes an int column with missing values as float ("12345.0"), the integer part is the id
+    return std::from_chars(field.data(), field.data() + field.size(), routeId).ec == std::errc();
+}
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "data/", historyFile, outFile = "routes_history_matched.csv";
+    int numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--data") dataDir = argv[i + 1];
+        else if (arg == "--history") historyFile = argv[i + 1];
+        else if (arg == "--out") outFile = argv[i + 1];
+        else if (arg == "--threads") numOfThreads = std::max(1, std::stoi(argv[i + 1]));
+    }
+    auto start = std::chrono::steady_clock::now();
+    PreprocessOptions options;
+    options.dataDir = dataDir;
+    auto timetable = std::make_unique<Preprocess>(options);
+    timetable->ingestTrips();
+
+    // trips.txt once more for its order, it decides the ties like idxmin does
+    std::string filename = dataDir + "trips.txt";
+    std::ifstream tripsFile(filename);
+    if (!tripsFile.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return 1;
+    }
+    std::unordered_map<int,std::vector<std::pair<int,int>>> startsByRoute; // gtfs route id -> (start time, file order)
+    std::vector<std::string> gtfsTripIds; // file order -> gtfs trip id
+    std::string line, routeIdStr, serviceIdStr, gtfsTripId;
+    std::getline(tripsFile, line); // Skip header
+    while (std::getline(tripsFile, line)) {
+        if (line.empty()) continue;
+        std::istringstream iss(line);
+        std::getline(iss, routeIdStr, ',');
+        std::getline(iss, serviceIdStr, ',');
+        std::getline(iss, gtfsTripId, ',');
+        int tripId = timetable->findTripId(gtfsTripId);
+        if (tripId == -1) continue; // no stop times, no start time
+        int startTime = std::numeric_limits<int>::max();
+        for (const TripStop& tripStop : timetable->trips[tripId]) {
+            startTime = std::min(startTime, tripStop.depTime);
+        }
+        startsByRoute[timetable->tripsData[tripId].gtfsRouteId].emplace_back(startTime, static_cast<int>(gtfsTripIds.size()));
+        gtfsTripIds.push_back(gtfsTripId);
+    }
+    std::unordered_map<int,RouteStarts> routes;
+    for (auto& [routeId, starts] : startsByRoute) {
+        std::sort(starts.begin(), starts.end());
+        RouteStarts& route = routes[routeId];
+        for (const auto& [startTime, fileOrder] : starts) {
+            if (route.startTimes.empty() || route.startTimes.back() != startTime) {
+                route.startTimes.push_back(startTime);
+                route.fileOrder.push_back(fileOrder); // the smallest one, starts is sorted by time then order
+            }
+        }
+    }
+    std::cout << "indexed " << gtfsTripIds.size() << " trips of " << routes.size() << " routes in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+
+    std::ifstream historyIn(historyFile, std::ios::binary);
+    if (!historyIn.is_open()) {
+        std::cerr << "Could not open file: " << historyFile << std::endl;
+        return 1;
+    }
+    std::vector<std::string> records;
+    std::string header;
+    std::getline(historyIn, header);
+    while (std::getline(historyIn, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) records.push_back(std::move(line));
+    }
+    std::vector<std::string_view> fields;
+    std::string_view headerView = header;
+    if (headerView.substr(0, 3) == "\xEF\xBB\xBF") headerView.remove_prefix(3); // utf-8-sig
+    if (!headerView.empty() && headerView.back() == '\r') {
+        headerView.remove_suffix(1);
+        header.pop_back();
+    }
+    splitCsvLine(headerView, fields);
+    int routeColumn = -1, startColumn = -1;
+    for (int i = 0; i < static_cast<int>(fields.size()); i++) {
+        if (unquote(fields[i]) == "route_route_id") routeColumn = i;
+        if (unquote(fields[i]) == "bitzua_history_start_dt") startColumn = i;
+    }
+    if (routeColumn == -1 || startColumn == -1) {
+        std::cerr << "The history file needs route_route_id and bitzua_history_start_dt columns" << std::endl;
+        return 1;
+    }
+
+    // the matching, each thread takes a contiguous block of records
+    std::vector<int> matches(records.size(), -1);
+    std::vector<std::thread> workers;
+    size_t blockSize = (records.size() + numOfThreads - 1) / numOfThreads;
+    for (int t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&, t] {
+            std::vector<std::string_view> recordFields;
+            size_t blockEnd = std::min(records.size(), (t + 1) * blockSize);
+            for (size_t i = t * blockSize; i < blockEnd; i++) {
+                splitCsvLine(records[i], recordFields);
+                int routeId;
+                if (static_cast<int>(recordFields.size()) <= std::max(routeColumn, startColumn) ||
+                    !parseRouteId(recordFields[routeColumn], routeId)) continue;
+                int actualStart = secondsSinceMidnight(recordFields[startColumn]);
+                auto route = routes.find(routeId);
+                if (actualStart == -1 || route == routes.end()) continue;
+                const std::vector<int>& startTimes = route->second.startTimes;
+                size_t after = std::lower_bound(startTimes.begin(), startTimes.end(), actualStart) - startTimes.begin();
+                // the closest start is right before or right after, on a tie the one earlier in trips.txt
+                int best = -1;
+                long long bestDiff = 0;
+                for (size_t candidate : {after - 1, after}) {
+                    if (candidate >= startTimes.size()) continue; // after - 1 wraps around when after is 0
+                    long long diff = std::abs(static_cast<long long>(startTimes[candidate]) - actualStart);
+                    int fileOrder = route->second.fileOrder[candidate];
+                    if (best == -1 || diff < bestDiff || (diff == bestDiff && fileOrder < best)) {
+                        best = fileOrder;
+                        bestDiff = diff;
+                    }
+                }
+                matches[i] = best;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Could not open file: " << outFile << std::endl;
+        return 1;
+    }
+    size_t matched = 0;
+    out << header << ",gtfs_trip_id\n";
+    for (size_t i = 0; i < records.size(); i++) {
+        out << records[i] << ',';
+        if (matches[i] != -1) {
+            out << gtfsTripIds[matches[i]];
+            matched++;
+        }
+        out << '\n';
+    }
+    std::cout << "matched " << matched << " of " << records.size() << " history records on " << numOfThreads
+              << " threads in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+              << "s" << std::endl;
+    return 0;
+}
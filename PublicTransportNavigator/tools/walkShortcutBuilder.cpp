@@ -0,0 +1,340 @@
+// Walk shortcut precomputation (see walkShortcuts.h), the ULTRA way: from every stop at every --interval minutes of
+// the sampled days, the earliest trip of every route at the stop, then a walk of up to --max-walk meters from every
+// stop those trips reach, then the earliest trip of every route from every stop the walks reach. a walk v -> w (the
+// candidate) is a shortcut when some stop is reached by the second trip earlier than by any journey without such a
+// walk (the witnesses): walking from the source, the first trip alone, a walk from the source and then one trip, or
+// two trips with the transfer at one stop. ties go to the witnesses.
+// two trips with one walk between them is enough: a longer journey is made of such pieces, every walk in it sits
+// between two trips. the samples stand in for the profile search over every departure of the stop that ULTRA runs,
+// like in transferPatternBuilder, and the journeys are compared where the second trip arrives - the walk to the
+// destination is the query's own.
+// the walks are measured like the footpaths: over the streets of --osm between two snapped stops, in a straight line
+// otherwise. main re measures every shortcut the same way when it loads them, so build with the --osm main runs with,
+// without it the walks here are straight lines and shortcuts that are longer over the streets are missed or dropped.
+// a shortcut is direct, main walks it over the streets itself.
+//
+// usage: walkShortcutBuilder --data data/ [--out walk_shortcuts.bin] [--max-walk 4000] [--interval 15]
+//                            [--date 20250504] [--days 7] [--threads n] [--osm <extract, the same as main's>]
+// --max-walk is at most WALK_SHORTCUT_MAX_DISTANCE, --date is the first day that is sampled, the next --days follow it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "../pedestrianGraph.h"
+#include "../preprocess.h"
+#include "../routingAlgorithm.h"
+#include "../walkShortcuts.h"
+
+#define FIRST_SAMPLE_TIME (5 * 3600)
+#define LAST_SAMPLE_TIME (23 * 3600)
+
+// 1 = sunday, the same as Time.dayInWeek
+static int dayInWeekOf(int date) {
+    std::chrono::year_month_day day{std::chrono::year(date / 10000), std::chrono::month(date / 100 % 100),
+                                    std::chrono::day(date % 100)};
+    return static_cast<int>(std::chrono::weekday(std::chrono::sys_days(day)).c_encoding()) + 1;
+}
+
+// the walks of every stop within --max-walk, the same compressed rows as the footpath graph
+struct WalkGraph {
+    std::vector<uint32_t> offsets;
+    std::vector<int> otherStopIds;
+    std::vector<int> walkTimes;
+};
+
+// one search at a time from one source stop, the arrays are reused from search to search
+class ShortcutSearch {
+public:
+    ShortcutSearch(const Preprocess& timetable_, const WalkGraph& walks_)
+        : timetable(timetable_), walks(walks_), fromSource(NUM_OF_STOPS, unreached), byFirstTrip(NUM_OF_STOPS, unreached),
+          beforeSecondTrip(NUM_OF_STOPS, {unreached, -1}), bySecondTrip(NUM_OF_STOPS, {unreached, -1, -1}),
+          routeFirstSeq(NUM_OF_ALGO_ROUTES, -1) {}
+
+    // adds the shortcuts the journeys from source leaving at time need to shortcuts
+    void run(int source, const Time& time, std::unordered_set<uint64_t>& shortcuts) {
+        clear();
+        // the witnesses that walk first: to every stop in reach, then the trips from there
+        setFromSource(source, time.curHourInSeconds);
+        for (uint32_t edge = walks.offsets[source]; edge < walks.offsets[source + 1]; edge++) {
+            setFromSource(walks.otherStopIds[edge], time.curHourInSeconds + walks.walkTimes[edge]);
+        }
+        // the first trip
+        for (int routeId : timetable.Astops[source].routes) {
+            int seq = stopSeqOf(routeId, source);
+            int tripId = seq == -1 ? -1 : earliestTrip(routeId, seq, readyTime(source, time.curHourInSeconds), time);
+            if (tripId == -1) continue;
+            const auto& routeStops = timetable.Aroutes[routeId].second;
+            for (size_t i = seq + 1; i < routeStops.size(); i++) {
+                int stopId = routeStops[i].id, arrTime = timetable.tripProfiles.arrTime(tripId, static_cast<int>(i));
+                if (arrTime >= byFirstTrip[stopId]) continue;
+                if (byFirstTrip[stopId] == unreached) reachedByFirstTrip.push_back(stopId);
+                byFirstTrip[stopId] = arrTime;
+                setBeforeSecondTrip(stopId, arrTime, -1);
+            }
+        }
+        // the candidates: a walk after the first trip, only from the stops it reaches before walking from the source would
+        for (int stopId : reachedByFirstTrip) {
+            if (byFirstTrip[stopId] >= fromSource[stopId]) continue;
+            for (uint32_t edge = walks.offsets[stopId]; edge < walks.offsets[stopId + 1]; edge++) {
+                setBeforeSecondTrip(walks.otherStopIds[edge], byFirstTrip[stopId] + walks.walkTimes[edge], stopId);
+            }
+        }
+        // the second trip, every route once from its first stop that has a label like a round of the search
+        for (int stopId : readyForSecondTrip) {
+            for (int routeId : timetable.Astops[stopId].routes) {
+                int seq = stopSeqOf(routeId, stopId);
+                if (seq == -1) continue;
+                if (routeFirstSeq[routeId] == -1) routesToScan.push_back(routeId);
+                if (routeFirstSeq[routeId] == -1 || seq < routeFirstSeq[routeId]) routeFirstSeq[routeId] = seq;
+            }
+        }
+        for (int routeId : routesToScan) {
+            const auto& routeStops = timetable.Aroutes[routeId].second;
+            int tripId = -1, depTime = unreached;
+            Label boardedWith = {unreached, -1};
+            int boardedAt = -1;
+            for (size_t i = routeFirstSeq[routeId]; i < routeStops.size(); i++) {
+                int stopId = routeStops[i].id;
+                if (tripId != -1) {
+                    int arrTime = timetable.tripProfiles.arrTime(tripId, static_cast<int>(i));
+                    Arrival& arrival = bySecondTrip[stopId];
+                    if (arrTime < arrival.time || (arrTime == arrival.time && boardedWith.walkedFrom == -1 && arrival.walkedFrom != -1)) {
+                        if (arrival.time == unreached) reachedBySecondTrip.push_back(stopId);
+                        arrival = {arrTime, boardedWith.walkedFrom, boardedAt};
+                    }
+                }
+                const Label& label = beforeSecondTrip[stopId];
+                if (label.time == unreached) continue;
+                int earlierTripId = earliestTrip(routeId, static_cast<int>(i), readyTime(stopId, label.time), time);
+                if (earlierTripId == -1) continue;
+                int earlierDepTime = timetable.tripProfiles.depTime(earlierTripId, static_cast<int>(i));
+                if (earlierDepTime < depTime || (earlierDepTime == depTime && label.walkedFrom == -1 && boardedWith.walkedFrom != -1)) {
+                    tripId = earlierTripId;
+                    depTime = earlierDepTime;
+                    boardedWith = label;
+                    boardedAt = stopId;
+                }
+            }
+        }
+        for (int stopId : reachedBySecondTrip) {
+            const Arrival& arrival = bySecondTrip[stopId];
+            if (arrival.walkedFrom != -1 && arrival.time < beforeSecondTrip[stopId].time) {
+                shortcuts.insert((static_cast<uint64_t>(arrival.walkedFrom) << 32) | static_cast<uint32_t>(arrival.boardedAt));
+            }
+        }
+    }
+private:
+    static constexpr int unreached = std::numeric_limits<int>::max();
+    struct Label {
+        int time;
+        int walkedFrom; // the stop the candidate walk started at, -1 for a witness
+    };
+    struct Arrival {
+        int time;
+        int walkedFrom;
+        int boardedAt; // the end of the walk
+    };
+
+    void clear() {
+        for (int stopId : touchedStops) fromSource[stopId] = unreached;
+        for (int stopId : reachedByFirstTrip) byFirstTrip[stopId] = unreached;
+        for (int stopId : readyForSecondTrip) beforeSecondTrip[stopId] = {unreached, -1};
+        for (int stopId : reachedBySecondTrip) bySecondTrip[stopId] = {unreached, -1, -1};
+        for (int routeId : routesToScan) routeFirstSeq[routeId] = -1;
+        touchedStops.clear();
+        reachedByFirstTrip.clear();
+        readyForSecondTrip.clear();
+        reachedBySecondTrip.clear();
+        routesToScan.clear();
+    }
+    void setFromSource(int stopId, int time) {
+        if (fromSource[stopId] == unreached) touchedStops.push_back(stopId);
+        fromSource[stopId] = std::min(fromSource[stopId], time);
+        setBeforeSecondTrip(stopId, time, -1);
+    }
+    // a candidate only replaces a label it is strictly earlier than
+    void setBeforeSecondTrip(int stopId, int time, int walkedFrom) {
+        Label& label = beforeSecondTrip[stopId];
+        if (time > label.time || (time == label.time && (walkedFrom != -1 || label.walkedFrom == -1))) return;
+        if (label.time == unreached) readyForSecondTrip.push_back(stopId);
+        label = {time, walkedFrom};
+    }
+    // the same as transferReadyTime and earliestTrip of the search
+    int readyTime(int stopId, int arrTime) const {
+        return arrTime + std::max(0, timetable.Astops[stopId].transferTime - MIN_TRANSFER_TIME * 60) + MIN_TRANSFER_TIME * 60;
+    }
+    int earliestTrip(int routeId, int seq, int readyTime, const Time& time) const {
+        const std::vector<ATrip>& tripsOfDay = timetable.Aroutes[routeId].third[time.dayInWeek - 1];
+        auto it = std::lower_bound(tripsOfDay.begin(), tripsOfDay.end(), readyTime, [this, seq](const ATrip& trip, int ready) {
+            return timetable.tripProfiles.depTime(trip.tripId, seq) < ready;
+        });
+        for (; it != tripsOfDay.end(); ++it) {
+            if (it->endDate >= time.date && time.date >= it->startDate) return it->tripId;
+        }
+        return -1;
+    }
+    // 0 based, like findStopSeq - 1
+    int stopSeqOf(int routeId, int stopId) const {
+        const std::vector<ARouteStop>& sortedByIds = timetable.Aroutes[routeId].first;
+        auto it = std::lower_bound(sortedByIds.begin(), sortedByIds.end(), stopId,
+                                   [](const ARouteStop& a, int id) { return a.id < id; });
+        return it != sortedByIds.end() && it->id == stopId ? it->stopSeqIndex - 1 : -1;
+    }
+
+    const Preprocess& timetable;
+    const WalkGraph& walks;
+    std::vector<int> fromSource; // arrival walking from the source
+    std::vector<int> byFirstTrip;
+    std::vector<Label> beforeSecondTrip; // the earliest arrival before the second trip and how
+    std::vector<Arrival> bySecondTrip;
+    std::vector<int> routeFirstSeq;
+    std::vector<int> touchedStops, reachedByFirstTrip, readyForSecondTrip, reachedBySecondTrip, routesToScan;
+};
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "data/", outFile = "walk_shortcuts.bin", osmFile;
+    int maxWalkDistance = WALK_SHORTCUT_MAX_DISTANCE, intervalMinutes = 15, firstDate = 20250504, numOfDays = NUM_OF_DAYS;
+    int numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--data") dataDir = argv[i + 1];
+        else if (arg == "--out") outFile = argv[i + 1];
+        else if (arg == "--max-walk") maxWalkDistance = std::clamp(std::stoi(argv[i + 1]), MAX_WALK_DISTANCE, WALK_SHORTCUT_MAX_DISTANCE);
+        else if (arg == "--interval") intervalMinutes = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--date") firstDate = std::stoi(argv[i + 1]);
+        else if (arg == "--days") numOfDays = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--threads") numOfThreads = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--osm") osmFile = argv[i + 1];
+    }
+    auto start = std::chrono::steady_clock::now();
+    PreprocessOptions options;
+    options.dataDir = dataDir;
+    options.runChecker = false;
+    options.buildReportFile = "";
+    options.osmFile = osmFile;
+    auto timetable = std::make_unique<Preprocess>(options);
+    timetable->process();
+
+    // the stops of the search that a trip stops at, and every walk between two of them (the same 9 boxes as the footpaths)
+    std::vector<int> sources;
+    for (const auto& [cell, stopIds] : timetable->stopCoords.cellStops) {
+        for (int stopId : stopIds) {
+            if (!timetable->Astops[stopId].routes.empty()) sources.push_back(stopId);
+        }
+    }
+    std::sort(sources.begin(), sources.end());
+    // the walk lengths are the ones Preprocess::footpathsForStop gives the shortcuts: over the streets when both stops
+    // are snapped and the source is near the graph, else in a straight line. a street walk is never shorter than the
+    // straight line, so the 9 boxes still hold every stop in reach
+    const StopCoords& coords = timetable->stopCoords;
+    const StreetNetwork& streets = timetable->streets;
+    std::vector<std::vector<std::pair<int,int>>> walksOfStop(NUM_OF_STOPS);
+    std::atomic<size_t> nextWalkSource{0};
+    std::atomic<long long> numOfFootpaths{0}; // the walks under MAX_WALK_DISTANCE, what the footpath graph would hold
+    std::vector<std::thread> walkWorkers;
+    for (int t = 0; t < numOfThreads; t++) {
+        walkWorkers.emplace_back([&] {
+            std::unique_ptr<PedestrianSearch> streetSearch = streets.empty() ? nullptr : std::make_unique<PedestrianSearch>(*streets.graph);
+            std::vector<std::pair<int,double>> streetWalks;
+            long long footpaths = 0;
+            for (size_t source = nextWalkSource++; source < sources.size(); source = nextWalkSource++) {
+                const int stopId = sources[source];
+                const double lat = coords.lat(stopId), lon = coords.lon(stopId);
+                streetWalks.clear();
+                const bool onStreets = streetSearch && streets.snapped(stopId) &&
+                    streets.walkableStops(*streetSearch, lat, lon, maxWalkDistance, streetWalks);
+                std::sort(streetWalks.begin(), streetWalks.end());
+                for (uint32_t cell : Geohash::getCellNeighbors(coords.cells[stopId], GEO_HASH_PRESITION)) {
+                    auto box = coords.cellStops.find(cell);
+                    if (box == coords.cellStops.end()) continue;
+                    for (int otherStopId : box->second) {
+                        if (otherStopId == stopId || timetable->Astops[otherStopId].routes.empty()) continue;
+                        double distance = haversineDistance(lat, lon, coords.lat(otherStopId), coords.lon(otherStopId));
+                        if (onStreets && streets.snapped(otherStopId)) {
+                            auto walk = std::lower_bound(streetWalks.begin(), streetWalks.end(), std::make_pair(otherStopId, 0.0));
+                            if (walk == streetWalks.end() || walk->first != otherStopId) continue; // farther over the streets
+                            distance = walk->second;
+                        }
+                        if (distance > maxWalkDistance) continue;
+                        walksOfStop[stopId].emplace_back(otherStopId, calculateWalkTime(distance));
+                        if (distance < MAX_WALK_DISTANCE) footpaths++;
+                    }
+                }
+            }
+            numOfFootpaths += footpaths;
+        });
+    }
+    for (std::thread& worker : walkWorkers) {
+        worker.join();
+    }
+    WalkGraph walks;
+    for (int stopId = 0; stopId < NUM_OF_STOPS; stopId++) {
+        walks.offsets.push_back(static_cast<uint32_t>(walks.otherStopIds.size()));
+        for (const auto& [otherStopId, walkTime] : walksOfStop[stopId]) {
+            walks.otherStopIds.push_back(otherStopId);
+            walks.walkTimes.push_back(walkTime);
+        }
+    }
+    walks.offsets.push_back(static_cast<uint32_t>(walks.otherStopIds.size()));
+    std::vector<std::vector<std::pair<int,int>>>().swap(walksOfStop);
+
+    std::vector<Time> samples;
+    RAPTOR calendar(timetable->tripProfiles, timetable->Aroutes, timetable->Astops, timetable->footpathGraph,
+                    timetable->stopsData, timetable->stopCoords, timetable->tripsData); // for incrementDate
+    for (int day = 0, date = firstDate; day < numOfDays; day++, date = calendar.incrementDate(date)) {
+        for (int time = FIRST_SAMPLE_TIME; time <= LAST_SAMPLE_TIME; time += intervalMinutes * 60) {
+            samples.push_back({time, dayInWeekOf(date), date});
+        }
+    }
+
+    // every thread takes the next source stop and keeps its own shortcuts, they are merged at the end
+    std::atomic<size_t> nextSource{0};
+    std::mutex mergeMutex;
+    std::unordered_set<uint64_t> shortcuts;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&] {
+            ShortcutSearch search(*timetable, walks);
+            std::unordered_set<uint64_t> found;
+            for (size_t source = nextSource++; source < sources.size(); source = nextSource++) {
+                for (const Time& sample : samples) {
+                    search.run(sources[source], sample, found);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            shortcuts.insert(found.begin(), found.end());
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    WalkShortcutFile file;
+    file.maxWalkDistance = maxWalkDistance;
+    long long longerThanFootpaths = 0;
+    for (uint64_t shortcut : shortcuts) {
+        int from = static_cast<int>(shortcut >> 32), to = static_cast<int>(shortcut & 0xffffffffu);
+        file.shortcuts.push_back({timetable->gtfsStopIdOf(from), timetable->gtfsStopIdOf(to)});
+        // by walk time, the lengths are over the streets when there are streets
+        for (uint32_t edge = walks.offsets[from]; edge < walks.offsets[from + 1]; edge++) {
+            if (walks.otherStopIds[edge] == to && walks.walkTimes[edge] >= calculateWalkTime(MAX_WALK_DISTANCE)) longerThanFootpaths++;
+        }
+    }
+    std::sort(file.shortcuts.begin(), file.shortcuts.end(), [](const WalkShortcut& shortcut1, const WalkShortcut& shortcut2) {
+        return shortcut1.fromGtfsStopId < shortcut2.fromGtfsStopId ||
+               (shortcut1.fromGtfsStopId == shortcut2.fromGtfsStopId && shortcut1.toGtfsStopId < shortcut2.toGtfsStopId);
+    });
+    if (!writeWalkShortcuts(outFile, file)) return 1;
+    std::cout << "wrote " << file.shortcuts.size() << " shortcuts (" << longerThanFootpaths << " longer than MAX_WALK_DISTANCE) of "
+              << walks.otherStopIds.size() << " walks up to " << maxWalkDistance << "m from " << sources.size() << " stops ("
+              << samples.size() << " departure times) to " << outFile << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s, the footpath graph has "
+              << numOfFootpaths << " walks up to " << MAX_WALK_DISTANCE << "m" << (streets.empty() ? ", straight line walks" : ", walks over the streets") << std::endl;
+    return 0;
+}
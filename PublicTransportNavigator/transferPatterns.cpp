@@ -0,0 +1,171 @@
+#include "transferPatterns.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include "geoUtil.h"
+
+// the same explicit little endian reading as the delay table
+static uint64_t getInt(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+// the stop sequences (1 based) of stopId on the route, a route can pass twice through a station
+static std::pair<std::vector<ARouteStop>::const_iterator,std::vector<ARouteStop>::const_iterator> stopSeqsOf(
+    const std::vector<ARouteStop>& sortedByIds, int stopId) {
+    auto first = std::lower_bound(sortedByIds.begin(), sortedByIds.end(), stopId,
+                                  [](const ARouteStop& a, int id) { return a.id < id; });
+    auto last = std::upper_bound(first, sortedByIds.end(), stopId,
+                                 [](int id, const ARouteStop& a) { return id < a.id; });
+    return {first, last};
+}
+
+// the shortest walk over the footpaths of the timetable, -1 = none. a walk of a journey can be more than one
+// footpath, the search merges the footpaths it takes one after another (a footpath in every round) into one leg
+static int footpathWalkTime(const FootpathGraph& footpaths, int fromStopId, int toStopId) {
+    std::unordered_map<int,int> walkTimes = {{fromStopId, 0}};
+    std::priority_queue<std::pair<int,int>,std::vector<std::pair<int,int>>,std::greater<>> queue;
+    queue.push({0, fromStopId});
+    while (!queue.empty()) {
+        auto [walkTime, stopId] = queue.top();
+        queue.pop();
+        if (stopId == toStopId) return walkTime;
+        if (walkTime > walkTimes[stopId]) continue;
+        for (uint32_t footpath = footpaths.begin(stopId); footpath < footpaths.end(stopId); footpath++) {
+            int otherStopId = footpaths.otherStopIds[footpath];
+            int otherWalkTime = walkTime + footpaths.walkTimes[footpath];
+            auto [it, inserted] = walkTimes.try_emplace(otherStopId, otherWalkTime);
+            if (!inserted && it->second <= otherWalkTime) continue;
+            it->second = otherWalkTime;
+            queue.push({otherWalkTime, otherStopId});
+        }
+    }
+    return -1;
+}
+
+bool TransferPatterns::load(const std::string& filename, const Preprocessor& timetable) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[16];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, "OTTP", 4) != 0 ||
+        getInt(header + 4, 4) != TRANSFER_PATTERNS_VERSION) {
+        std::cerr << "Not a transfer pattern file: " << filename << std::endl;
+        return false;
+    }
+    uint32_t numOfFileHubs = getInt(header + 8, 4), numOfFilePairs = getInt(header + 12, 4);
+    auto truncated = [&] {
+        std::cerr << "Truncated transfer pattern file: " << filename << std::endl;
+        hubs.clear();
+        trees.clear();
+        nodes.clear();
+        connections.clear();
+        return false;
+    };
+    std::vector<int> hubStops(numOfFileHubs, -1);
+    unsigned char field[12];
+    for (uint32_t hub = 0; hub < numOfFileHubs; hub++) {
+        if (!file.read(reinterpret_cast<char*>(field), 4)) return truncated();
+        hubStops[hub] = timetable.stopIdOfGtfs(static_cast<int32_t>(getInt(field, 4)));
+        if (hubStops[hub] != -1) {
+            hubs.push_back({hubStops[hub], timetable.stopCoords.lat(hubStops[hub]), timetable.stopCoords.lon(hubStops[hub])});
+        }
+    }
+
+    int droppedNodes = 0;
+    std::vector<int> newIndex; // file node -> node of the tree, -1 = dropped with its subtree
+    for (uint32_t pair = 0; pair < numOfFilePairs; pair++) {
+        if (!file.read(reinterpret_cast<char*>(field), 12)) return truncated();
+        uint32_t sourceHub = getInt(field, 4), targetHub = getInt(field + 4, 4), numOfNodes = getInt(field + 8, 4);
+        bool hubsKnown = sourceHub < numOfFileHubs && targetHub < numOfFileHubs &&
+                         hubStops[sourceHub] != -1 && hubStops[targetHub] != -1;
+        PatternTree tree = {static_cast<uint32_t>(nodes.size()), 0};
+        newIndex.assign(numOfNodes, -1);
+        unsigned char record[9];
+        for (uint32_t fileNode = 0; fileNode < numOfNodes; fileNode++) {
+            if (!file.read(reinterpret_cast<char*>(record), sizeof(record))) return truncated();
+            int stopId = timetable.stopIdOfGtfs(static_cast<int32_t>(getInt(record, 4)));
+            int fileParent = static_cast<int32_t>(getInt(record + 4, 4));
+            uint8_t flags = record[8];
+            // a stop that left the feed takes the patterns through it along
+            if (!hubsKnown || stopId == -1 || fileParent >= static_cast<int>(fileNode) ||
+                (fileParent != -1 && newIndex[fileParent] == -1)) {
+                droppedNodes++;
+                continue;
+            }
+            PatternNode node = {stopId, fileParent == -1 ? -1 : newIndex[fileParent], flags, 0,
+                                static_cast<uint32_t>(connections.size()), 0};
+            if (node.parent != -1) {
+                int parentStopId = nodes[tree.firstNode + node.parent].stopId;
+                if (flags & PATTERN_NODE_WALK) {
+                    // the walk the search takes between the two stops, over the streets when the timetable has them
+                    node.walkTime = footpathWalkTime(timetable.footpathGraph, parentStopId, stopId);
+                    if (node.walkTime == -1) { // out of walking reach in this timetable
+                        droppedNodes++;
+                        continue;
+                    }
+                } else {
+                    // the direct connections: every route that serves the parent stop and later this stop
+                    for (int routeId : timetable.Astops[parentStopId].routes) {
+                        const std::vector<ARouteStop>& sortedByIds = timetable.Aroutes[routeId].first;
+                        auto [fromBegin, fromEnd] = stopSeqsOf(sortedByIds, parentStopId);
+                        auto [toBegin, toEnd] = stopSeqsOf(sortedByIds, stopId);
+                        for (auto from = fromBegin; from != fromEnd; ++from) {
+                            // alight at the first time the route reaches the stop after boarding, as the search does
+                            int toSeq = std::numeric_limits<int>::max();
+                            for (auto to = toBegin; to != toEnd; ++to) {
+                                if (to->stopSeqIndex > from->stopSeqIndex) toSeq = std::min(toSeq, to->stopSeqIndex);
+                            }
+                            if (toSeq != std::numeric_limits<int>::max()) {
+                                connections.push_back({routeId, from->stopSeqIndex - 1, toSeq - 1});
+                            }
+                        }
+                    }
+                    node.numOfConnections = static_cast<uint32_t>(connections.size()) - node.firstConnection;
+                    if (node.numOfConnections == 0) { // no route left between the two stops
+                        droppedNodes++;
+                        continue;
+                    }
+                }
+            }
+            newIndex[fileNode] = static_cast<int>(tree.numOfNodes++);
+            nodes.push_back(node);
+        }
+        if (tree.numOfNodes > 0) {
+            trees[pairKey(hubStops[sourceHub], hubStops[targetHub])] = tree;
+        }
+    }
+    std::cout << "transfer patterns: " << hubs.size() << " hubs, " << trees.size() << " pairs, " << nodes.size()
+              << " nodes, " << connections.size() << " connections";
+    if (droppedNodes > 0) std::cout << ", " << droppedNodes << " nodes not in this timetable";
+    std::cout << std::endl;
+    return true;
+}
+
+int TransferPatterns::hubAt(double lat, double lon) const {
+    // a few hundred hubs at most, a scan is cheaper than the search it saves
+    int bestStopId = -1;
+    double bestDistance = TRANSFER_PATTERN_HUB_RADIUS;
+    for (const Hub& hub : hubs) {
+        double distance = haversineDistance(lat, lon, hub.lat, hub.lon);
+        if (distance <= bestDistance) {
+            bestDistance = distance;
+            bestStopId = hub.stopId;
+        }
+    }
+    return bestStopId;
+}
+
+size_t TransferPatterns::memoryBytes() const {
+    return hubs.capacity() * sizeof(Hub) + trees.size() * (sizeof(uint64_t) + sizeof(PatternTree) + 2 * sizeof(void*)) +
+           nodes.capacity() * sizeof(PatternNode) + connections.capacity() * sizeof(PatternConnection);
+}
@@ -0,0 +1,77 @@
+#ifndef TRANSFERPATTERNS_H
+#define TRANSFERPATTERNS_H
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "preprocess.h"
+
+// transfer patterns of hot hub pairs, computed offline (tools/transferPatternBuilder) from searches between the hubs at
+// many times of the week. a pattern is the sequence of stops where a journey boards, alights and walks, without the
+// trips - at query time the trips come from the timetable, so a pattern stays valid while the schedule changes.
+// the patterns of a hub pair share their prefixes, a tree per pair whose roots are the access stops and where every
+// node that ends a journey is marked for the egress walk. the walks are the ones the search takes: the footpaths of
+// the timetable between stops and RAPTOR::getFootpathsFromStop from and to the query locations, over the streets
+// when there are any.
+// file format, little endian:
+//   "OTTP", uint32 version, uint32 numOfHubs, uint32 numOfPairs
+//   numOfHubs x int32 gtfsStopId
+//   numOfPairs x { uint32 sourceHub, uint32 targetHub, uint32 numOfNodes,
+//                  numOfNodes x { int32 gtfsStopId, int32 parent (-1 = root), uint8 flags } }   parent < node
+#define TRANSFER_PATTERNS_VERSION 1
+#define TRANSFER_PATTERN_HUB_RADIUS 100 // a query location this close to a hub (meters) uses the patterns of the hub
+#define PATTERN_NODE_WALK 1 // reached by walking from the parent, otherwise by one trip from the parent
+#define PATTERN_NODE_EGRESS 2 // a journey ends here and walks to the destination
+
+// a route that goes from the stop of the parent to the stop of a node, with the 0 based stop sequences of both
+struct PatternConnection {
+    int routeId;
+    int fromSeq;
+    int toSeq;
+};
+struct PatternNode {
+    int stopId;
+    int parent; // index in the same pair, -1 = an access stop
+    uint8_t flags;
+    int walkTime; // PATTERN_NODE_WALK only, over the footpaths of the timetable between the two stops
+    uint32_t firstConnection; // in TransferPatterns::connections, trip nodes only
+    uint32_t numOfConnections;
+};
+struct PatternTree {
+    uint32_t firstNode; // in TransferPatterns::nodes
+    uint32_t numOfNodes;
+};
+
+class TransferPatterns {
+public:
+    // resolves the stops of the file and the routes between them in timetable, so the patterns are tied to one timetable version
+    bool load(const std::string& filename, const Preprocessor& timetable);
+    // the hub within TRANSFER_PATTERN_HUB_RADIUS of the location, -1 if there is none
+    int hubAt(double lat, double lon) const;
+    // the patterns from one hub stop to another, null when the pair wasnt precomputed
+    const PatternTree* tree(int sourceHub, int targetHub) const {
+        auto found = trees.find(pairKey(sourceHub, targetHub));
+        return found == trees.end() ? nullptr : &found->second;
+    }
+    const PatternNode& node(const PatternTree& tree, int index) const { return nodes[tree.firstNode + index]; }
+    const PatternConnection* connectionsBegin(const PatternNode& node) const { return connections.data() + node.firstConnection; }
+    const PatternConnection* connectionsEnd(const PatternNode& node) const { return connections.data() + node.firstConnection + node.numOfConnections; }
+    int numOfHubs() const { return static_cast<int>(hubs.size()); }
+    int numOfPairs() const { return static_cast<int>(trees.size()); }
+    size_t memoryBytes() const;
+private:
+    static uint64_t pairKey(int sourceHub, int targetHub) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(sourceHub)) << 32) | static_cast<uint32_t>(targetHub);
+    }
+    struct Hub {
+        int stopId;
+        double lat;
+        double lon;
+    };
+    std::vector<Hub> hubs;
+    std::unordered_map<uint64_t,PatternTree> trees; // pairKey of the hub stops -> its nodes
+    std::vector<PatternNode> nodes;
+    std::vector<PatternConnection> connections;
+};
+
+#endif //TRANSFERPATTERNS_H
@@ -0,0 +1,72 @@
+#include "walkShortcuts.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// the same explicit little endian reading and writing as the transfer patterns
+static uint64_t getInt(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+static void putInt(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+bool readWalkShortcuts(const std::string& filename, WalkShortcutFile& file) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[16];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, "OTWS", 4) != 0 ||
+        getInt(header + 4, 4) != WALK_SHORTCUTS_VERSION) {
+        std::cerr << "Not a walk shortcut file: " << filename << std::endl;
+        return false;
+    }
+    file.maxWalkDistance = static_cast<int>(getInt(header + 8, 4));
+    if (file.maxWalkDistance > WALK_SHORTCUT_MAX_DISTANCE) {
+        std::cerr << "Walk shortcuts longer than WALK_SHORTCUT_MAX_DISTANCE: " << filename << std::endl;
+        return false;
+    }
+    uint32_t numOfShortcuts = getInt(header + 12, 4);
+    file.shortcuts.clear();
+    file.shortcuts.reserve(numOfShortcuts);
+    unsigned char record[8];
+    for (uint32_t i = 0; i < numOfShortcuts; i++) {
+        if (!in.read(reinterpret_cast<char*>(record), sizeof(record))) {
+            std::cerr << "Truncated walk shortcut file: " << filename << std::endl;
+            file.shortcuts.clear();
+            return false;
+        }
+        file.shortcuts.push_back({static_cast<int32_t>(getInt(record, 4)), static_cast<int32_t>(getInt(record + 4, 4))});
+    }
+    return true;
+}
+
+bool writeWalkShortcuts(const std::string& filename, const WalkShortcutFile& file) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+    unsigned char header[16];
+    std::memcpy(header, "OTWS", 4);
+    putInt(header + 4, WALK_SHORTCUTS_VERSION, 4);
+    putInt(header + 8, static_cast<uint32_t>(file.maxWalkDistance), 4);
+    putInt(header + 12, file.shortcuts.size(), 4);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    unsigned char record[8];
+    for (const WalkShortcut& shortcut : file.shortcuts) {
+        putInt(record, static_cast<uint32_t>(shortcut.fromGtfsStopId), 4);
+        putInt(record + 4, static_cast<uint32_t>(shortcut.toGtfsStopId), 4);
+        out.write(reinterpret_cast<const char*>(record), sizeof(record));
+    }
+    return static_cast<bool>(out);
+}
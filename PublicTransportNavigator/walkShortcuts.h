@@ -0,0 +1,31 @@
+#ifndef WALKSHORTCUTS_H
+#define WALKSHORTCUTS_H
+#include <string>
+#include <vector>
+
+// the walks between stops that some optimal journey needs when walking is not limited to MAX_WALK_DISTANCE, computed
+// offline (tools/walkShortcutBuilder, like ULTRA: a search from every stop with one trip, a walk of any length and
+// one more trip keeps the walks that no other journey matches). the search relaxes only these shortcuts instead of all
+// the stops in walking distance, so a long walk costs no more than today's footpaths where it isnt needed.
+// only the two stops are stored, the walk time comes from their coordinates in the timetable that loads the file.
+// file format, little endian:
+//   "OTWS", uint32 version, uint32 maxWalkDistance (meters), uint32 numOfShortcuts
+//   numOfShortcuts x { int32 fromGtfsStopId, int32 toGtfsStopId }
+#define WALK_SHORTCUTS_VERSION 1
+// meters, the longest walk there is a shortcut for: the stops in the 9 geohash boxes around a stop (GEO_HASH_PRESITION 5,
+// ~4.9 x 4.9 km at the equator, narrower to the poles) are all within it up to about 35 degrees of latitude
+#define WALK_SHORTCUT_MAX_DISTANCE 4000
+
+struct WalkShortcut {
+    int fromGtfsStopId;
+    int toGtfsStopId;
+};
+struct WalkShortcutFile {
+    int maxWalkDistance = WALK_SHORTCUT_MAX_DISTANCE; // also how far the query locations walk to and from the stops
+    std::vector<WalkShortcut> shortcuts;
+};
+
+bool readWalkShortcuts(const std::string& filename, WalkShortcutFile& file);
+bool writeWalkShortcuts(const std::string& filename, const WalkShortcutFile& file);
+
+#endif //WALKSHORTCUTS_H